@@ -114,7 +114,6 @@ QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
 QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
 {
     QByteArray out;
-    out.resize(1024);
     int err;
     z_stream strm;
     strm.zalloc = Z_NULL;
@@ -122,8 +121,6 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
     strm.opaque = Z_NULL;
     strm.next_in = (Bytef *) data.data();
     strm.avail_in = data.length();
-    strm.next_out = (Bytef *) out.data();
-    strm.avail_out = out.size();
 
     const int windowBits = (method == Gzip) ? 15 + 16 : 15;
 
@@ -134,6 +131,12 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
         return QByteArray();
     }
 
+    // Size the output so deflate() finishes in one call.  The loop below
+    // still grows it should an older zlib underestimate.
+    out.resize(int(deflateBound(&strm, data.length())));
+    strm.next_out = (Bytef *) out.data();
+    strm.avail_out = out.size();
+
     do {
         err = deflate(&strm, Z_FINISH);
         Q_ASSERT(err != Z_STREAM_ERROR);
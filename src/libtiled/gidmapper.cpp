@@ -24,6 +24,8 @@
 #include "tileset.h"
 #include "map.h"
 
+#include <climits>
+
 using namespace Tiled;
 
 // Bits on the far end of the 32-bit global tile ID are used for tile flags
@@ -44,6 +46,18 @@ GidMapper::GidMapper(const QList<Tileset *> &tilesets)
     }
 }
 
+void GidMapper::insert(uint firstGid, Tileset *tileset)
+{
+    mFirstGidToTileset.insert(firstGid, tileset);
+
+    // If a tileset is inserted more than once, the lowest first GID wins.
+    QHash<const Tileset*, uint>::iterator it = mTilesetToFirstGid.find(tileset);
+    if (it == mTilesetToFirstGid.end())
+        mTilesetToFirstGid.insert(tileset, firstGid);
+    else if (firstGid < it.value())
+        it.value() = firstGid;
+}
+
 Cell GidMapper::gidToCell(uint gid, bool &ok) const
 {
     Cell result;
@@ -89,6 +103,52 @@ Cell GidMapper::gidToCell(uint gid, bool &ok) const
     return result;
 }
 
+Cell GidMapper::gidToCell(uint gid, bool &ok, Cache &cache) const
+{
+    Cell result;
+
+    // Read out the flags
+    result.flippedHorizontally = (gid & FlippedHorizontallyFlag);
+    result.flippedVertically = (gid & FlippedVerticallyFlag);
+    result.flippedAntiDiagonally = (gid & FlippedAntiDiagonallyFlag);
+
+    // Clear the flags
+    gid &= ~(FlippedHorizontallyFlag |
+             FlippedVerticallyFlag |
+             FlippedAntiDiagonallyFlag);
+
+    ok = true;
+    if (gid == 0)
+        return result;
+
+    if (gid < cache.firstGid || gid >= cache.endGid) {
+        // Find the tileset containing this tile
+        QMap<uint, Tileset*>::const_iterator i = mFirstGidToTileset.upperBound(gid);
+        if (i == mFirstGidToTileset.constBegin()) {
+            ok = false;
+            return result;
+        }
+        cache.endGid = (i == mFirstGidToTileset.constEnd()) ? UINT_MAX : i.key();
+        --i; // Navigate one tileset back since upper bound finds the next
+        cache.firstGid = i.key();
+        cache.tileset = i.value();
+        cache.columnCount = cache.tileset ? mTilesetColumnCounts.value(cache.tileset) : 0;
+    }
+
+    if (const Tileset *tileset = cache.tileset) {
+        int tileId = gid - cache.firstGid;
+        if (cache.columnCount > 0 && cache.columnCount != tileset->columnCount()) {
+            // Correct tile index for changes in image width
+            const int row = tileId / cache.columnCount;
+            const int column = tileId % cache.columnCount;
+            tileId = row * tileset->columnCount() + column;
+        }
+        result.tile = tileset->tileAt(tileId);
+    }
+
+    return result;
+}
+
 uint GidMapper::cellToGid(const Cell &cell) const
 {
     if (cell.isEmpty())
@@ -97,15 +157,11 @@ uint GidMapper::cellToGid(const Cell &cell) const
     const Tileset *tileset = cell.tile->tileset();
 
     // Find the first GID for the tileset
-    QMap<uint, Tileset*>::const_iterator i = mFirstGidToTileset.begin();
-    QMap<uint, Tileset*>::const_iterator i_end = mFirstGidToTileset.end();
-    while (i != i_end && i.value() != tileset)
-        ++i;
-
-    if (i == i_end) // tileset not found
+    const uint first = firstGid(tileset);
+    if (first == 0) // tileset not found
         return 0;
 
-    uint gid = i.key() + cell.tile->id();
+    uint gid = first + cell.tile->id();
     if (cell.flippedHorizontally)
         gid |= FlippedHorizontallyFlag;
     if (cell.flippedVertically)
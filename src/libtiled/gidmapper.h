@@ -23,6 +23,7 @@
 
 #include "tilelayer.h"
 
+#include <QHash>
 #include <QMap>
 
 namespace Tiled {
@@ -46,14 +47,20 @@ public:
 
     /**
      * Insert the given \a tileset with \a firstGid as its first global ID.
+     * A tileset may share the first GID of another one that stands for the
+     * same tiles; cellToGid() then works for both, and gidToCell() returns
+     * the last one inserted.
      */
-    void insert(uint firstGid, Tileset *tileset)
-    { mFirstGidToTileset.insert(firstGid, tileset); }
+    void insert(uint firstGid, Tileset *tileset);
 
     /**
      * Clears the gid mapper, so that it can be reused.
      */
-    void clear() { mFirstGidToTileset.clear(); }
+    void clear()
+    {
+        mFirstGidToTileset.clear();
+        mTilesetToFirstGid.clear();
+    }
 
     /**
      * Returns true when no tilesets are known to this gid mapper.
@@ -66,12 +73,44 @@ public:
      */
     Cell gidToCell(uint gid, bool &ok) const;
 
+    /**
+     * The tileset found by the last cached gidToCell() call.
+     */
+    class Cache
+    {
+    public:
+        Cache() :
+            firstGid(1),
+            endGid(0),
+            tileset(0),
+            columnCount(0)
+        {}
+
+        uint firstGid;
+        uint endGid;
+        const Tileset *tileset;
+        int columnCount;
+    };
+
+    /**
+     * Like gidToCell(), but runs of gids from the same tileset only look up
+     * the tileset once.  Used when reading whole layers.
+     */
+    Cell gidToCell(uint gid, bool &ok, Cache &cache) const;
+
     /**
      * Returns the global tile ID for the given \a cell. Returns 0 when the
      * cell is empty or when its tileset isn't known.
      */
     uint cellToGid(const Cell &cell) const;
 
+    /**
+     * Returns the first global ID of the given \a tileset, or 0 when the
+     * tileset isn't known.
+     */
+    uint firstGid(const Tileset *tileset) const
+    { return mTilesetToFirstGid.value(tileset); }
+
     /**
      * This sets the original tileset width. In case the image size has
      * changed, the tile indexes will be adjusted automatically when using
@@ -81,6 +120,7 @@ public:
 
 private:
     QMap<uint, Tileset*> mFirstGidToTileset;
+    QHash<const Tileset*, uint> mTilesetToFirstGid; // reverse of the above
     QMap<const Tileset*, int> mTilesetColumnCounts;
 };
 
@@ -311,7 +311,7 @@ void IsometricRenderer::drawTileLayer(QPainter *painter,
                     painter->setTransform(transform * baseTransform);
 
 #ifdef ZOMBOID
-                    painter->drawImage(0, 0, img);
+                    painter->drawImage(QPointF(), cell.tile->atlas(), cell.tile->atlasRect());
 #else
                     painter->drawPixmap(0, 0, img);
 #endif
@@ -459,7 +459,7 @@ void IsometricRenderer::drawTileLayerGroup(QPainter *painter, ZTileLayerGroup *l
 
                         painter->setOpacity(opacities[i] * opacity);
 
-                        painter->drawImage(0, 0, img);
+                        painter->drawImage(QPointF(), cell->tile->atlas(), cell->tile->atlasRect());
                     }
                 }
             }
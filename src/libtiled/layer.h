@@ -228,7 +228,7 @@ protected:
     Layer *initializeClone(Layer *clone) const;
 
 #ifdef ZOMBOID
-    void addReference(Tileset *ts);
+    void addReference(Tileset *ts, int count = 1);
     void removeReference(Tileset *ts);
     QMap<Tileset*,int> mUsedTilesets;
 #endif
@@ -50,6 +50,7 @@
 using namespace SharedTools;
 #endif
 #include <QXmlStreamReader>
+#include <QtEndian>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -93,7 +94,7 @@ private:
     void decodeBinaryLayerData(TileLayer *tileLayer,
                                QStringView text,
                                QStringView compression);
-    void decodeCSVLayerData(TileLayer *tileLayer, const QString &text);
+    void decodeCSVLayerData(TileLayer *tileLayer, QStringView text);
 
     /**
      * Returns the cell for the given global tile ID. Errors are raised with
@@ -104,6 +105,7 @@ private:
      *         empty cell if not found
      */
     Cell cellForGid(uint gid);
+    Cell cellForGid(uint gid, GidMapper::Cache &cache);
 
     ImageLayer *readImageLayer();
     void readImageLayerImage(ImageLayer *imageLayer);
@@ -138,6 +140,10 @@ private:
     GidMapper mGidMapper;
     bool mReadingExternalTileset;
 
+    // Reused by every layer to avoid allocating per layer.
+    QByteArray mLayerBytes;
+    QVector<Cell> mLayerCells;
+
     QXmlStreamReader xml;
 };
 
@@ -490,7 +496,7 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
                                       xml.text(),
                                       compression);
             } else if (encoding == QLatin1String("csv")) {
-                decodeCSVLayerData(tileLayer, xml.text().toString());
+                decodeCSVLayerData(tileLayer, xml.text());
             } else {
                 xml.raiseError(tr("Unknown encoding: %1")
                                .arg(encoding.toString()));
@@ -500,26 +506,65 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
     }
 }
 
+static inline int base64Value(ushort c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+// Decodes base64 text into 'out' without converting it to Latin-1 first.
+// Like QByteArray::fromBase64(), characters outside the alphabet are skipped.
+static void decodeBase64(QStringView text, QByteArray &out)
+{
+    out.resize(int(text.size() / 4 * 3 + 3));
+    char *dest = out.data();
+    uint bits = 0;
+    int numBits = 0;
+    for (int i = 0; i < text.size(); i++) {
+        const ushort c = text.at(i).unicode();
+        const int value = base64Value(c);
+        if (value < 0) {
+            if (c == '=')
+                break;
+            continue;
+        }
+        bits = (bits << 6) | uint(value);
+        numBits += 6;
+        if (numBits >= 8) {
+            numBits -= 8;
+            *dest++ = char(bits >> numBits);
+        }
+    }
+    out.resize(int(dest - out.constData()));
+}
+
 void MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
                                              QStringView text,
                                              QStringView compression)
 {
-#if QT_VERSION < 0x040800
-    const QString textData = QString::fromRawData(text.unicode(), text.size());
-    const QByteArray latin1Text = textData.toLatin1();
-#else
-    const QByteArray latin1Text = text.toLatin1();
-#endif
-    QByteArray tileData = QByteArray::fromBase64(latin1Text);
-    const int size = (tileLayer->width() * tileLayer->height()) * 4;
+    decodeBase64(text, mLayerBytes);
+    const int count = tileLayer->width() * tileLayer->height();
+    const int size = count * 4;
 
+    QByteArray tileData;
     if (compression == QLatin1String("zlib")
         || compression == QLatin1String("gzip")) {
-        tileData = decompress(tileData, size);
+        tileData = decompress(mLayerBytes, size);
     } else if (!compression.isEmpty()) {
         xml.raiseError(tr("Compression method '%1' not supported")
                        .arg(compression.toString()));
         return;
+    } else {
+        tileData = mLayerBytes;
     }
 
     if (size != tileData.length()) {
@@ -528,25 +573,17 @@ void MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
         return;
     }
 
-    const unsigned char *data =
-            reinterpret_cast<const unsigned char*>(tileData.constData());
-    int x = 0;
-    int y = 0;
-
-    for (int i = 0; i < size - 3; i += 4) {
-        const uint gid = data[i] |
-                         data[i + 1] << 8 |
-                         data[i + 2] << 16 |
-                         data[i + 3] << 24;
-
-        tileLayer->setCell(x, y, cellForGid(gid));
-
-        x++;
-        if (x == tileLayer->width()) {
-            x = 0;
-            y++;
-        }
+    const uchar *data = reinterpret_cast<const uchar*>(tileData.constData());
+    GidMapper::Cache cache;
+    mLayerCells.resize(count);
+    Cell *cells = mLayerCells.data();
+    for (int i = 0; i < count; i++) {
+        cells[i] = cellForGid(qFromLittleEndian<quint32>(data + i * 4), cache);
+        if (xml.hasError())
+            return;
     }
+
+    tileLayer->setCells(mLayerCells);
 }
 
 #if defined(ZOMBOID) /*&& defined(_DEBUG)*/
@@ -568,61 +605,61 @@ void QString_split(const QChar &sep, Qt::SplitBehavior behavior, Qt::CaseSensiti
 }
 #endif
 
-void MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer, const QString &text)
+void MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer, QStringView text)
 {
 #if defined(ZOMBOID) /*&& defined(_DEBUG)*/
-
-    int start = 0;
-    int end = text.length();
-    while (start < end && text.at(start).isSpace())
-        start++;
-    int x = 0, y = 0;
-    const QChar sep(QLatin1Char(','));
-    const QChar nullChar(QLatin1Char('0'));
-    const Cell emptyCell = cellForGid(0);
-    while ((end = text.indexOf(sep, start, Qt::CaseSensitive)) != -1) {
-        if (end - start == 1 && text.at(start) == nullChar) {
-            tileLayer->setCell(x, y, emptyCell);
-        } else {
-            bool conversionOk;
-            uint gid = text.mid(start, end - start).toUInt(&conversionOk);
-            if (!conversionOk) {
-                xml.raiseError(
-                        tr("Unable to parse tile at (%1,%2) on layer '%3'")
-                               .arg(x + 1).arg(y + 1).arg(tileLayer->name()));
-                return;
-            }
-            tileLayer->setCell(x, y, cellForGid(gid));
+    const int width = tileLayer->width();
+    const int count = width * tileLayer->height();
+    mLayerCells.fill(Cell(), count);
+    Cell *cells = mLayerCells.data();
+    GidMapper::Cache cache;
+
+    const QChar *c = text.data();
+    const QChar *end = c + text.size();
+    int index = 0;
+    while (c != end) {
+        while (c != end && c->isSpace())
+            ++c;
+        if (c == end && index > 0)
+            break;
+        if (index == count) {
+            xml.raiseError(tr("Corrupt layer data for layer '%1'")
+                           .arg(tileLayer->name()));
+            return;
         }
-        start = end + 1;
-        if (++x == tileLayer->width()) {
-            ++y;
-            if (y >= tileLayer->height()) {
-                xml.raiseError(tr("Corrupt layer data for layer '%1'")
-                               .arg(tileLayer->name()));
-                return;
-            }
-            x = 0;
+
+        quint64 gid = 0;
+        int digits = 0;
+        while (c != end && c->unicode() >= '0' && c->unicode() <= '9') {
+            gid = gid * 10 + (c->unicode() - '0');
+            if (gid > 0xFFFFFFFFu)
+                break;
+            ++digits;
+            ++c;
         }
-    }
-    end = text.size();
-    while (start < end && text.at(end-1).isSpace())
-        end--;
-    if (end - start == 1 && text.at(start) == nullChar) {
-        tileLayer->setCell(x, y, emptyCell);
-    } else {
-        bool conversionOk;
-        uint gid = text.mid(start, end - start).toUInt(&conversionOk);
-        if (!conversionOk) {
+        while (c != end && c->isSpace())
+            ++c;
+        if (!digits || gid > 0xFFFFFFFFu || (c != end && *c != QLatin1Char(','))) {
             xml.raiseError(
                     tr("Unable to parse tile at (%1,%2) on layer '%3'")
-                           .arg(x + 1).arg(y + 1).arg(tileLayer->name()));
+                           .arg(index % width + 1).arg(index / width + 1)
+                           .arg(tileLayer->name()));
             return;
         }
-        tileLayer->setCell(x, y, cellForGid(gid));
+        if (c != end)
+            ++c;
+
+        if (gid) {
+            cells[index] = cellForGid(uint(gid), cache);
+            if (xml.hasError())
+                return;
+        }
+        ++index;
     }
+
+    tileLayer->setCells(mLayerCells);
 #elif 0
-    QString trimText = text.trimmed();
+    QString trimText = text.toString().trimmed();
     static QVector<int> tiles;
     tiles.reserve(300*300*2);
     tiles.clear();
@@ -658,7 +695,7 @@ void MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer, const QString &t
 #endif
     }
 #else
-    QString trimText = text.trimmed();
+    QString trimText = text.toString().trimmed();
     QStringList tiles = trimText.split(QLatin1Char(','));
 
     if (tiles.length() != tileLayer->width() * tileLayer->height()) {
@@ -699,6 +736,21 @@ Cell MapReaderPrivate::cellForGid(uint gid)
     return result;
 }
 
+Cell MapReaderPrivate::cellForGid(uint gid, GidMapper::Cache &cache)
+{
+    bool ok;
+    const Cell result = mGidMapper.gidToCell(gid, ok, cache);
+
+    if (!ok) {
+        if (mGidMapper.isEmpty())
+            xml.raiseError(tr("Tile used but no tilesets specified"));
+        else
+            xml.raiseError(tr("Invalid tile: %1").arg(gid));
+    }
+
+    return result;
+}
+
 ObjectGroup *MapReaderPrivate::readObjectGroup()
 {
     Q_ASSERT(xml.isStartElement() && xml.name() == QLatin1String("objectgroup"));
@@ -42,7 +42,10 @@
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QXmlStreamWriter>
+#include <QtEndian>
 #ifdef ZOMBOID
 #include "qtlockedfile.h"
 using namespace SharedTools;
@@ -81,6 +84,7 @@ private:
     void writeMap(QXmlStreamWriter &w, const Map *map);
     void writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
                       uint firstGid);
+    void encodeTileLayers(const Map *map);
     void writeTileLayer(QXmlStreamWriter &w, const TileLayer *tileLayer);
     void writeLayerAttributes(QXmlStreamWriter &w, const Layer *layer);
     void writeObjectGroup(QXmlStreamWriter &w, const ObjectGroup *objectGroup);
@@ -97,6 +101,7 @@ private:
 
     QDir mMapDir;     // The directory in which the map is being saved
     GidMapper mGidMapper;
+    QHash<const TileLayer*,QByteArray> mEncodedLayers; // base64 <data> text
     bool mUseAbsolutePaths;
 };
 
@@ -104,6 +109,54 @@ private:
 } // namespace Tiled
 
 
+static QByteArray encodeGids(QByteArray gids, MapWriter::LayerDataFormat format)
+{
+    if (format == MapWriter::Base64Gzip)
+        gids = compress(gids, Gzip);
+    else if (format == MapWriter::Base64Zlib)
+        gids = compress(gids, Zlib);
+    return gids.toBase64();
+}
+
+static QByteArray encodeLayerData(const TileLayer *tileLayer,
+                                  const GidMapper &gidMapper,
+                                  MapWriter::LayerDataFormat format)
+{
+    QByteArray gids(tileLayer->width() * tileLayer->height() * 4, Qt::Uninitialized);
+    uchar *out = (uchar *) gids.data();
+    for (int y = 0; y < tileLayer->height(); ++y) {
+        for (int x = 0; x < tileLayer->width(); ++x) {
+            qToLittleEndian<quint32>(gidMapper.cellToGid(tileLayer->cellAt(x, y)), out);
+            out += 4;
+        }
+    }
+    return encodeGids(gids, format);
+}
+
+class LayerDataEncoder : public QRunnable
+{
+public:
+    LayerDataEncoder(const TileLayer *tileLayer, const GidMapper &gidMapper,
+                     MapWriter::LayerDataFormat format, QByteArray *result) :
+        mTileLayer(tileLayer),
+        mGidMapper(gidMapper),
+        mFormat(format),
+        mResult(result)
+    {
+    }
+
+    void run()
+    {
+        *mResult = encodeLayerData(mTileLayer, mGidMapper, mFormat);
+    }
+
+private:
+    const TileLayer *mTileLayer;
+    const GidMapper &mGidMapper;
+    MapWriter::LayerDataFormat mFormat;
+    QByteArray *mResult;
+};
+
 MapWriterPrivate::MapWriterPrivate()
     : mLayerDataFormat(MapWriter::Base64Gzip)
     , mDtdEnabled(false)
@@ -204,6 +257,8 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
         firstGid += tileset->tileCount();
     }
 
+    encodeTileLayers(map);
+
     foreach (const Layer *layer, map->layers()) {
         const Layer::Type type = layer->type();
         if (type == Layer::TileLayerType)
@@ -223,6 +278,51 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
 #endif
 
     w.writeEndElement();
+
+    mEncodedLayers.clear();
+}
+
+// Encodes and compresses the base64 data of every tile layer at once, one
+// layer per thread.  Empty layers of the same size share one encoding.
+void MapWriterPrivate::encodeTileLayers(const Map *map)
+{
+    mEncodedLayers.clear();
+    if (mLayerDataFormat != MapWriter::Base64
+            && mLayerDataFormat != MapWriter::Base64Gzip
+            && mLayerDataFormat != MapWriter::Base64Zlib)
+        return;
+
+    QList<const TileLayer*> tileLayers;
+    QMap<QPair<int,int>,QByteArray> emptyLayers;
+    foreach (const Layer *layer, map->layers()) {
+        if (layer->type() != Layer::TileLayerType)
+            continue;
+        const TileLayer *tileLayer = static_cast<const TileLayer*>(layer);
+        if (tileLayer->isEmpty()) {
+            QPair<int,int> size(tileLayer->width(), tileLayer->height());
+            if (!emptyLayers.contains(size)) {
+                QByteArray gids(size.first * size.second * 4, 0);
+                emptyLayers[size] = encodeGids(gids, mLayerDataFormat);
+            }
+            mEncodedLayers[tileLayer] = emptyLayers[size];
+            continue;
+        }
+        tileLayers += tileLayer;
+    }
+
+    QVector<QByteArray> encoded(tileLayers.size());
+    if (tileLayers.size() > 1) {
+        QThreadPool pool;
+        for (int i = 0; i < tileLayers.size(); i++)
+            pool.start(new LayerDataEncoder(tileLayers[i], mGidMapper,
+                                            mLayerDataFormat, &encoded[i]));
+        pool.waitForDone();
+    } else if (tileLayers.size() == 1) {
+        encoded[0] = encodeLayerData(tileLayers[0], mGidMapper, mLayerDataFormat);
+    }
+
+    for (int i = 0; i < tileLayers.size(); i++)
+        mEncodedLayers[tileLayers[i]] = encoded[i];
 }
 
 void MapWriterPrivate::writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
@@ -374,26 +474,13 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
         w.writeCharacters(QLatin1String("\n"));
         w.writeCharacters(tileData);
     } else {
-        QByteArray tileData;
-        tileData.reserve(tileLayer->height() * tileLayer->width() * 4);
-
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
-                const uint gid = mGidMapper.cellToGid(tileLayer->cellAt(x, y));
-                tileData.append((char) (gid));
-                tileData.append((char) (gid >> 8));
-                tileData.append((char) (gid >> 16));
-                tileData.append((char) (gid >> 24));
-            }
-        }
-
-        if (mLayerDataFormat == MapWriter::Base64Gzip)
-            tileData = compress(tileData, Gzip);
-        else if (mLayerDataFormat == MapWriter::Base64Zlib)
-            tileData = compress(tileData, Zlib);
+        QHash<const TileLayer*,QByteArray>::const_iterator it = mEncodedLayers.constFind(tileLayer);
+        QByteArray tileData = (it != mEncodedLayers.constEnd())
+                ? it.value()
+                : encodeLayerData(tileLayer, mGidMapper, mLayerDataFormat);
 
         w.writeCharacters(QLatin1String("\n   "));
-        w.writeCharacters(QString::fromLatin1(tileData.toBase64()));
+        w.writeCharacters(QString::fromLatin1(tileData));
         w.writeCharacters(QLatin1String("\n  "));
     }
 
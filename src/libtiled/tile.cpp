@@ -36,39 +36,68 @@
 
 using namespace Tiled;
 
+static void releaseAtlas(void *atlas)
+{
+    delete static_cast<QImage*>(atlas);
+}
+
 void Tile::setImage(const QImage &image)
+{
+    setImage(image, image.rect());
+}
+
+void Tile::setImage(const QImage &atlas, const QRect &rect)
 {
     mImage = QImage();
+    mAtlas = QImage();
+    mAtlasRect = QRect();
     mImageOffset = QPoint(0, 0);
-    mImageSize = image.size();
+    mImageSize = rect.size();
 
-    int top = 0;
-    while (top < image.height() && isRowTransparent(image, top))
+    int top = rect.top();
+    while (top <= rect.bottom() && isRowTransparent(atlas, rect, top))
         top++;
-    if (top == image.height()) {
+    if (top > rect.bottom()) {
         return;
     }
-    mImageOffset.setY(top);
+    mImageOffset.setY(top - rect.top());
 
-    int bottom = image.height() - 1;
-    while (bottom > top && isRowTransparent(image, bottom))
+    int bottom = rect.bottom();
+    while (bottom > top && isRowTransparent(atlas, rect, bottom))
         bottom--;
 
-    int left = 0;
-    while (left < image.width() && isColumnTransparent(image, left))
+    int left = rect.left();
+    while (left <= rect.right() && isColumnTransparent(atlas, rect, left))
         left++;
-    mImageOffset.setX(left);
+    mImageOffset.setX(left - rect.left());
 
-    int right = image.width() - 1;
-    while (right > left && isColumnTransparent(image, right))
+    int right = rect.right();
+    while (right > left && isColumnTransparent(atlas, rect, right))
         right--;
 
-    mImage = image.copy(left, top, right - left + 1, bottom - top + 1);
+    mAtlas = atlas;
+    mAtlasRect = QRect(left, top, right - left + 1, bottom - top + 1);
+
+    if (mAtlas.depth() != 32) {
+        mImage = mAtlas.copy(mAtlasRect);
+        return;
+    }
+
+    // The view shares the atlas's pixels and holds its own reference to the
+    // atlas, so copies of image() stay valid after this tile changes.
+    const uchar *bits = mAtlas.constBits()
+            + mAtlasRect.top() * mAtlas.bytesPerLine()
+            + mAtlasRect.left() * 4;
+    mImage = QImage(bits, mAtlasRect.width(), mAtlasRect.height(),
+                    mAtlas.bytesPerLine(), mAtlas.format(),
+                    releaseAtlas, new QImage(mAtlas));
 }
 
 void Tile::setEmptyImage(int width, int height)
 {
     mImage = QImage();
+    mAtlas = QImage();
+    mAtlasRect = QRect();
     mImageOffset = QPoint(0, 0);
     mImageSize = QSize(width, height);
 }
@@ -96,13 +125,29 @@ QImage Tile::finalImage(int width, int height)
 void Tile::setImage(const Tile *tile)
 {
     mImage = tile->mImage;
+    mAtlas = tile->mAtlas;
+    mAtlasRect = tile->mAtlasRect;
     mImageOffset = tile->mImageOffset;
     mImageSize = tile->mImageSize;
 }
 
-bool Tile::isRowTransparent(const QImage &image, int row)
+static inline bool hasPlainAlpha(const QImage &image)
 {
-    for (int x = 0; x < image.width(); x++) {
+    return image.format() == QImage::Format_ARGB32_Premultiplied
+            || image.format() == QImage::Format_ARGB32;
+}
+
+bool Tile::isRowTransparent(const QImage &image, const QRect &rect, int row)
+{
+    if (hasPlainAlpha(image)) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(row));
+        for (int x = rect.left(); x <= rect.right(); x++) {
+            if (qAlpha(line[x]) > 0)
+                return false;
+        }
+        return true;
+    }
+    for (int x = rect.left(); x <= rect.right(); x++) {
         QRgb rgb = image.pixel(x, row);
         if (qAlpha(rgb) > 0)
             return false;
@@ -110,9 +155,17 @@ bool Tile::isRowTransparent(const QImage &image, int row)
     return true;
 }
 
-bool Tile::isColumnTransparent(const QImage &image, int col)
+bool Tile::isColumnTransparent(const QImage &image, const QRect &rect, int col)
 {
-    for (int y = 0; y < image.height(); y++) {
+    if (hasPlainAlpha(image)) {
+        for (int y = rect.top(); y <= rect.bottom(); y++) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            if (qAlpha(line[col]) > 0)
+                return false;
+        }
+        return true;
+    }
+    for (int y = rect.top(); y <= rect.bottom(); y++) {
         QRgb rgb = image.pixel(col, y);
         if (qAlpha(rgb) > 0)
             return false;
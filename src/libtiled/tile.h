@@ -62,6 +62,13 @@ public:
     {
         setEmptyImage(width, height);
     }
+
+    Tile(const QImage &atlas, const QRect &rect, int id, Tileset *tileset):
+        mId(id),
+        mTileset(tileset)
+    {
+        setImage(atlas, rect);
+    }
 #else
     Tile(const QPixmap &image, int id, Tileset *tileset):
         mId(id),
@@ -86,10 +93,19 @@ public:
      */
     const QImage &image() const { return mImage; }
 
+    /**
+     * Returns the image this tile's image is part of, usually the whole
+     * tileset image, and the rectangle of this tile within it.  image() is a
+     * read-only view of that rectangle.
+     */
+    const QImage &atlas() const { return mAtlas; }
+    const QRect &atlasRect() const { return mAtlasRect; }
+
     /**
      * Sets the image of this tile.
      */
     void setImage(const QImage &image);
+    void setImage(const QImage &atlas, const QRect &rect);
     void setImage(const Tile *tile);
     void setEmptyImage(int width, int height);
 
@@ -114,8 +130,8 @@ public:
     QImage finalImage(int width, int height);
 
 private:
-    bool isRowTransparent(const QImage &image, int row);
-    bool isColumnTransparent(const QImage &image, int col);
+    bool isRowTransparent(const QImage &image, const QRect &rect, int row);
+    bool isColumnTransparent(const QImage &image, const QRect &rect, int col);
 #else
     /**
      * Returns the image of this tile.
@@ -148,6 +164,8 @@ private:
     Tileset *mTileset;
 #ifdef ZOMBOID
     QImage mImage;
+    QImage mAtlas;
+    QRect mAtlasRect;
     QPoint mImageOffset;
     QSize mImageSize;
 #else
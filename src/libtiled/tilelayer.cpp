@@ -183,6 +183,71 @@ void TileLayer::setCells(int x, int y, TileLayer *layer,
                 setCell(_x, _y, layer->cellAt(_x - x, _y - y));
 }
 
+void TileLayer::setCells(const QVector<Cell> &cells)
+{
+    Q_ASSERT(cells.size() == mWidth * mHeight);
+
+    if (!isEmpty()) {
+        for (int i = 0; i < cells.size(); i++)
+            setCell(i % mWidth, i / mWidth, cells[i]);
+        return;
+    }
+
+    QSize maxTileSize = mMaxTileSize;
+    QMargins offsetMargins = mOffsetMargins;
+    Tileset *tileset = 0;
+#ifdef ZOMBOID
+    int references = 0;
+#endif
+    for (int i = 0; i < cells.size(); i++) {
+        const Cell &cell = cells[i];
+        if (!cell.tile)
+            continue;
+
+        int width = cell.tile->width();
+        int height = cell.tile->height();
+        if (cell.flippedAntiDiagonally)
+            std::swap(width, height);
+        maxTileSize = maxSize(QSize(width, height), maxTileSize);
+
+        // Tiles usually come in runs from the same tileset.
+        if (cell.tile->tileset() != tileset) {
+#ifdef ZOMBOID
+            if (references)
+                addReference(tileset, references);
+            references = 0;
+#endif
+            tileset = cell.tile->tileset();
+            const QPoint offset = tileset->tileOffset();
+            offsetMargins = maxMargins(QMargins(-offset.x(),
+                                                -offset.y(),
+                                                offset.x(),
+                                                offset.y()),
+                                       offsetMargins);
+        }
+#ifdef ZOMBOID
+        ++references;
+#endif
+    }
+#ifdef ZOMBOID
+    if (references)
+        addReference(tileset, references);
+#endif
+
+#if SPARSE_TILELAYER
+    mGrid.setCells(cells);
+#else
+    mGrid = cells;
+#endif
+
+    if (tileset) {
+        mMaxTileSize = maxTileSize;
+        mOffsetMargins = offsetMargins;
+        if (mMap)
+            mMap->adjustDrawMargins(drawMargins());
+    }
+}
+
 void TileLayer::erase(const QRegion &area)
 {
     const Cell emptyCell;
@@ -158,6 +158,31 @@ public:
         replace(index, cell);
     }
 
+    /**
+     * Replaces every cell with the row-major \a cells.
+     */
+    void setCells(const QVector<Cell> &cells)
+    {
+        Q_ASSERT(cells.size() == size());
+        int count = 0;
+        for (int i = 0; i < cells.size(); i++) {
+            if (!cells[i].isEmpty())
+                ++count;
+        }
+        if (mUseVector || count > 300 * 300 / 3) {
+            mCells.clear();
+            mCellsVector = cells;
+            mUseVector = true;
+            return;
+        }
+        mCells.clear();
+        mCells.reserve(count);
+        for (int i = 0; i < cells.size(); i++) {
+            if (!cells[i].isEmpty())
+                mCells.insert(i, cells[i]);
+        }
+    }
+
     bool isEmpty() const
     { return !mUseVector && mCells.isEmpty(); }
 
@@ -301,6 +326,13 @@ public:
     void setCells(int x, int y, TileLayer *tileLayer,
                   const QRegion &mask = QRegion());
 
+    /**
+     * Sets every cell in this layer from the row-major \a cells, updating the
+     * draw margins and used tilesets once rather than per cell.  Used when
+     * reading a whole layer.
+     */
+    void setCells(const QVector<Cell> &cells);
+
     /**
      * Flip this tile layer in the given \a direction. Direction must be
      * horizontal or vertical. This doesn't change the dimensions of the
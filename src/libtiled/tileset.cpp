@@ -66,26 +66,25 @@ bool Tileset::loadFromImage(const QImage &image, const QString &fileName)
     int oldTilesetSize = mTiles.size();
     int tileNum = 0;
 #ifdef ZOMBOID
-    QImage image2 = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    // The tiles are views into this one image rather than separate copies.
+    QImage atlas = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    if (mTransparentColor.isValid()) {
+        for (int x = 0; x < atlas.width(); x++) {
+            for (int y = 0; y < atlas.height(); y++) {
+                if (atlas.pixel(x, y) == mTransparentColor.rgba())
+                    atlas.setPixel(x, y, qRgba(0,0,0,0));
+            }
+        }
+    }
 #endif
     for (int y = mMargin; y <= stopHeight; y += mTileHeight + mTileSpacing) {
         for (int x = mMargin; x <= stopWidth; x += mTileWidth + mTileSpacing) {
 #ifdef ZOMBOID
-            QImage tileImage = image2.copy(x, y, mTileWidth, mTileHeight);
-
-            if (mTransparentColor.isValid()) {
-                for (int x = 0; x < mTileWidth; x++) {
-                    for (int y = 0; y < mTileHeight; y++) {
-                        if (tileImage.pixel(x, y) == mTransparentColor.rgba())
-                            tileImage.setPixel(x, y, qRgba(0,0,0,0));
-                    }
-                }
-            }
-
+            const QRect tileRect(x, y, mTileWidth, mTileHeight);
             if (tileNum < oldTilesetSize) {
-                mTiles.at(tileNum)->setImage(tileImage);
+                mTiles.at(tileNum)->setImage(atlas, tileRect);
             } else {
-                mTiles.append(new Tile(tileImage, tileNum, this));
+                mTiles.append(new Tile(atlas, tileRect, tileNum, this));
             }
 #else
             const QImage tileImage = image.copy(x, y, mTileWidth, mTileHeight);
@@ -193,6 +193,101 @@ void ZLevelRenderer::drawGrid(QPainter *painter, const QRectF &rect,
 
 static Tile *g_missing_tile = 0;
 
+static Tile *missingTile()
+{
+    if (g_missing_tile == 0) {
+        Tileset *ts = new Tileset(QLatin1String("MISSING"), 64, 128);
+        if (ts->loadFromImage(QImage(QLatin1String(":/images/missing-tile.png")), QLatin1String(":/images/missing-tile.png"))) {
+            g_missing_tile = ts->tileAt(0);
+        }
+    }
+    return g_missing_tile;
+}
+
+/**
+ * The part of a cell's transform that doesn't depend on where the cell is
+ * drawn.  The image is drawn at (x + dx, y + dy) through the linear part.
+ */
+struct CellTransform
+{
+    qreal m11, m12, m21, m22;
+    qreal dx, dy;
+
+    bool sameLinearPart(const QTransform &t) const
+    {
+        return m11 == t.m11() && m12 == t.m12() && m21 == t.m21() && m22 == t.m22();
+    }
+};
+
+static void cellTransform(const Cell *cell, const Tile *tile, int tileWidth,
+                          CellTransform &ct)
+{
+    const QImage &img = tile->image();
+    const QPoint offset = tile->tileset()->tileOffset() + tile->offset();
+
+    ct.m11 = 1;      // Horizontal scaling factor
+    ct.m12 = 0;      // Vertical shearing factor
+    ct.m21 = 0;      // Horizontal shearing factor
+    ct.m22 = 1;      // Vertical scaling factor
+    ct.dx = offset.x();
+    ct.dy = offset.y() - tile->height();
+
+    if (cell->flippedAntiDiagonally) {
+        // Use shearing to swap the X/Y axis
+        ct.m11 = 0;
+        ct.m12 = 1;
+        ct.m21 = 1;
+        ct.m22 = 0;
+
+        // Compensate for the swap of image dimensions
+        ct.dy += img.height() - img.width();
+    }
+    if (cell->flippedHorizontally) {
+        ct.m11 = -ct.m11;
+        ct.m21 = -ct.m21;
+        ct.dx += cell->flippedAntiDiagonally ? img.height() : img.width();
+    }
+    if (cell->flippedVertically) {
+        ct.m12 = -ct.m12;
+        ct.m22 = -ct.m22;
+        ct.dy += cell->flippedAntiDiagonally ? img.width() : img.height();
+    }
+
+    if (tileWidth == tile->width() * 2) {
+        ct.m11 *= 2.0f;
+        ct.m22 *= 2.0f;
+        ct.dx += tile->offset().x();
+        ct.dy -= tile->height() - tile->offset().y();
+    } else if (tileWidth == tile->width() / 2) {
+        float scale = 0.5f;
+        ct.m11 *= scale;
+        ct.m22 *= scale;
+//        dx += (tileWidth - img.width() * scale) / 2;
+//        dy += (tile->tileset()->tileHeight() - img.height() * scale);
+//        dy -= (tileHeight - tileHeight * scale) / 2;
+        ct.dy += tile->height() / 2;
+    }
+}
+
+/**
+ * Draws a cell's image.  The painter's transform only changes when the
+ * linear part differs from the previous cell's, which for unflipped tiles
+ * of one size is never.
+ */
+static inline void drawCell(QPainter *painter, const Tile *tile,
+                            const CellTransform &ct, int x, int y,
+                            const QTransform &baseTransform,
+                            QTransform &linear, QTransform &inverse)
+{
+    if (!ct.sameLinearPart(linear)) {
+        linear = QTransform(ct.m11, ct.m12, ct.m21, ct.m22, 0, 0);
+        inverse = linear.inverted();
+        painter->setTransform(linear * baseTransform);
+    }
+    painter->drawImage(inverse.map(QPointF(x + ct.dx, y + ct.dy)),
+                       tile->atlas(), tile->atlasRect());
+}
+
 void ZLevelRenderer::drawTileLayer(QPainter *painter,
                                       const TileLayer *layer,
                                       const QRectF &exposed) const
@@ -253,6 +348,8 @@ void ZLevelRenderer::drawTileLayer(QPainter *painter,
     bool shifted = inUpperHalf ^ inLeftHalf;
 
     QTransform baseTransform = painter->transform();
+    QTransform linear, inverse;
+    CellTransform ct;
 
     for (int y = startPos.y(); y - tileHeight < rect.bottom();
          y += tileHeight / 2)
@@ -268,55 +365,9 @@ void ZLevelRenderer::drawTileLayer(QPainter *painter,
             if (layer->contains(columnItr)) {
                 const Cell &cell = layer->cellAt(columnItr);
                 if (!cell.isEmpty()) {
-                    QImage img = cell.tile->image();
-                    const QPoint offset = cell.tile->tileset()->tileOffset() + cell.tile->offset();
-
-                    qreal m11 = 1;      // Horizontal scaling factor
-                    qreal m12 = 0;      // Vertical shearing factor
-                    qreal m21 = 0;      // Horizontal shearing factor
-                    qreal m22 = 1;      // Vertical scaling factor
-                    qreal dx = offset.x() + x;
-                    qreal dy = offset.y() + y - cell.tile->height();
-
-                    if (cell.flippedAntiDiagonally) {
-                        // Use shearing to swap the X/Y axis
-                        m11 = 0;
-                        m12 = 1;
-                        m21 = 1;
-                        m22 = 0;
-
-                        // Compensate for the swap of image dimensions
-                        dy += img.height() - img.width();
-                    }
-                    if (cell.flippedHorizontally) {
-                        m11 = -m11;
-                        m21 = -m21;
-                        dx += cell.flippedAntiDiagonally ? img.height()
-                                                         : img.width();
-                    }
-                    if (cell.flippedVertically) {
-                        m12 = -m12;
-                        m22 = -m22;
-                        dy += cell.flippedAntiDiagonally ? img.width()
-                                                         : img.height();
-                    }
-
-                    if (tileWidth == cell.tile->width() * 2) {
-                        m11 *= 2.0f;
-                        m22 *= 2.0f;
-                        dx += cell.tile->offset().x();
-                        dy -= cell.tile->height() - cell.tile->offset().y();
-                    } else if (tileWidth == cell.tile->width() / 2) {
-                        float scale = 0.5f;
-                        m11 *= scale;
-                        m22 *= scale;
-                        dy += cell.tile->height() / 2;
-                    }
-
-                    const QTransform transform(m11, m12, m21, m22, dx, dy);
-                    painter->setTransform(transform * baseTransform);
-
-                    painter->drawImage(0, 0, img);
+                    cellTransform(&cell, cell.tile, tileWidth, ct);
+                    drawCell(painter, cell.tile, ct, x, y,
+                             baseTransform, linear, inverse);
                 }
             }
 
@@ -403,6 +454,9 @@ void ZLevelRenderer::drawTileLayerGroup(QPainter *painter, ZTileLayerGroup *laye
     layerGroup->prepareDrawing(this, rect);
 
     qreal opacity = painter->opacity();
+    qreal painterOpacity = opacity;
+    QTransform linear, inverse;
+    CellTransform ct;
 
     for (int y = startPos.y(); y - tileHeight < rect.bottom();
          y += tileHeight / 2)
@@ -416,75 +470,26 @@ void ZLevelRenderer::drawTileLayerGroup(QPainter *painter, ZTileLayerGroup *laye
                     // Multi-threading
                     if (mAbortDrawing && *mAbortDrawing) {
                         painter->setTransform(baseTransform);
+                        painter->setOpacity(opacity);
                         return;
                     }
                     const Cell *cell = cells[i];
                     if (!cell->isEmpty()) {
                         Tile *tile = cell->tile;
                         if (tile->image().isNull()) {
-                            if (g_missing_tile == 0) {
-                                Tileset *ts = new Tileset(QLatin1String("MISSING"), 64, 128);
-                                if (ts->loadFromImage(QImage(QLatin1String(":/images/missing-tile.png")), QLatin1String(":/images/missing-tile.png"))) {
-                                    g_missing_tile = ts->tileAt(0);
-                                }
-                            }
-                            if (g_missing_tile)
-                                tile = g_missing_tile;
-                        }
-                        QImage img = tile->image();
-                        const QPoint offset = tile->tileset()->tileOffset() + tile->offset();
-
-                        qreal m11 = 1;      // Horizontal scaling factor
-                        qreal m12 = 0;      // Vertical shearing factor
-                        qreal m21 = 0;      // Horizontal shearing factor
-                        qreal m22 = 1;      // Vertical scaling factor
-                        qreal dx = offset.x() + x;
-                        qreal dy = offset.y() + y - tile->height();
-
-                        if (cell->flippedAntiDiagonally) {
-                            // Use shearing to swap the X/Y axis
-                            m11 = 0;
-                            m12 = 1;
-                            m21 = 1;
-                            m22 = 0;
-
-                            // Compensate for the swap of image dimensions
-                            dy += img.height() - img.width();
-                        }
-                        if (cell->flippedHorizontally) {
-                            m11 = -m11;
-                            m21 = -m21;
-                            dx += cell->flippedAntiDiagonally ? img.height()
-                                                             : img.width();
-                        }
-                        if (cell->flippedVertically) {
-                            m12 = -m12;
-                            m22 = -m22;
-                            dy += cell->flippedAntiDiagonally ? img.width()
-                                                             : img.height();
+                            if (Tile *missing = missingTile())
+                                tile = missing;
                         }
+                        cellTransform(cell, tile, tileWidth, ct);
 
-                        if (tileWidth == tile->width() * 2) {
-                            m11 *= 2.0f;
-                            m22 *= 2.0f;
-                            dx += tile->offset().x();
-                            dy -= tile->height() - tile->offset().y();
-                        } else if (tileWidth == tile->width() / 2) {
-                            float scale = 0.5f;
-                            m11 *= scale;
-                            m22 *= scale;
-//                            dx += (tileWidth - img.width() * scale) / 2;
-//                            dy += (tile->tileset()->tileHeight() - img.height() * scale);
-//                            dy -= (tileHeight - tileHeight * scale) / 2;
-                            dy += tile->height() / 2;
+                        qreal cellOpacity = opacities[i] * opacity;
+                        if (cellOpacity != painterOpacity) {
+                            painter->setOpacity(cellOpacity);
+                            painterOpacity = cellOpacity;
                         }
 
-                        const QTransform transform(m11, m12, m21, m22, dx, dy);
-                        painter->setTransform(transform * baseTransform);
-
-                        painter->setOpacity(opacities[i] * opacity);
-
-                        painter->drawImage(0, 0, img);
+                        drawCell(painter, tile, ct, x, y,
+                                 baseTransform, linear, inverse);
                     }
                 }
             }
@@ -507,6 +512,7 @@ void ZLevelRenderer::drawTileLayerGroup(QPainter *painter, ZTileLayerGroup *laye
     }
 
     painter->setTransform(baseTransform);
+    painter->setOpacity(opacity);
 }
 #endif // ZOMBOID
 
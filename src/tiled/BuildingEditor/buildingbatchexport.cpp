@@ -0,0 +1,147 @@
+/*
+ * Copyright 2013, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "buildingbatchexport.h"
+
+#include "building.h"
+#include "buildingmap.h"
+#include "buildingreader.h"
+#include "buildingtmx.h"
+
+#include "tilesetmanager.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QProcess>
+#include <QThread>
+
+using namespace BuildingEditor;
+using namespace Tiled::Internal;
+
+BuildingBatchExport::BuildingBatchExport() :
+    mExportTMX(false),
+    mExportNewBinary(false)
+{
+}
+
+QStringList BuildingBatchExport::buildingFiles(const QStringList &paths)
+{
+    QStringList fileNames;
+    foreach (QString path, paths) {
+        QFileInfo info(path);
+        if (info.isDir()) {
+            QDir dir(path);
+            foreach (QFileInfo fileInfo, dir.entryInfoList(QStringList() << QLatin1String("*.tbx"),
+                                                           QDir::Files, QDir::Name))
+                fileNames += fileInfo.absoluteFilePath();
+        } else if (info.exists()) {
+            fileNames += info.absoluteFilePath();
+        } else {
+            qWarning("%s: %s", qPrintable(path), qPrintable(tr("No such file or directory")));
+        }
+    }
+    return fileNames;
+}
+
+bool BuildingBatchExport::exportFiles(const QStringList &fileNames)
+{
+    bool ok = true;
+    foreach (QString fileName, fileNames) {
+        if (!exportFile(fileName))
+            ok = false;
+    }
+    return ok;
+}
+
+bool BuildingBatchExport::exportFilesInWorkers(const QStringList &fileNames,
+                                               const QStringList &arguments)
+{
+    int workerCount = qMin(QThread::idealThreadCount(), fileNames.size());
+
+    // Deal the files out in turn so large and small buildings get mixed.
+    QVector<QStringList> shares(qMax(workerCount, 1));
+    for (int i = 0; i < fileNames.size(); i++)
+        shares[i % shares.size()] += fileNames[i];
+
+    QList<QProcess*> workers;
+    foreach (QStringList share, shares) {
+        QProcess *process = new QProcess;
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        process->start(QCoreApplication::applicationFilePath(),
+                       arguments + (QStringList() << QLatin1String("--")) + share);
+        workers += process;
+    }
+
+    bool ok = true;
+    foreach (QProcess *process, workers) {
+        if (!process->waitForFinished(-1)
+                || process->exitStatus() != QProcess::NormalExit
+                || process->exitCode() != 0) {
+            if (process->error() == QProcess::FailedToStart)
+                qWarning("%s", qPrintable(process->errorString()));
+            ok = false;
+        }
+        delete process;
+    }
+    return ok;
+}
+
+bool BuildingBatchExport::exportFile(const QString &fileName)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    BuildingReader reader;
+    Building *building = reader.read(fileName);
+    if (!building) {
+        qWarning("%s: %s", qPrintable(fileName), qPrintable(reader.errorString()));
+        return false;
+    }
+    reader.fix(building);
+    BuildingMap::loadNeededTilesets(building);
+    TilesetManager::instance()->waitForTilesets();
+
+    QFileInfo info(fileName);
+    QString baseName = info.dir().filePath(info.completeBaseName());
+    bool ok = true;
+
+    if (mExportTMX) {
+        QString tmxName = baseName + QLatin1String(".tmx");
+        if (!BuildingTMX::instance()->exportTMX(building, tmxName)) {
+            qWarning("%s: %s", qPrintable(tmxName),
+                     qPrintable(BuildingTMX::instance()->errorString()));
+            ok = false;
+        }
+    }
+
+    if (mExportNewBinary) {
+        QString pzbyName = baseName + QLatin1String(".pzby");
+        if (!BuildingTMX::instance()->exportNewBinary(building, pzbyName)) {
+            qWarning("%s: %s", qPrintable(pzbyName),
+                     qPrintable(BuildingTMX::instance()->errorString()));
+            ok = false;
+        }
+    }
+
+    delete building;
+
+    qWarning("%s: %s in %lld ms", qPrintable(fileName),
+             ok ? "exported" : "failed", timer.elapsed());
+    return ok;
+}
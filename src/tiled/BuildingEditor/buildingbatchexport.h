@@ -0,0 +1,64 @@
+/*
+ * Copyright 2013, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUILDINGBATCHEXPORT_H
+#define BUILDINGBATCHEXPORT_H
+
+#include <QCoreApplication>
+#include <QStringList>
+
+namespace BuildingEditor {
+
+/**
+  * Exports .tbx files to .tmx and/or .pzby files without any user interface.
+  * The exported files are written next to each .tbx file.
+  */
+class BuildingBatchExport
+{
+    Q_DECLARE_TR_FUNCTIONS(BuildingBatchExport)
+
+public:
+    BuildingBatchExport();
+
+    void setExportTMX(bool enable)
+    { mExportTMX = enable; }
+
+    void setExportNewBinary(bool enable)
+    { mExportNewBinary = enable; }
+
+    // Returns the given .tbx files plus the .tbx files in the given directories.
+    static QStringList buildingFiles(const QStringList &paths);
+
+    // Exports every file in this process.  The config files and tilesets must
+    // already be loaded.
+    bool exportFiles(const QStringList &fileNames);
+
+    // Shares the files between one worker process per core.  Each worker
+    // runs this program with the given arguments followed by its files.
+    bool exportFilesInWorkers(const QStringList &fileNames,
+                              const QStringList &arguments);
+
+private:
+    bool exportFile(const QString &fileName);
+
+    bool mExportTMX;
+    bool mExportNewBinary;
+};
+
+} // namespace BuildingEditor
+
+#endif // BUILDINGBATCHEXPORT_H
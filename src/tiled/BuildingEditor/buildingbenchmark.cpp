@@ -0,0 +1,202 @@
+/*
+ * Copyright 2013, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "buildingbenchmark.h"
+
+#include "simplefile.h"
+
+#include "bmpblender.h"
+#include "tilemetainfomgr.h"
+
+#include "gidmapper.h"
+#include "map.h"
+#include "tile.h"
+#include "tileset.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRgb>
+
+using namespace BuildingEditor;
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+static const int CELL_SIZE = 300;
+static const int ITERATIONS = 10;
+
+static void printTimes(const char *what, const QVector<qint64> &times, const char *unit)
+{
+    qint64 best = times[0], total = 0;
+    foreach (qint64 ms, times) {
+        best = qMin(best, ms);
+        total += ms;
+    }
+    qWarning("%s: first %lld %s, best %lld %s, average %lld %s over %d runs",
+             what, times[0], unit, best, unit, total / times.size(), unit, times.size());
+}
+
+bool BuildingBenchmark::blend(const QString &rulesFile, const QString &blendsFile)
+{
+    BmpRulesFile rules;
+    if (!rules.read(rulesFile)) {
+        qWarning("%s: %s", qPrintable(rulesFile), qPrintable(rules.errorString()));
+        return false;
+    }
+    BmpBlendsFile blends;
+    if (!blends.read(blendsFile, rules.aliases())) {
+        qWarning("%s: %s", qPrintable(blendsFile), qPrintable(blends.errorString()));
+        return false;
+    }
+
+    Map map(Map::LevelIsometric, CELL_SIZE, CELL_SIZE, 64, 32);
+    foreach (Tileset *ts, TileMetaInfoMgr::instance()->tilesets())
+        map.addTileset(ts);
+    map.rbmpSettings()->setAliases(rules.aliasesCopy());
+    map.rbmpSettings()->setRules(rules.rulesCopy());
+    map.rbmpSettings()->setBlends(blends.blendsCopy());
+
+    QList<QRgb> colors[2];
+    foreach (BmpRule *rule, rules.rules()) {
+        if (rule->bitmapIndex < 0 || rule->bitmapIndex > 1)
+            continue;
+        if (!colors[rule->bitmapIndex].contains(rule->color))
+            colors[rule->bitmapIndex] += rule->color;
+    }
+    if (colors[0].isEmpty()) {
+        qWarning("%s: no rules for the main bitmap", qPrintable(rulesFile));
+        return false;
+    }
+
+    // Irregular patches of every colour, so there are plenty of edges between
+    // different ground types to blend.  Vegetation covers every third patch.
+    const QRgb black = qRgb(0, 0, 0);
+    for (int y = 0; y < CELL_SIZE; y++) {
+        for (int x = 0; x < CELL_SIZE; x++) {
+            int patch = (x / 5) * 7 + (y / 4) * 13 + (x * y) % 3;
+            map.rbmpMain().setPixel(x, y, colors[0][patch % colors[0].size()]);
+            QRgb veg = black;
+            if (!colors[1].isEmpty() && (patch % 3) == 0)
+                veg = colors[1][(patch / 3) % colors[1].size()];
+            map.rbmpVeg().setPixel(x, y, veg);
+        }
+    }
+
+    // The first run also resolves the tile names and compiles the tables.
+    BmpBlender blender(&map);
+    QVector<qint64> times;
+    QElapsedTimer timer;
+    for (int i = 0; i < ITERATIONS; i++) {
+        blender.markDirty(0, 0, CELL_SIZE - 1, CELL_SIZE - 1);
+        timer.start();
+        blender.flush(QRect(0, 0, CELL_SIZE, CELL_SIZE));
+        times += timer.elapsed();
+    }
+
+    printTimes("Blending a 300x300 cell", times, "ms");
+    return true;
+}
+
+bool BuildingBenchmark::simpleFiles(const QStringList &paths)
+{
+    QStringList fileNames;
+    foreach (QString path, paths) {
+        QFileInfo info(path);
+        if (info.isDir()) {
+            QDir dir(path);
+            foreach (QFileInfo fileInfo, dir.entryInfoList(QStringList() << QLatin1String("*.txt"),
+                                                           QDir::Files, QDir::Name))
+                fileNames += fileInfo.absoluteFilePath();
+        } else if (info.exists()) {
+            fileNames += info.absoluteFilePath();
+        } else {
+            qWarning("%s: No such file or directory", qPrintable(path));
+            return false;
+        }
+    }
+    if (fileNames.isEmpty()) {
+        qWarning("No .txt files to parse");
+        return false;
+    }
+
+    QVector<qint64> totals(ITERATIONS);
+    QElapsedTimer timer;
+    foreach (QString fileName, fileNames) {
+        QVector<qint64> times;
+        for (int i = 0; i < ITERATIONS; i++) {
+            SimpleFile simple;
+            timer.start();
+            if (!simple.read(fileName)) {
+                qWarning("%s: %s", qPrintable(fileName), qPrintable(simple.errorString()));
+                return false;
+            }
+            times += timer.nsecsElapsed() / 1000;
+            totals[i] += times[i];
+        }
+        printTimes(qPrintable(QFileInfo(fileName).fileName()), times, "us");
+    }
+
+    printTimes("All files", totals, "us");
+    return true;
+}
+
+bool BuildingBenchmark::gidMapper()
+{
+    const int tilesetCount = 250;
+    const int cellCount = 1000000;
+
+    QList<Tileset*> tilesets;
+    for (int i = 0; i < tilesetCount; i++) {
+        QString name = QString::fromLatin1("benchmark_%1").arg(i);
+        Tileset *ts = new Tileset(name, 64, 128);
+        ts->loadFromNothing(QSize(64 * 8, 128 * 16), name);
+        tilesets += ts;
+    }
+    GidMapper mapper(tilesets);
+
+    // A fixed sequence so every run looks up the same tiles.
+    QVector<Cell> cells(cellCount);
+    quint32 seed = 12345;
+    for (int i = 0; i < cellCount; i++) {
+        seed = seed * 1103515245 + 12345;
+        Tileset *ts = tilesets[(seed >> 8) % tilesetCount];
+        cells[i] = Cell(ts->tileAt((seed >> 20) % ts->tileCount()));
+    }
+
+    QVector<qint64> cellToGidTimes, firstGidTimes;
+    QElapsedTimer timer;
+    quint64 sum = 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        timer.start();
+        foreach (const Cell &cell, cells)
+            sum += mapper.cellToGid(cell);
+        cellToGidTimes += timer.elapsed();
+
+        timer.start();
+        foreach (const Cell &cell, cells)
+            sum += mapper.firstGid(cell.tile->tileset());
+        firstGidTimes += timer.elapsed();
+    }
+
+    qDeleteAll(tilesets);
+
+    // Printing the sum stops the loops being optimized away.
+    qWarning("Checksum %llu", sum);
+    printTimes("cellToGid() of 1000000 cells", cellToGidTimes, "ms");
+    printTimes("firstGid() of 1000000 cells", firstGidTimes, "ms");
+    return true;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2013, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUILDINGBENCHMARK_H
+#define BUILDINGBENCHMARK_H
+
+#include <QStringList>
+
+namespace BuildingEditor {
+
+/**
+  * Timings run from the command line without any user interface.  The
+  * results are printed with qWarning().
+  */
+class BuildingBenchmark
+{
+public:
+    // Blends a synthetic 300x300 cell painted with every colour in the given
+    // Rules.txt.  The config files and tilesets must already be loaded.
+    static bool blend(const QString &rulesFile, const QString &blendsFile);
+
+    // Parses each of the given SimpleFile .txt files, or the .txt files in the
+    // given directories, such as the ones shipped with BuildingEd.
+    static bool simpleFiles(const QStringList &paths);
+
+    // Looks up the GIDs of random tiles from a couple of hundred synthetic
+    // tilesets, as the TMX and .lotpack writers do for every cell.
+    static bool gidMapper();
+};
+
+} // namespace BuildingEditor
+
+#endif // BUILDINGBENCHMARK_H
@@ -525,6 +525,9 @@ void BuildingDocument::furnitureTileChanged(FurnitureTile *ftile)
     foreach (BuildingFloor *floor, mBuilding->floors()) {
         foreach (BuildingObject *object, floor->objects()) {
             if (FurnitureObject *furniture = object->asFurniture()) {
+                // The size of the other orientations may depend on this one.
+                if (furniture->furnitureTile() && furniture->furnitureTile()->owner() == ftile->owner())
+                    floor->objectMoved(furniture);
                 if (furniture->furnitureTile() == ftile) {
                     emit objectTileChanged(furniture);
                     if (!mTileChanges) {
@@ -107,6 +107,12 @@ public:
     void emitBuildingRotated()
     { emit buildingRotated(); }
 
+    void emitFloorEdited(BuildingFloor *floor)
+    { emit floorEdited(floor); }
+
+    void emitFloorTilesChanged(BuildingFloor *floor)
+    { emit floorTilesChanged(floor); }
+
     void emitObjectChanged(BuildingObject *object)
     { emit objectChanged(object); }
 
@@ -1264,11 +1264,6 @@ void BuildingEditorWindow::exportTMX()
                        QFileInfo(fileName).absolutePath());
 }
 
-#include "buildingmap.h"
-#include "mapcomposite.h"
-#include "mapmanager.h"
-#include "newmapbinaryfile.h"
-
 void BuildingEditorWindow::exportNewBinary()
 {
     if (mCurrentDocument == nullptr)
@@ -1280,66 +1275,10 @@ void BuildingEditorWindow::exportNewBinary()
     if (fileName.isEmpty())
         return;
 
-    Building* building = mCurrentDocument->building();
-    BuildingMap bmap(building);
-    Map *map = bmap.mergedMap();
-
-#if 0
-    if (map->orientation() == Map::LevelIsometric) {
-        if (!BuildingPreferences::instance()->levelIsometric()) {
-            Map *isoMap = MapManager::instance()->convertOrientation(map, Map::Isometric);
-            TilesetManager::instance()->removeReferences(map->tilesets());
-            delete map;
-            map = isoMap;
-        }
-    }
-#endif
-    for (BuildingFloor *floor : building->floors()) {
-#if 0
-        // The given map has layers required by the editor, i.e., Floors, Walls,
-        // Doors, etc.  The TMXConfig.txt file may specify extra layer names.
-        // So we need to insert any extra layers in the order specified in
-        // TMXConfig.txt.  If the layer name has a N_ prefix, it is only added
-        // to level N, otherwise it is added to every level.  Object layers are
-        // added above *all* the tile layers in the map.
-        int previousExistingLayer = -1;
-        foreach (LayerInfo layerInfo, mLayers) {
-            QString layerName = layerInfo.mName;
-            int level;
-            if (MapComposite::levelForLayer(layerName, &level)) {
-                if (level != floor->level())
-                    continue;
-            } else {
-                layerName = tr("%1_%2").arg(floor->level()).arg(layerName);
-            }
-            int n;
-            if ((n = map->indexOfLayer(layerName)) >= 0) {
-                previousExistingLayer = n;
-                continue;
-            }
-            if (layerInfo.mType == LayerInfo::Tile) {
-                TileLayer *tl = new TileLayer(layerName, 0, 0,
-                                              map->width(), map->height());
-                if (previousExistingLayer < 0)
-                    previousExistingLayer = 0;
-                map->insertLayer(previousExistingLayer + 1, tl);
-                previousExistingLayer++;
-            } else {
-                ObjectGroup *og = new ObjectGroup(layerName,
-                                                  0, 0, map->width(), map->height());
-                map->addLayer(og);
-            }
-        }
-#endif
-
-        bmap.addRoomDefObjects(map, floor);
+    if (!BuildingTMX::instance()->exportNewBinary(currentBuilding(), fileName)) {
+        QMessageBox::critical(this, tr("Error Saving Map"),
+                              BuildingTMX::instance()->errorString());
     }
-
-    MapInfo* mapInfo = MapManager::instance()->newFromMap(map);
-    MapComposite mapComposite(mapInfo);
-
-    NewMapBinaryFile file;
-    file.write(&mapComposite, fileName);
 }
 
 void BuildingEditorWindow::editCut()
@@ -1648,7 +1587,7 @@ void BuildingEditorWindow::cropToMinimum()
         for (int y = 0; y < floor->height() + 1; y++) {
             for (int x = 0; x < floor->width() + 1; x++) {
                 foreach (QString layerName, floor->grimeLayers())
-                    if (!floor->grimeAt(layerName, x, y).isEmpty())
+                    if (floor->grimeIdAt(layerName, x, y))
                         tileBounds |= QRect(x, y, 1, 1);
             }
         }
@@ -1712,7 +1651,7 @@ void BuildingEditorWindow::cropBuilding(const QRect &bounds)
             FloorTileGrid *dest = new FloorTileGrid(floor->width() + 1, floor->height() + 1);
             for (int y = bounds.top(); y <= bounds.bottom() + 1; y++) {
                 for (int x = bounds.left(); x <= bounds.right() + 1; x++) {
-                    dest->replace(x-bounds.left(), y-bounds.top(), src->at(x, y));
+                    dest->replaceId(x-bounds.left(), y-bounds.top(), src->idAt(x, y));
                 }
             }
             grime[layerName] = dest;
@@ -1795,7 +1734,7 @@ void BuildingEditorWindow::resizeBuilding()
             for (int y = 0; y < floor->height() + 1; y++) {
                 for (int x = 0; x < floor->width() + 1; x++) {
                     if (newBounds.adjusted(0, 0, 1, 1).contains(x + offset.x(), y + offset.y()))
-                        dest->replace(x + offset.x(), y + offset.y(), src->at(x, y));
+                        dest->replaceId(x + offset.x(), y + offset.y(), src->idAt(x, y));
                 }
             }
             grime[layerName] = dest;
@@ -2064,21 +2003,25 @@ void BuildingEditorWindow::reportMissingTilesets()
             }
         }
     }
+    QSet<uint> tileIds;
     foreach (BuildingFloor *floor, building->floors()) {
         foreach (QString layerName, floor->grimeLayers()) {
             for (int y = 0; y < floor->height(); y++) {
                 for (int x = 0; x < floor->width(); x++) {
-                    QString tileName = floor->grimeAt(layerName, x, y);
-                    QString tilesetName;
-                    int tileIndex;
-                    if (!tileName.isEmpty() && BuildingTilesMgr::parseTileName(tileName, tilesetName, tileIndex)) {
-                        if (!TileMetaInfoMgr::instance()->tileset(tilesetName))
-                            missingTilesets.insert(tilesetName);
-                    }
+                    if (uint tileId = floor->grimeIdAt(layerName, x, y))
+                        tileIds.insert(tileId);
                 }
             }
         }
     }
+    foreach (uint tileId, tileIds) {
+        QString tilesetName;
+        int tileIndex;
+        if (BuildingTilesMgr::parseTileName(TileNameTable::name(tileId), tilesetName, tileIndex)) {
+            if (!TileMetaInfoMgr::instance()->tileset(tilesetName))
+                missingTilesets.insert(tilesetName);
+        }
+    }
 
     if (missingTilesets.size()) {
         QStringList tilesets(missingTilesets.values());
@@ -24,6 +24,8 @@
 #include "furnituregroups.h"
 #include "roofhiding.h"
 
+#include <algorithm>
+
 #if defined(Q_OS_WIN) && (_MSC_VER >= 1600)
 // Hmmmm.  libtiled.dll defines the MapRands class as so:
 // class TILEDSHARED_EXPORT MapRands : public QVector<QVector<int> >
@@ -50,16 +52,6 @@ FloorTileGrid::FloorTileGrid(int width, int height) :
 {
 }
 
-const QString &FloorTileGrid::at(int index) const
-{
-    if (mUseVector)
-        return mCellsVector[index];
-    QHash<int,QString>::const_iterator it = mCells.find(index);
-    if (it != mCells.end())
-        return *it;
-    return mEmptyCell;
-}
-
 // Return true if the area of this object matches that of the other object placed at x,y.
 bool FloorTileGrid::matches(int x, int y, const FloorTileGrid &other) const
 {
@@ -71,7 +63,7 @@ bool FloorTileGrid::matches(int x, int y, const FloorTileGrid &other) const
     }
     for (int y1 = 0; y1 < other.height(); y1++) {
         for (int x1 = 0; x1 < other.width(); x1++) {
-            if (at(x + x1, y + y1) != other.at(x1, y1)) {
+            if (idAt(x + x1, y + y1) != other.idAt(x1, y1)) {
                 return false;
             }
         }
@@ -79,64 +71,55 @@ bool FloorTileGrid::matches(int x, int y, const FloorTileGrid &other) const
     return true;
 }
 
-void FloorTileGrid::replace(int index, const QString &tile)
+void FloorTileGrid::replaceId(int index, uint tileId)
 {
     if (mUseVector) {
-        if (!mCellsVector[index].isEmpty() && tile.isEmpty()) mCount--;
-        if (mCellsVector[index].isEmpty() && !tile.isEmpty()) mCount++;
-        mCellsVector[index] = tile;
+        uint &cell = mCellsVector[index];
+        if (cell && !tileId) mCount--;
+        if (!cell && tileId) mCount++;
+        cell = tileId;
         return;
     }
-    QHash<int,QString>::iterator it = mCells.find(index);
+    QHash<int,uint>::iterator it = mCells.find(index);
     if (it == mCells.end()) {
-        if (tile.isEmpty())
+        if (!tileId)
             return;
-        mCells.insert(index, tile);
-        mCount++;
-    } else if (!tile.isEmpty()) {
-        (*it) = tile;
+        mCells.insert(index, tileId);
         mCount++;
+    } else if (tileId) {
+        (*it) = tileId;
     } else {
         mCells.erase(it);
         mCount--;
     }
-    if (mCells.size() > 300 * 300 / 3)
+    // A dense grid is smaller than a hash holding more than a few cells.
+    if (mCells.size() > size() / 4)
         swapToVector();
 }
 
+void FloorTileGrid::replace(int index, const QString &tile)
+{
+    replaceId(index, TileNameTable::id(tile));
+}
+
 void FloorTileGrid::replace(int x, int y, const QString &tile)
 {
     Q_ASSERT(contains(x, y));
-    replace(y * mWidth + x, tile);
+    replaceId(y * mWidth + x, TileNameTable::id(tile));
 }
 
 bool FloorTileGrid::replace(const QString &tile)
 {
-    bool changed = false;
-    for (int x = 0; x < mWidth; x++) {
-        for (int y = 0; y < mHeight; y++) {
-            if (at(x, y) != tile) {
-                replace(x, y, tile);
-                changed = true;
-            }
-        }
-    }
-    return changed;
+    return replaceIds(bounds(), TileNameTable::id(tile));
 }
 
 bool FloorTileGrid::replace(const QRegion &rgn, const QString &tile)
 {
+    uint tileId = TileNameTable::id(tile);
     bool changed = false;
-    for (QRect r2 : rgn) {
-        r2 &= bounds();
-        for (int x = r2.left(); x <= r2.right(); x++) {
-            for (int y = r2.top(); y <= r2.bottom(); y++) {
-                if (at(x, y) != tile) {
-                    replace(x, y, tile);
-                    changed = true;
-                }
-            }
-        }
+    for (const QRect &r : rgn) {
+        if (replaceIds(r & bounds(), tileId))
+            changed = true;
     }
     return changed;
 }
@@ -148,11 +131,11 @@ bool FloorTileGrid::replace(const QRegion &rgn, const QPoint &p,
     bool changed = false;
     for (QRect r2 : rgn) {
         r2 &= bounds();
-        for (int x = r2.left(); x <= r2.right(); x++) {
-            for (int y = r2.top(); y <= r2.bottom(); y++) {
-                QString tile = other->at(x - p.x(), y - p.y());
-                if (at(x, y) != tile) {
-                    replace(x, y, tile);
+        for (int y = r2.top(); y <= r2.bottom(); y++) {
+            for (int x = r2.left(); x <= r2.right(); x++) {
+                uint tileId = other->idAt(x - p.x(), y - p.y());
+                if (idAt(x, y) != tileId) {
+                    replaceId(x, y, tileId);
                     changed = true;
                 }
             }
@@ -163,11 +146,18 @@ bool FloorTileGrid::replace(const QRegion &rgn, const QPoint &p,
 
 bool FloorTileGrid::replace(const QRect &r, const QString &tile)
 {
+    return replaceIds(r, TileNameTable::id(tile));
+}
+
+bool FloorTileGrid::replace(const QPoint &p, const FloorTileGrid *other)
+{
+    const QRect r = other->bounds().translated(p) & bounds();
     bool changed = false;
-    for (int x = r.left(); x <= r.right(); x++) {
-        for (int y = r.top(); y <= r.bottom(); y++) {
-            if (at(x, y) != tile) {
-                replace(x, y, tile);
+    for (int y = r.top(); y <= r.bottom(); y++) {
+        for (int x = r.left(); x <= r.right(); x++) {
+            uint tileId = other->idAt(x - p.x(), y - p.y());
+            if (idAt(x, y) != tileId) {
+                replaceId(x, y, tileId);
                 changed = true;
             }
         }
@@ -175,15 +165,13 @@ bool FloorTileGrid::replace(const QRect &r, const QString &tile)
     return changed;
 }
 
-bool FloorTileGrid::replace(const QPoint &p, const FloorTileGrid *other)
+bool FloorTileGrid::replaceIds(const QRect &r, uint tileId)
 {
-    const QRect r = other->bounds().translated(p) & bounds();
     bool changed = false;
-    for (int x = r.left(); x <= r.right(); x++) {
-        for (int y = r.top(); y <= r.bottom(); y++) {
-            QString tile = other->at(x - p.x(), y - p.y());
-            if (at(x, y) != tile) {
-                replace(x, y, tile);
+    for (int y = r.top(); y <= r.bottom(); y++) {
+        for (int x = r.left(); x <= r.right(); x++) {
+            if (idAt(x, y) != tileId) {
+                replaceId(x, y, tileId);
                 changed = true;
             }
         }
@@ -194,7 +182,7 @@ bool FloorTileGrid::replace(const QPoint &p, const FloorTileGrid *other)
 void FloorTileGrid::clear()
 {
     if (mUseVector)
-        mCellsVector.fill(mEmptyCell);
+        mCellsVector.fill(0);
     else
         mCells.clear();
     mCount = 0;
@@ -209,9 +197,9 @@ FloorTileGrid *FloorTileGrid::clone(const QRect &r)
 {
     FloorTileGrid *klone = new FloorTileGrid(r.width(), r.height());
     const QRect r2 = r & bounds();
-    for (int x = r2.left(); x <= r2.right(); x++) {
-        for (int y = r2.top(); y <= r2.bottom(); y++) {
-            klone->replace(x - r.x(), y - r.y(), at(x, y));
+    for (int y = r2.top(); y <= r2.bottom(); y++) {
+        for (int x = r2.left(); x <= r2.right(); x++) {
+            klone->replaceId(x - r.x(), y - r.y(), idAt(x, y));
         }
     }
     return klone;
@@ -222,9 +210,9 @@ FloorTileGrid *FloorTileGrid::clone(const QRect &r, const QRegion &rgn)
     FloorTileGrid *klone = new FloorTileGrid(r.width(), r.height());
     for (QRect r2 : rgn) {
         r2 &= bounds() & r;
-        for (int x = r2.left(); x <= r2.right(); x++) {
-            for (int y = r2.top(); y <= r2.bottom(); y++) {
-                klone->replace(x - r.x(), y - r.y(), at(x, y));
+        for (int y = r2.top(); y <= r2.bottom(); y++) {
+            for (int x = r2.left(); x <= r2.right(); x++) {
+                klone->replaceId(x - r.x(), y - r.y(), idAt(x, y));
             }
         }
     }
@@ -234,8 +222,8 @@ FloorTileGrid *FloorTileGrid::clone(const QRect &r, const QRegion &rgn)
 void FloorTileGrid::swapToVector()
 {
     Q_ASSERT(!mUseVector);
-    mCellsVector.resize(size());
-    QHash<int,QString>::const_iterator it = mCells.begin();
+    mCellsVector.fill(0, size());
+    QHash<int,uint>::const_iterator it = mCells.begin();
     while (it != mCells.end()) {
         mCellsVector[it.key()] = (*it);
         ++it;
@@ -248,7 +236,9 @@ void FloorTileGrid::swapToVector()
 
 BuildingFloor::BuildingFloor(Building *building, int level) :
     mBuilding(building),
-    mLevel(level)
+    mLevel(level),
+    mRoomRectsValid(false),
+    mObjectIndexValid(false)
 {
     int w = building->width();
     int h = building->height();
@@ -289,32 +279,204 @@ bool BuildingFloor::isBottomFloor() const
     return mLevel == 0;
 }
 
+// Objects are bucketed in cells of (1 << OBJECT_CELL_SHIFT) squares square.
+static const int OBJECT_CELL_SHIFT = 3;
+
+// Gap between the orders of neighbouring objects after the index is rebuilt,
+// so objects can be inserted between others without renumbering.
+static const int OBJECT_ORDER_STEP = 1024;
+
+static inline quint32 objectCellKey(int cx, int cy)
+{
+    return (quint32(quint16(cy)) << 16) | quint16(cx);
+}
+
 void BuildingFloor::insertObject(int index, BuildingObject *object)
 {
     mObjects.insert(index, object);
+
+    QMutexLocker locker(&mObjectIndexMutex);
+    if (!mObjectIndexValid)
+        return;
+    int prev = (index > 0) ? mIndexedObjects[mObjects[index - 1]].order : 0;
+    if (index == mObjects.size() - 1) {
+        indexObject(object, prev + OBJECT_ORDER_STEP);
+        return;
+    }
+    int next = mIndexedObjects[mObjects[index + 1]].order;
+    if (next - prev > 1)
+        indexObject(object, prev + (next - prev) / 2);
+    else
+        mObjectIndexValid = false;
 }
 
 BuildingObject *BuildingFloor::removeObject(int index)
 {
     BuildingObject *object = mObjects.takeAt(index);
-    if (RoofObject *ro = object->asRoof())
-        mFlatRoofsWithDepthThree.removeAll(ro);
-    if (Stairs *stairs = object->asStairs())
-        mStairs.removeAll(stairs);
+
+    QMutexLocker locker(&mObjectIndexMutex);
+    if (mObjectIndexValid)
+        unindexObject(object);
+    mMovedObjects.remove(object);
     return object;
 }
 
 BuildingObject *BuildingFloor::objectAt(int x, int y)
 {
-    foreach (BuildingObject *object, mObjects)
-        if (object->bounds().contains(x, y))
-            return object;
+    QMutexLocker locker(&mObjectIndexMutex);
+    updateObjectIndex();
+    if (const QVector<IndexedObject> *cell = objectCell(x, y)) {
+        for (int i = 0; i < cell->size(); i++)
+            if (cell->at(i).bounds.contains(x, y))
+                return cell->at(i).object;
+    }
     return 0;
 }
 
+// Called with mObjectIndexMutex locked.  Returns the bucket holding the
+// square (x,y), or 0 if no objects overlap that bucket.
+const QVector<BuildingFloor::IndexedObject> *BuildingFloor::objectCell(int x, int y) const
+{
+    QHash<quint32,QVector<IndexedObject> >::const_iterator it =
+            mObjectCells.constFind(objectCellKey(x >> OBJECT_CELL_SHIFT, y >> OBJECT_CELL_SHIFT));
+    return (it == mObjectCells.constEnd()) ? 0 : &it.value();
+}
+
+// Returns the objects overlapping 'rect' in the same order as objects().
+QList<BuildingObject*> BuildingFloor::objectsInRect(const QRect &rect)
+{
+    QMap<int,BuildingObject*> found;
+    QMutexLocker locker(&mObjectIndexMutex);
+    updateObjectIndex();
+    findObjects(rect, found);
+    return found.values();
+}
+
+// Called with mObjectIndexMutex locked.  Adds the objects overlapping 'rect'
+// to 'found' by order.
+void BuildingFloor::findObjects(const QRect &rect, QMap<int,BuildingObject*> &found)
+{
+    if (rect.isEmpty())
+        return;
+    int cx1 = rect.left() >> OBJECT_CELL_SHIFT, cx2 = rect.right() >> OBJECT_CELL_SHIFT;
+    int cy1 = rect.top() >> OBJECT_CELL_SHIFT, cy2 = rect.bottom() >> OBJECT_CELL_SHIFT;
+    for (int cy = cy1; cy <= cy2; cy++) {
+        for (int cx = cx1; cx <= cx2; cx++) {
+            QHash<quint32,QVector<IndexedObject> >::const_iterator it =
+                    mObjectCells.constFind(objectCellKey(cx, cy));
+            if (it == mObjectCells.constEnd())
+                continue;
+            foreach (const IndexedObject &entry, it.value())
+                if (entry.bounds.intersects(rect))
+                    found.insert(entry.order, entry.object);
+        }
+    }
+}
+
+// Returns the objects that may place tiles in 'area' when laid out, in the
+// same order as objects().  Some furniture goes one square past its bounds,
+// and roof tiles can be offset further still.
+QList<BuildingObject*> BuildingFloor::objectsLaidOutIn(const QRect &area)
+{
+    QMap<int,BuildingObject*> found;
+    QMutexLocker locker(&mObjectIndexMutex);
+    updateObjectIndex();
+    findObjects(area.adjusted(-1, -1, 1, 1), found);
+    foreach (BuildingObject *object, mIndexedRoofs) {
+        int margin = 1;
+        foreach (BuildingTileEntry *entry, object->tiles()) {
+            if (!entry)
+                continue;
+            foreach (const QPoint &offset, entry->mOffsets)
+                margin = qMax(margin, 1 + qMax(qAbs(offset.x()), qAbs(offset.y())));
+        }
+        if (object->bounds().adjusted(-margin, -margin, margin, margin).intersects(area))
+            found.insert(mIndexedObjects[object].order, object);
+    }
+    return found.values();
+}
+
+// Called when the bounds of an object on this floor may have changed.
+void BuildingFloor::objectMoved(BuildingObject *object)
+{
+    QMutexLocker locker(&mObjectIndexMutex);
+    if (mObjectIndexValid && mIndexedObjects.contains(object))
+        mMovedObjects.insert(object);
+}
+
+// Called with mObjectIndexMutex locked.
+void BuildingFloor::updateObjectIndex()
+{
+    if (!mObjectIndexValid) {
+        mIndexedObjects.clear();
+        mObjectCells.clear();
+        mMovedObjects.clear();
+        mIndexedRoofs.clear();
+        for (int i = 0; i < mObjects.size(); i++)
+            indexObject(mObjects[i], (i + 1) * OBJECT_ORDER_STEP);
+        mObjectIndexValid = true;
+        return;
+    }
+    foreach (BuildingObject *object, mMovedObjects) {
+        int order = mIndexedObjects[object].order;
+        unindexObject(object);
+        indexObject(object, order);
+    }
+    mMovedObjects.clear();
+}
+
+void BuildingFloor::indexObject(BuildingObject *object, int order)
+{
+    IndexedObject entry;
+    entry.object = object;
+    entry.bounds = object->bounds();
+    entry.order = order;
+    mIndexedObjects[object] = entry;
+    if (object->asRoof())
+        mIndexedRoofs.insert(object);
+    if (entry.bounds.isEmpty())
+        return;
+    int cx1 = entry.bounds.left() >> OBJECT_CELL_SHIFT, cx2 = entry.bounds.right() >> OBJECT_CELL_SHIFT;
+    int cy1 = entry.bounds.top() >> OBJECT_CELL_SHIFT, cy2 = entry.bounds.bottom() >> OBJECT_CELL_SHIFT;
+    for (int cy = cy1; cy <= cy2; cy++) {
+        for (int cx = cx1; cx <= cx2; cx++) {
+            QVector<IndexedObject> &cell = mObjectCells[objectCellKey(cx, cy)];
+            int i = cell.size();
+            while (i > 0 && cell[i - 1].order > order)
+                --i;
+            cell.insert(i, entry);
+        }
+    }
+}
+
+void BuildingFloor::unindexObject(BuildingObject *object)
+{
+    IndexedObject entry = mIndexedObjects.take(object);
+    mIndexedRoofs.remove(object);
+    if (entry.bounds.isEmpty())
+        return;
+    int cx1 = entry.bounds.left() >> OBJECT_CELL_SHIFT, cx2 = entry.bounds.right() >> OBJECT_CELL_SHIFT;
+    int cy1 = entry.bounds.top() >> OBJECT_CELL_SHIFT, cy2 = entry.bounds.bottom() >> OBJECT_CELL_SHIFT;
+    for (int cy = cy1; cy <= cy2; cy++) {
+        for (int cx = cx1; cx <= cx2; cx++) {
+            quint32 key = objectCellKey(cx, cy);
+            QVector<IndexedObject> &cell = mObjectCells[key];
+            for (int i = 0; i < cell.size(); i++) {
+                if (cell[i].object == object) {
+                    cell.remove(i);
+                    break;
+                }
+            }
+            if (cell.isEmpty())
+                mObjectCells.remove(key);
+        }
+    }
+}
+
 void BuildingFloor::setGrid(const QVector<QVector<Room *> > &grid)
 {
     mRoomAtPos = grid;
+    mRoomRectsValid = false;
 
     mIndexAtPos.resize(mRoomAtPos.size());
     for (int x = 0; x < mIndexAtPos.size(); x++)
@@ -322,13 +484,12 @@ void BuildingFloor::setGrid(const QVector<QVector<Room *> > &grid)
 }
 
 static void ReplaceRoofSlope(RoofObject *ro, const QRect &r,
-                             QVector<QVector<BuildingFloor::Square> > &squares,
-                             RoofObject::RoofTile tile)
+                             BuildingFloor::SquareGrid &squares,
+                             const QRect &bounds, RoofObject::RoofTile tile)
 {
     if (r.isEmpty()) return;
     int offset = ro->getOffset(tile);
     QPoint tileOffset = ro->slopeTiles()->offset(offset);
-    QRect bounds(0, 0, squares.size(), squares[0].size());
     QRect rOffset = r.translated(tileOffset) & bounds;
     for (int x = rOffset.left(); x <= rOffset.right(); x++)
         for (int y = rOffset.top(); y <= rOffset.bottom(); y++)
@@ -337,22 +498,22 @@ static void ReplaceRoofSlope(RoofObject *ro, const QRect &r,
 
 static void ReplaceRoofSlope(RoofObject *ro, const QRect &r,
                            const QVector<RoofObject::RoofTile> &tiles,
-                           QVector<QVector<BuildingFloor::Square> > &squares)
+                           BuildingFloor::SquareGrid &squares,
+                           const QRect &bounds)
 {
     if (tiles.isEmpty()) return;
     for (int y = r.top(); y <= r.bottom(); y++)
         for (int x = r.left(); x <= r.right(); x++)
-            ReplaceRoofSlope(ro, QRect(x, y, 1, 1), squares, tiles.at(x - r.left() + (y - r.top()) * r.width()));
+            ReplaceRoofSlope(ro, QRect(x, y, 1, 1), squares, bounds, tiles.at(x - r.left() + (y - r.top()) * r.width()));
 }
 
 static void ReplaceRoofGap(RoofObject *ro, const QRect &r,
-                           QVector<QVector<BuildingFloor::Square> > &squares,
-                           RoofObject::RoofTile tile)
+                           BuildingFloor::SquareGrid &squares,
+                           const QRect &bounds, RoofObject::RoofTile tile)
 {
     if (r.isEmpty()) return;
     int offset = ro->getOffset(tile);
     QPoint tileOffset = ro->capTiles()->offset(offset);
-    QRect bounds(0, 0, squares.size(), squares[0].size());
     QRect rOffset = r.translated(tileOffset) & bounds;
     for (int x = rOffset.left(); x <= rOffset.right(); x++)
         for (int y = rOffset.top(); y <= rOffset.bottom(); y++)
@@ -360,12 +521,11 @@ static void ReplaceRoofGap(RoofObject *ro, const QRect &r,
 }
 
 static void ReplaceRoofCap(RoofObject *ro, int x, int y,
-                           QVector<QVector<BuildingFloor::Square> > &squares,
-                           RoofObject::RoofTile tile)
+                           BuildingFloor::SquareGrid &squares,
+                           const QRect &bounds, RoofObject::RoofTile tile)
 {
     int offset = ro->getOffset(tile);
     QPoint tileOffset = ro->capTiles()->offset(offset);
-    QRect bounds(0, 0, squares.size(), squares[0].size());
     QPoint p = QPoint(x, y) + tileOffset;
     if (bounds.contains(p))
         squares[p.x()][p.y()].ReplaceRoofCap(ro->capTiles(), offset);
@@ -373,16 +533,18 @@ static void ReplaceRoofCap(RoofObject *ro, int x, int y,
 
 static void ReplaceRoofCap(RoofObject *ro, const QRect &r,
                            const QVector<RoofObject::RoofTile> &tiles,
-                           QVector<QVector<BuildingFloor::Square> > &squares)
+                           BuildingFloor::SquareGrid &squares,
+                           const QRect &bounds)
 {
     if (tiles.isEmpty()) return;
     for (int y = r.top(); y <= r.bottom(); y++)
         for (int x = r.left(); x <= r.right(); x++)
-            ReplaceRoofCap(ro, x, y, squares, tiles.at(x - r.left() + (y - r.top()) * r.width()));
+            ReplaceRoofCap(ro, x, y, squares, bounds, tiles.at(x - r.left() + (y - r.top()) * r.width()));
 }
 
 static void ReplaceRoofTop(RoofObject *ro, const QRect &r,
-                           QVector<QVector<BuildingFloor::Square> > &squares)
+                           BuildingFloor::SquareGrid &squares,
+                           const QRect &bounds)
 {
     if (r.isEmpty()) return;
     int offset = 0;
@@ -395,7 +557,6 @@ static void ReplaceRoofTop(RoofObject *ro, const QRect &r,
     else if (ro->depth() == RoofObject::Three)
         offset = ro->isN() ? BTC_RoofTops::North3 : BTC_RoofTops::West3;
     QPoint tileOffset = ro->topTiles()->offset(offset);
-    QRect bounds(0, 0, squares.size(), squares[0].size());
     QRect rOffset = r.translated(tileOffset) & bounds;
     for (int x = rOffset.left(); x <= rOffset.right(); x++)
         for (int y = rOffset.top(); y <= rOffset.bottom(); y++)
@@ -405,12 +566,11 @@ static void ReplaceRoofTop(RoofObject *ro, const QRect &r,
 }
 
 static void ReplaceRoofCorner(RoofObject *ro, int x, int y,
-                              QVector<QVector<BuildingFloor::Square> > &squares,
-                              RoofObject::RoofTile tile)
+                              BuildingFloor::SquareGrid &squares,
+                              const QRect &bounds, RoofObject::RoofTile tile)
 {
     int offset = ro->getOffset(tile);
     QPoint tileOffset = ro->slopeTiles()->offset(offset);
-    QRect bounds(0, 0, squares.size(), squares[0].size());
     QPoint p = QPoint(x, y) + tileOffset;
     if (bounds.contains(p))
         squares[p.x()][p.y()].ReplaceRoof(ro->slopeTiles(), offset);
@@ -418,19 +578,21 @@ static void ReplaceRoofCorner(RoofObject *ro, int x, int y,
 
 static void ReplaceRoofCorner(RoofObject *ro, const QRect &r,
                               const QVector<RoofObject::RoofTile> &tiles,
-                              QVector<QVector<BuildingFloor::Square> > &squares)
+                              BuildingFloor::SquareGrid &squares,
+                              const QRect &bounds)
 {
     if (tiles.isEmpty()) return;
     for (int y = r.top(); y <= r.bottom(); y++)
         for (int x = r.left(); x <= r.right(); x++) {
             RoofObject::RoofTile tile = tiles.at(x - r.left() + (y - r.top()) * r.width());
             if (tile != RoofObject::TileCount)
-                ReplaceRoofCorner(ro, x, y, squares, tile);
+                ReplaceRoofCorner(ro, x, y, squares, bounds, tile);
         }
 }
 
 static void ReplaceFurniture(int x, int y,
-                             QVector<QVector<BuildingFloor::Square> > &squares,
+                             BuildingFloor::SquareGrid &squares,
+                             const QRect &clip,
                              BuildingTile *btile,
                              BuildingFloor::Square::SquareSection sectionMin,
                              BuildingFloor::Square::SquareSection sectionMax,
@@ -439,15 +601,15 @@ static void ReplaceFurniture(int x, int y,
     if (!btile)
         return;
     Q_ASSERT(dw <= 1 && dh <= 1);
-    QRect bounds(0, 0, squares.size() - 1 + dw, squares[0].size() - 1 + dh);
-    if (bounds.contains(x, y))
+    QRect bounds(0, 0, squares.width() - 1 + dw, squares.height() - 1 + dh);
+    if (bounds.contains(x, y) && clip.contains(x, y))
         squares[x][y].ReplaceFurniture(btile, sectionMin, sectionMax);
 }
 
-static void ReplaceDoor(Door *door, QVector<QVector<BuildingFloor::Square> > &squares)
+static void ReplaceDoor(Door *door, BuildingFloor::SquareGrid &squares,
+                        const QRect &bounds)
 {
     int x = door->x(), y = door->y();
-    QRect bounds(0, 0, squares.size(), squares[0].size());
     if (bounds.contains(x, y)) {
         squares[x][y].ReplaceDoor(door->tile(),
                                   door->isW() ? BTC_Doors::West
@@ -458,39 +620,47 @@ static void ReplaceDoor(Door *door, QVector<QVector<BuildingFloor::Square> > &sq
     }
 }
 
-static void ReplaceWindow(Window *window, QVector<QVector<BuildingFloor::Square> > &squares)
+// The curtains and shutters of a window are placed next to the window's own
+// square, so only the squares inside 'clip' are touched here.
+static void ReplaceWindow(Window *window, BuildingFloor::SquareGrid &squares,
+                          const QRect &clip)
 {
     int x = window->x(), y = window->y();
-    QRect bounds(0, 0, squares.size(), squares[0].size());
+    QRect bounds(0, 0, squares.width(), squares.height());
     if (bounds.contains(x, y)) {
-        squares[x][y].ReplaceWindow(window->tile(),
-                                    window->isW() ? BTC_Windows::West
-                                                  : BTC_Windows::North);
+        if (clip.contains(x, y))
+            squares[x][y].ReplaceWindow(window->tile(),
+                                        window->isW() ? BTC_Windows::West
+                                                      : BTC_Windows::North);
 
         // Window curtains on exterior walls must be *inside* the
         // room.
         if (squares[x][y].mExterior) {
             int dx = window->isW() ? 1 : 0;
             int dy = window->isN() ? 1 : 0;
-            if ((x - dx >= 0) && (y - dy >= 0))
+            if ((x - dx >= 0) && (y - dy >= 0) && clip.contains(x - dx, y - dy))
                 squares[x - dx][y - dy].ReplaceCurtains(window, true);
-        } else
+        } else if (clip.contains(x, y))
             squares[x][y].ReplaceCurtains(window, false);
 
         if (squares[x][y].mExterior) {
             if (window->isN()) {
-                if (x > 0)
+                if (x > 0 && clip.contains(x - 1, y))
                     squares[x-1][y].ReplaceShutters(window, true);
-                squares[x][y].ReplaceShutters(window, true);
-                squares[x][y].ReplaceShutters(window, false);
-                if (x < bounds.right())
+                if (clip.contains(x, y)) {
+                    squares[x][y].ReplaceShutters(window, true);
+                    squares[x][y].ReplaceShutters(window, false);
+                }
+                if (x < bounds.right() && clip.contains(x + 1, y))
                     squares[x + 1][y].ReplaceShutters(window, false);
             } else {
-                if (y > 0)
+                if (y > 0 && clip.contains(x, y - 1))
                     squares[x][y - 1].ReplaceShutters(window, true);
-                squares[x][y].ReplaceShutters(window, true);
-                squares[x][y].ReplaceShutters(window, false);
-                if (y < bounds.bottom())
+                if (clip.contains(x, y)) {
+                    squares[x][y].ReplaceShutters(window, true);
+                    squares[x][y].ReplaceShutters(window, false);
+                }
+                if (y < bounds.bottom() && clip.contains(x, y + 1))
                     squares[x][y + 1].ReplaceShutters(window, false);
             }
         } else {
@@ -500,14 +670,46 @@ static void ReplaceWindow(Window *window, QVector<QVector<BuildingFloor::Square>
 }
 
 void BuildingFloor::LayoutToSquares()
+{
+    LayoutToSquares(bounds(1, 1));
+}
+
+// Only the squares in 'area' are recalculated, the others keep the tiles from
+// the previous layout.  The caller is responsible for adding enough of a
+// border around whatever changed to include any affected walls, roofs and
+// grime.
+void BuildingFloor::LayoutToSquares(const QRect &area)
 {
     int w = width() + 1;
     int h = height() + 1;
     // +1 for the outside walls;
     static const Square empty;
-    squares.resize(w);
-    for (int x = 0; x < w; x++)
-        squares[x].fill(empty, h);
+
+    QRect update = area & bounds(1, 1);
+    if (squares.width() != w || squares.height() != h)
+        update = bounds(1, 1);
+    if (update.isEmpty())
+        return;
+
+    // Some squares look at the squares to the north and west while being laid
+    // out, and those neighbours must be at the same stage of the layout, not
+    // in their final state.  So an extra row and column around the area are
+    // laid out as well, then put back the way they were.
+    const QRect work = update.adjusted(-1, -1, 1, 1) & bounds(1, 1);
+    QVector<Square> border;
+    for (int x = work.left(); x <= work.right(); x++)
+        for (int y = work.top(); y <= work.bottom(); y++)
+            if (!update.contains(x, y))
+                border += squares[x][y];
+
+    if (update == bounds(1, 1)) {
+        squares.resize(w, h);
+        squares.fill(empty);
+    } else {
+        for (int x = work.left(); x <= work.right(); x++)
+            for (int y = work.top(); y <= work.bottom(); y++)
+                squares[x][y] = empty;
+    }
 
     BuildingTileEntry *wtype = 0;
 
@@ -523,18 +725,21 @@ void BuildingFloor::LayoutToSquares()
         floors += room->tile(Room::Floor);
     }
 
-    for (int x = 0; x < width(); x++) {
-        for (int y = 0; y < height(); y++) {
+    // Walls look at the room to the north and west.
+    const QRect indexRect = work.adjusted(-1, -1, 0, 0) & bounds();
+    for (int x = indexRect.left(); x <= indexRect.right(); x++) {
+        for (int y = indexRect.top(); y <= indexRect.bottom(); y++) {
             Room *room = mRoomAtPos[x][y];
             if (room != nullptr && RoofHiding::isEmptyOutside(room->Name))
                 room = nullptr;
             mIndexAtPos[x][y] = room ? mBuilding->indexOf(room) : -1;
-            squares[x][y].mExterior = room == 0;
+            if (work.contains(x, y))
+                squares[x][y].mExterior = room == 0;
         }
     }
 
-    for (int x = 0; x < width() + 1; x++) {
-        for (int y = 0; y < height() + 1; y++) {
+    for (int x = work.left(); x <= work.right(); x++) {
+        for (int y = work.top(); y <= work.bottom(); y++) {
             // Place N walls...
             if (x < width()) {
                 if (y == height() && mIndexAtPos[x][y - 1] >= 0) {
@@ -568,12 +773,15 @@ void BuildingFloor::LayoutToSquares()
         }
     }
 
+    // Only objects near the squares being laid out can change them.
+    const QList<BuildingObject*> objects = objectsLaidOutIn(work);
+
     // Handle WallObjects.
-    foreach (BuildingObject *object, mObjects) {
+    foreach (BuildingObject *object, objects) {
         if (WallObject *wall = object->asWall()) {
             int x = wall->x(), y = wall->y();
             if (wall->isN()) {
-                QRect r = wall->bounds() & bounds(1, 0);
+                QRect r = wall->bounds() & bounds(1, 0) & work;
                 for (y = r.top(); y <= r.bottom(); y++) {
                     squares[x][y].SetWallW(wall->tile(squares[x][y].mExterior
                                                       ? WallObject::TileExterior
@@ -583,7 +791,7 @@ void BuildingFloor::LayoutToSquares()
                                                           : WallObject::TileInteriorTrim));
                 }
             } else {
-                QRect r = wall->bounds() & bounds(0, 1);
+                QRect r = wall->bounds() & bounds(0, 1) & work;
                 for (x = r.left(); x <= r.right(); x++) {
                     squares[x][y].SetWallN(wall->tile(squares[x][y].mExterior
                                                       ? WallObject::TileExterior
@@ -598,7 +806,7 @@ void BuildingFloor::LayoutToSquares()
 
     // Furniture in the Walls layer replaces wall entries with tiles.
     QList<FurnitureObject*> wallReplacement;
-    foreach (BuildingObject *object, mObjects) {
+    foreach (BuildingObject *object, objects) {
         if (FurnitureObject *fo = object->asFurniture()) {
             FurnitureTile *ftile = fo->furnitureTile()->resolved();
             if (ftile->owner()->layer() == FurnitureTiles::LayerWalls) {
@@ -628,7 +836,7 @@ void BuildingFloor::LayoutToSquares()
                 for (int i = 0; i < ftile->size().height(); i++) {
                     for (int j = 0; j < ftile->size().width(); j++) {
                         int sx = x + j + dx, sy = y + i + dy;
-                        if (bounds(1, 1).contains(sx, sy)) {
+                        if (work.contains(sx, sy)) {
                             Square &sq = squares[sx][sy];
                             if (killW)
                                 sq.SetWallW(fo->furnitureTile(), ftile->tile(j, i));
@@ -641,8 +849,8 @@ void BuildingFloor::LayoutToSquares()
         }
     }
 
-    for (int x = 0; x < width() + 1; x++) {
-        for (int y = 0; y < height() + 1; y++) {
+    for (int x = work.left(); x <= work.right(); x++) {
+        for (int y = work.top(); y <= work.bottom(); y++) {
             Square &s = squares[x][y];
             BuildingTileEntry *wallN = s.mWallN.entry;
             BuildingTileEntry *wallW = s.mWallW.entry;
@@ -671,8 +879,8 @@ void BuildingFloor::LayoutToSquares()
         }
     }
 
-    for (int x = 0; x < width() + 1; x++) {
-        for (int y = 0; y < height() + 1; y++) {
+    for (int x = work.left(); x <= work.right(); x++) {
+        for (int y = work.top(); y <= work.bottom(); y++) {
             Square &sq = squares[x][y];
             if ((sq.mEntries[Square::SectionWall] &&
                     !sq.mEntries[Square::SectionWall]->isNone()) ||
@@ -712,34 +920,30 @@ void BuildingFloor::LayoutToSquares()
         }
     }
 
-    mFlatRoofsWithDepthThree.clear();
-    mStairs.clear();
-
-    foreach (BuildingObject *object, mObjects) {
+    foreach (BuildingObject *object, objects) {
         int x = object->x();
         int y = object->y();
         if (Door *door = object->asDoor()) {
-            ReplaceDoor(door, squares);
+            ReplaceDoor(door, squares, work);
         }
         if (Window *window = object->asWindow()) {
-            ReplaceWindow(window, squares);
+            ReplaceWindow(window, squares, work);
         }
         if (Stairs *stairs = object->asStairs()) {
             // Stair objects are 5 tiles long but only have 3 tiles.
             if (stairs->isN()) {
                 for (int i = 1; i <= 3; i++)
-                    ReplaceFurniture(x, y + i, squares,
+                    ReplaceFurniture(x, y + i, squares, work,
                                      stairs->tile()->tile(stairs->getOffset(x, y + i)),
                                      Square::SectionFurniture,
                                      Square::SectionFurniture4);
             } else {
                 for (int i = 1; i <= 3; i++)
-                    ReplaceFurniture(x + i, y, squares,
+                    ReplaceFurniture(x + i, y, squares, work,
                                      stairs->tile()->tile(stairs->getOffset(x + i, y)),
                                      Square::SectionFurniture,
                                      Square::SectionFurniture4);
             }
-            mStairs += stairs;
         }
         if (FurnitureObject *fo = object->asFurniture()) {
             FurnitureTile *ftile = fo->furnitureTile()->resolved();
@@ -757,19 +961,19 @@ void BuildingFloor::LayoutToSquares()
                         if (fo->furnitureTile()->isE()) ++dx;
                         if (fo->furnitureTile()->isS()) ++dy;
                         ReplaceFurniture(x + j + dx, y + i + dy,
-                                         squares, ftile->tile(j, i),
+                                         squares, work, ftile->tile(j, i),
                                          Square::SectionRoofCap,
                                          Square::SectionRoofCap2,
                                          dx, dy);
                         break;
                     }
                     case FurnitureTiles::LayerWallOverlay:
-                        ReplaceFurniture(x + j, y + i, squares, ftile->tile(j, i),
+                        ReplaceFurniture(x + j, y + i, squares, work, ftile->tile(j, i),
                                          (ftile->isW() || ftile->isN()) ? Square::SectionWallOverlay : Square::SectionWallOverlay3,
                                          (ftile->isW() || ftile->isN()) ? Square::SectionWallOverlay2 : Square::SectionWallOverlay4);
                         break;
                     case FurnitureTiles::LayerWallFurniture:
-                        ReplaceFurniture(x + j, y + i, squares, ftile->tile(j, i),
+                        ReplaceFurniture(x + j, y + i, squares, work, ftile->tile(j, i),
                                          (ftile->isW() || ftile->isN()) ? Square::SectionWallFurniture : Square::SectionWallFurniture3,
                                          (ftile->isW() || ftile->isN()) ? Square::SectionWallFurniture2 : Square::SectionWallFurniture4);
                         break;
@@ -778,7 +982,7 @@ void BuildingFloor::LayoutToSquares()
                         if (fo->furnitureTile()->isE()) ++dx;
                         if (fo->furnitureTile()->isS()) ++dy;
                         ReplaceFurniture(x + j + dx, y + i + dy,
-                                         squares, ftile->tile(j, i),
+                                         squares, work, ftile->tile(j, i),
                                          Square::SectionFrame,
                                          Square::SectionFrame,
                                          dx, dy);
@@ -789,24 +993,24 @@ void BuildingFloor::LayoutToSquares()
                         if (fo->furnitureTile()->isE()) ++dx;
                         if (fo->furnitureTile()->isS()) ++dy;
                         ReplaceFurniture(x + j + dx, y + i + dy,
-                                         squares, ftile->tile(j, i),
+                                         squares, work, ftile->tile(j, i),
                                          Square::SectionDoor,
                                          Square::SectionDoor,
                                          dx, dy);
                         break;
                     }
                     case FurnitureTiles::LayerFurniture:
-                        ReplaceFurniture(x + j, y + i, squares, ftile->tile(j, i),
+                        ReplaceFurniture(x + j, y + i, squares, work, ftile->tile(j, i),
                                          Square::SectionFurniture,
                                          Square::SectionFurniture4);
                         break;
                     case FurnitureTiles::LayerRoof:
-                        ReplaceFurniture(x + j, y + i, squares, ftile->tile(j, i),
+                        ReplaceFurniture(x + j, y + i, squares, work, ftile->tile(j, i),
                                          Square::SectionRoof,
                                          Square::SectionRoof2);
                         break;
                     case FurnitureTiles::LayerFloorFurniture:
-                        ReplaceFurniture(x + j, y + i, squares, ftile->tile(j, i),
+                        ReplaceFurniture(x + j, y + i, squares, work, ftile->tile(j, i),
                                          Square::SectionFloorFurniture,
                                          Square::SectionFloorFurniture);
                         break;
@@ -894,24 +1098,24 @@ void BuildingFloor::LayoutToSquares()
             ReplaceRoofSlope(ro, squares, RoofObject::ShallowSlopeS2);
 #else
             tiles = ro->slopeTiles(tileRect);
-            ReplaceRoofSlope(ro, tileRect, tiles, squares);
+            ReplaceRoofSlope(ro, tileRect, tiles, squares, work);
 #endif
 
             tiles = ro->westCapTiles(tileRect);
-            ReplaceRoofCap(ro, tileRect, tiles, squares);
+            ReplaceRoofCap(ro, tileRect, tiles, squares, work);
 
             tiles = ro->eastCapTiles(tileRect);
-            ReplaceRoofCap(ro, tileRect, tiles, squares);
+            ReplaceRoofCap(ro, tileRect, tiles, squares, work);
 
             tiles = ro->northCapTiles(tileRect);
-            ReplaceRoofCap(ro, tileRect, tiles, squares);
+            ReplaceRoofCap(ro, tileRect, tiles, squares, work);
 
             tiles = ro->southCapTiles(tileRect);
-            ReplaceRoofCap(ro, tileRect, tiles, squares);
+            ReplaceRoofCap(ro, tileRect, tiles, squares, work);
 
 #if 1
             tiles = ro->cornerTiles(tileRect);
-            ReplaceRoofCorner(ro, tileRect, tiles, squares);
+            ReplaceRoofCorner(ro, tileRect, tiles, squares, work);
 #else
             // Inner corner
             bool slopeE, slopeS;
@@ -1106,9 +1310,7 @@ void BuildingFloor::LayoutToSquares()
             // Roof tops with depth of 3 are placed in the floor layer of the
             // floor above.
             if (ro->depth() != RoofObject::Three)
-                ReplaceRoofTop(ro, ro->flatTop(), squares);
-            else if (!ro->flatTop().isEmpty())
-                mFlatRoofsWithDepthThree += ro;
+                ReplaceRoofTop(ro, ro->flatTop(), squares, work);
 #if 0
             // West cap
             if (ro->isCappedW()) {
@@ -1565,7 +1767,7 @@ void BuildingFloor::LayoutToSquares()
         }
         for (int i = 0; i < ftile->size().height(); i++) {
             for (int j = 0; j < ftile->size().width(); j++) {
-                if (bounds(1, 1).contains(x + j + dx, y + i + dy)) {
+                if (work.contains(x + j + dx, y + i + dy)) {
                     Square &s = squares[x + j + dx][y + i + dy];
                     Square::SquareSection section = Square::SectionWall;
                     if (s.mEntries[section] && !s.mEntries[section]->isNone()) {
@@ -1604,35 +1806,45 @@ void BuildingFloor::LayoutToSquares()
     }
 
     // Place floors
-    for (int x = 0; x < width(); x++) {
-        for (int y = 0; y < height(); y++) {
+    const QRect floorRect = work & bounds();
+    for (int x = floorRect.left(); x <= floorRect.right(); x++) {
+        for (int y = floorRect.top(); y <= floorRect.bottom(); y++) {
             if (mIndexAtPos[x][y] >= 0)
                 squares[x][y].ReplaceFloor(floors[mIndexAtPos[x][y]], 0);
         }
     }
 
+    // Only the objects on the floor below are looked at, not the results of
+    // laying it out, so floors can be laid out in any order or in parallel.
     if (BuildingFloor *floorBelow = this->floorBelow()) {
+        const QList<BuildingObject*> objectsBelow = floorBelow->objectsLaidOutIn(work);
+
         // Place flat roof tops above roofs on the floor below
-        foreach (RoofObject *ro, floorBelow->mFlatRoofsWithDepthThree) {
-            ReplaceRoofTop(ro, ro->flatTop(), squares);
+        foreach (BuildingObject *object, objectsBelow) {
+            RoofObject *ro = object->asRoof();
+            if (ro && ro->depth() == RoofObject::Three && !ro->flatTop().isEmpty())
+                ReplaceRoofTop(ro, ro->flatTop(), squares, work);
         }
 
         // Nuke floors that have stairs on the floor below.
-        foreach (Stairs *stairs, floorBelow->mStairs) {
+        foreach (BuildingObject *object, objectsBelow) {
+            Stairs *stairs = object->asStairs();
+            if (!stairs)
+                continue;
             int x = stairs->x(), y = stairs->y();
             if (stairs->isW()) {
                 if (x + 1 < 0 || x + 3 >= width() || y < 0 || y >= height())
                     continue;
-                squares[x+1][y].ReplaceFloor(0, 0);
-                squares[x+2][y].ReplaceFloor(0, 0);
-                squares[x+3][y].ReplaceFloor(0, 0);
+                for (int i = 1; i <= 3; i++)
+                    if (work.contains(x + i, y))
+                        squares[x+i][y].ReplaceFloor(0, 0);
             }
             if (stairs->isN()) {
                 if (x < 0 || x >= width() || y + 1 < 0 || y + 3 >= height())
                     continue;
-                squares[x][y+1].ReplaceFloor(0, 0);
-                squares[x][y+2].ReplaceFloor(0, 0);
-                squares[x][y+3].ReplaceFloor(0, 0);
+                for (int i = 1; i <= 3; i++)
+                    if (work.contains(x, y + i))
+                        squares[x][y+i].ReplaceFloor(0, 0);
             }
         }
     }
@@ -1640,8 +1852,8 @@ void BuildingFloor::LayoutToSquares()
     FloorTileGrid *userTilesWalls = mGrimeGrid.contains(QLatin1String("Walls")) ? mGrimeGrid[QLatin1String("Walls")] : 0;
     FloorTileGrid *userTilesWalls2 = mGrimeGrid.contains(QLatin1String("Walls2")) ? mGrimeGrid[QLatin1String("Walls2")] : 0;
 
-    for (int x = 0; x < w; x++) {
-        for (int y = 0; y < h; y++) {
+    for (int x = work.left(); x <= work.right(); x++) {
+        for (int y = work.top(); y <= work.bottom(); y++) {
             Square &sq = squares[x][y];
 
             sq.ReplaceWallTrim();
@@ -1678,48 +1890,95 @@ void BuildingFloor::LayoutToSquares()
             }
         }
     }
+
+    int i = 0;
+    for (int x = work.left(); x <= work.right(); x++)
+        for (int y = work.top(); y <= work.bottom(); y++)
+            if (!update.contains(x, y))
+                squares[x][y] = border[i++];
+
+    mLayoutGrid = mRoomAtPos;
 }
 
-Door *BuildingFloor::GetDoorAt(int x, int y)
+QRect BuildingFloor::roomChangesSinceLayout() const
 {
-    foreach (BuildingObject *o, mObjects) {
-        if (!o->bounds().contains(x, y))
+    if (mLayoutGrid.size() != mRoomAtPos.size())
+        return bounds(1, 1);
+    QRect changed;
+    for (int x = 0; x < mRoomAtPos.size(); x++) {
+        // Columns that weren't modified still share their data.
+        if (mLayoutGrid[x] == mRoomAtPos[x])
             continue;
-        if (Door *door = o->asDoor())
-            return door;
+        if (mLayoutGrid[x].size() != mRoomAtPos[x].size())
+            return bounds(1, 1);
+        for (int y = 0; y < mRoomAtPos[x].size(); y++) {
+            if (mLayoutGrid[x][y] != mRoomAtPos[x][y])
+                changed |= QRect(x, y, 1, 1);
+        }
+    }
+    return changed;
+}
+
+Door *BuildingFloor::GetDoorAt(int x, int y)
+{
+    QMutexLocker locker(&mObjectIndexMutex);
+    updateObjectIndex();
+    if (const QVector<IndexedObject> *cell = objectCell(x, y)) {
+        for (int i = 0; i < cell->size(); i++) {
+            const IndexedObject &entry = cell->at(i);
+            if (!entry.bounds.contains(x, y))
+                continue;
+            if (Door *door = entry.object->asDoor())
+                return door;
+        }
     }
     return 0;
 }
 
 Window *BuildingFloor::GetWindowAt(int x, int y)
 {
-    foreach (BuildingObject *o, mObjects) {
-        if (!o->bounds().contains(x, y))
-            continue;
-        if (Window *window = o->asWindow())
-            return window;
+    QMutexLocker locker(&mObjectIndexMutex);
+    updateObjectIndex();
+    if (const QVector<IndexedObject> *cell = objectCell(x, y)) {
+        for (int i = 0; i < cell->size(); i++) {
+            const IndexedObject &entry = cell->at(i);
+            if (!entry.bounds.contains(x, y))
+                continue;
+            if (Window *window = entry.object->asWindow())
+                return window;
+        }
     }
     return 0;
 }
 
 Stairs *BuildingFloor::GetStairsAt(int x, int y)
 {
-    foreach (BuildingObject *o, mObjects) {
-        if (!o->bounds().contains(x, y))
-            continue;
-        if (Stairs *stairs = o->asStairs())
-            return stairs;
+    QMutexLocker locker(&mObjectIndexMutex);
+    updateObjectIndex();
+    if (const QVector<IndexedObject> *cell = objectCell(x, y)) {
+        for (int i = 0; i < cell->size(); i++) {
+            const IndexedObject &entry = cell->at(i);
+            if (!entry.bounds.contains(x, y))
+                continue;
+            if (Stairs *stairs = entry.object->asStairs())
+                return stairs;
+        }
     }
     return 0;
 }
 
 FurnitureObject *BuildingFloor::GetFurnitureAt(int x, int y)
 {
-    foreach (BuildingObject *o, mObjects) {
-        if (!o->bounds().contains(x, y))
-            continue;
-        if (FurnitureObject *fo = o->asFurniture())
-            return fo;
+    QMutexLocker locker(&mObjectIndexMutex);
+    updateObjectIndex();
+    if (const QVector<IndexedObject> *cell = objectCell(x, y)) {
+        for (int i = 0; i < cell->size(); i++) {
+            const IndexedObject &entry = cell->at(i);
+            if (!entry.bounds.contains(x, y))
+                continue;
+            if (FurnitureObject *fo = entry.object->asFurniture())
+                return fo;
+        }
     }
     return 0;
 }
@@ -1727,6 +1986,7 @@ FurnitureObject *BuildingFloor::GetFurnitureAt(int x, int y)
 void BuildingFloor::SetRoomAt(int x, int y, Room *room)
 {
     mRoomAtPos[x][y] = room;
+    mRoomRectsValid = false;
 }
 
 Room *BuildingFloor::GetRoomAt(const QPoint &pos)
@@ -1761,45 +2021,69 @@ bool BuildingFloor::contains(const QPoint &p, int dw, int dh)
     return contains(p.x(), p.y(), dw, dh);
 }
 
+// Returns the squares in 'room' as rectangles, each run of squares in a row
+// merged with identical runs in the rows below it.
 QVector<QRect> BuildingFloor::roomRegion(Room *room)
 {
-    QRegion region;
-    for (int y = 0; y < height(); y++) {
-        for (int x = 0; x < width(); x++) {
-            if (mRoomAtPos[x][y] == room)
-                region += QRect(x, y, 1, 1);
-        }
-    }
-
-    // Clean up the region by merging vertically-adjacent rectangles of the
-    // same width.
-    QVector<QRect> rects(region.begin(), region.end());
-    for (int i = 0; i < rects.size(); i++) {
-        QRect r = rects[i];
-        if (!r.isValid()) continue;
-        for (int j = 0; j < rects.size(); j++) {
-            if (i == j) continue;
-            QRect r2 = rects.at(j);
-            if (!r2.isValid()) continue;
-            if (r2.left() == r.left() && r2.right() == r.right()) {
-                if (r.bottom() + 1 == r2.top()) {
-                    r.setBottom(r2.bottom());
-                    rects[j] = QRect();
-                } else if (r.top() == r2.bottom() + 1) {
-                    r.setTop(r2.top());
-                    rects[j] = QRect();
-                }
+    if (!mRoomRectsValid)
+        updateRoomRects();
+    return mRoomRects.value(room);
+}
+
+static bool roomRectLessThan(const QRect &a, const QRect &b)
+{
+    return (a.top() < b.top()) || (a.top() == b.top() && a.left() < b.left());
+}
+
+// Finds the rectangles for every room in one pass over the grid.  A run of
+// squares extends the rectangle above it when that rectangle has the same
+// room, left and right; otherwise the rectangle above is finished.
+void BuildingFloor::updateRoomRects()
+{
+    struct OpenRect
+    {
+        Room *room;
+        int left, right, top;
+    };
+    QVector<OpenRect> above, row;
+
+    mRoomRects.clear();
+    int w = width(), h = height();
+    for (int y = 0; y <= h; y++) {
+        int i = 0;
+        int x = 0;
+        while (x < w && y < h) {
+            Room *room = mRoomAtPos[x][y];
+            int left = x;
+            while (x < w && mRoomAtPos[x][y] == room)
+                ++x;
+            if (!room)
+                continue;
+            int right = x - 1;
+            while (i < above.size() && above[i].left < left) {
+                const OpenRect &r = above[i++];
+                mRoomRects[r.room] += QRect(QPoint(r.left, r.top), QPoint(r.right, y - 1));
             }
+            if (i < above.size() && above[i].left == left && above[i].right == right
+                    && above[i].room == room) {
+                row += above[i++];
+            } else {
+                OpenRect r = { room, left, right, y };
+                row += r;
+            }
+        }
+        while (i < above.size()) {
+            const OpenRect &r = above[i++];
+            mRoomRects[r.room] += QRect(QPoint(r.left, r.top), QPoint(r.right, y - 1));
         }
-        rects[i] = r;
+        above.swap(row);
+        row.clear();
     }
 
-    QVector<QRect> result;
-    foreach (QRect r, rects) {
-        if (r.isValid())
-            result += r;
-    }
-    return result;
+    QHash<Room*,QVector<QRect> >::iterator it = mRoomRects.begin();
+    for (; it != mRoomRects.end(); ++it)
+        std::sort(it.value().begin(), it.value().end(), roomRectLessThan);
+    mRoomRectsValid = true;
 }
 
 QVector<QVector<Room *> > BuildingFloor::resizeGrid(const QSize &newSize) const
@@ -1818,7 +2102,7 @@ QMap<QString,FloorTileGrid*> BuildingFloor::resizeGrime(const QSize &newSize) co
         grid[key] = new FloorTileGrid(newSize.width(), newSize.height());
         for (int x = 0; x < qMin(mGrimeGrid[key]->width(), newSize.width()); x++)
             for (int y = 0; y < qMin(mGrimeGrid[key]->height(), newSize.height()); y++)
-                grid[key]->replace(x, y, mGrimeGrid[key]->at(x, y));
+                grid[key]->replaceId(x, y, mGrimeGrid[key]->idAt(x, y));
 
     }
 
@@ -1856,6 +2140,9 @@ void BuildingFloor::rotate(bool right)
 
     foreach (BuildingObject *object, mObjects)
         object->rotate(right);
+
+    QMutexLocker locker(&mObjectIndexMutex);
+    mObjectIndexValid = false;
 }
 
 void BuildingFloor::flip(bool horizontal)
@@ -1868,9 +2155,13 @@ void BuildingFloor::flip(bool horizontal)
             for (int y = 0; y < height() / 2; y++)
                 qSwap(mRoomAtPos[x][y], mRoomAtPos[x][height() - y - 1]);
     }
+    mRoomRectsValid = false;
 
     foreach (BuildingObject *object, mObjects)
         object->flip(horizontal);
+
+    QMutexLocker locker(&mObjectIndexMutex);
+    mObjectIndexValid = false;
 }
 
 BuildingFloor *BuildingFloor::clone()
@@ -1896,6 +2187,13 @@ QString BuildingFloor::grimeAt(const QString &layerName, int x, int y) const
     return QString();
 }
 
+uint BuildingFloor::grimeIdAt(const QString &layerName, int x, int y) const
+{
+    if (FloorTileGrid *grid = mGrimeGrid.value(layerName))
+        return grid->idAt(x, y);
+    return 0;
+}
+
 FloorTileGrid *BuildingFloor::grimeAt(const QString &layerName, const QRect &r)
 {
     if (mGrimeGrid.contains(layerName))
@@ -1930,10 +2228,15 @@ QMap<QString, FloorTileGrid *> BuildingFloor::setGrime(const QMap<QString,
 
 void BuildingFloor::setGrime(const QString &layerName, int x, int y,
                              const QString &tileName)
+{
+    setGrimeId(layerName, x, y, TileNameTable::id(tileName));
+}
+
+void BuildingFloor::setGrimeId(const QString &layerName, int x, int y, uint tileId)
 {
     if (!mGrimeGrid.contains(layerName))
         mGrimeGrid[layerName] = new FloorTileGrid(width() + 1, height() + 1);
-    mGrimeGrid[layerName]->replace(x, y, tileName);
+    mGrimeGrid[layerName]->replaceId(x, y, tileId);
 }
 
 
@@ -1981,20 +2284,26 @@ bool BuildingFloor::hasUserTiles(const QString &layerName)
 /////
 
 BuildingFloor::Square::Square() :
-    mEntries(MaxSection, 0),
-    mEntryEnum(MaxSection, 0),
     mWallOrientation(WallOrientInvalid),
-    mExterior(true),
-    mTiles(MaxSection, 0)
+    mExterior(true)
 {
+    // mTiles are owned by BuildingTiles
+    for (int i = 0; i < MaxSection; i++) {
+        mEntries[i] = 0;
+        mEntryEnum[i] = 0;
+        mTiles[i] = 0;
+    }
 }
 
+/////
 
-BuildingFloor::Square::~Square()
+void BuildingFloor::SquareGrid::resize(int width, int height)
 {
-    // mTiles are owned by BuildingTiles
-//    for (int i = 0; i < MaxSection; i++)
-    //        delete mTiles[i];
+    if (width == mWidth && height == mHeight)
+        return;
+    mWidth = width;
+    mHeight = height;
+    mSquares.resize(width * height);
 }
 
 void BuildingFloor::Square::SetWallN(BuildingTileEntry *tile)
@@ -2321,7 +2630,10 @@ void BuildingFloor::Square::ReplaceFloorGrime(BuildingTileEntry *grimeTile)
 #include "filesystemwatcher.h"
 #include "tiledeffile.h"
 #include "tilemetainfomgr.h"
+#include <QCoreApplication>
 #include <QFileInfo>
+#include <QMutex>
+#include <QThread>
 
 #if defined(Q_OS_WIN) && (_MSC_VER >= 1600)
 // Hmmmm.  libtiled.dll defines the Properties class as so:
@@ -2357,6 +2669,7 @@ void TileDefWatcher::check()
         if (fileInfo.exists()) {
             qDebug() << "TileDefWatcher read " << fileInfo.absoluteFilePath();
             mTileDefFile->read(fileInfo.absoluteFilePath());
+            updateGrimeFlags();
             if (!watching) {
                 mWatcher->addPath(fileInfo.canonicalFilePath());
                 watching = true;
@@ -2366,6 +2679,58 @@ void TileDefWatcher::check()
     }
 }
 
+void TileDefWatcher::updateGrimeFlags()
+{
+    const QString GrimeType(QLatin1String("GrimeType"));
+    const QString WallW(QLatin1String("WallW"));
+    const QString WallN(QLatin1String("WallN"));
+    const QString WestKeys[] = {
+        QLatin1String("DoorWallW"), WallW, QLatin1String("WallWTrans"), QLatin1String("windowW")
+    };
+    const QString NorthKeys[] = {
+        QLatin1String("DoorWallN"), WallN, QLatin1String("WallNTrans"), QLatin1String("windowN")
+    };
+    const QString WallNW(QLatin1String("WallNW"));
+    const QString WallSE(QLatin1String("WallSE"));
+
+    mGrimeFlags.clear();
+    foreach (TileDefTileset *tdts, mTileDefFile->tilesets()) {
+        QVector<quint8> &flags = mGrimeFlags[tdts->mName];
+        flags.fill(0, tdts->mTiles.size());
+        for (int i = 0; i < tdts->mTiles.size(); i++) {
+            const QMap<QString,QString> &props = tdts->mTiles[i]->mProperties;
+            quint8 f = 0;
+            QMap<QString,QString>::const_iterator grime = props.find(GrimeType);
+            if (grime != props.end()) {
+                f = GrimeTile;
+                if (props.contains(WestKeys[0]) || props.contains(WestKeys[1]) ||
+                        props.contains(WestKeys[2]) || props.contains(WestKeys[3]))
+                    f |= GrimeWest;
+                else if (props.contains(NorthKeys[0]) || props.contains(NorthKeys[1]) ||
+                         props.contains(NorthKeys[2]) || props.contains(NorthKeys[3]))
+                    f |= GrimeNorth;
+                else if (props.contains(WallNW))
+                    f |= GrimeWest | GrimeNorth;
+                else if (props.contains(WallSE))
+                    f |= GrimeSouthEast;
+                if (grime.value() == QLatin1String("FullWindow"))
+                    f |= GrimeFullWindow;
+                else if (grime.value() == QLatin1String("Trim"))
+                    f |= GrimeTrim;
+                else if (grime.value() == QLatin1String("DoubleLeft"))
+                    f |= GrimeDoubleLeft;
+                else if (grime.value() == QLatin1String("DoubleRight"))
+                    f |= GrimeDoubleRight;
+            } else if (props.contains(WallW)) {
+                f = GrimeTile | GrimeWest; // regular west wall
+            } else if (props.contains(WallN)) {
+                f = GrimeTile | GrimeNorth; // regular north wall
+            }
+            flags[i] = f;
+        }
+    }
+}
+
 void TileDefWatcher::fileChanged(const QString &path)
 {
     qDebug() << "TileDefWatcher.fileChanged() " << path;
@@ -2403,63 +2768,40 @@ struct GrimeProperties
     bool DoubleRight;
 };
 
+// BuildingTilesMgr::get() may add a new tile, and floors may be laid out on
+// several threads at once.
+static BuildingTile *getUserTile(const QString &tileName)
+{
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+    return BuildingTilesMgr::instance()->get(tileName);
+}
+
 static bool tileHasGrimeProperties(BuildingTile *btile, GrimeProperties *props)
 {
     if (btile == nullptr)
         return false;
 
+    // Floors may be laid out on worker threads, in which case BuildingMap
+    // has already done this.
     Tiled::Internal::TileDefWatcher *tileDefWatcher = getTileDefWatcher();
-    tileDefWatcher->check();
+    if (QThread::currentThread() == qApp->thread())
+        tileDefWatcher->check();
+
+    typedef Tiled::Internal::TileDefWatcher W;
+    quint8 flags = tileDefWatcher->grimeFlags(btile->mTilesetName, btile->mIndex);
 
     if (props) {
-        props->West = props->North = props->SouthEast = false;
-        props->FullWindow = props->Trim = false;
-        props->DoubleLeft = props->DoubleRight = false;
-    }
-
-    if (Tiled::Internal::TileDefTileset *tdts = tileDefWatcher->mTileDefFile->tileset(btile->mTilesetName)) {
-        if (Tiled::Internal::TileDefTile *tdt = tdts->tileAt(btile->mIndex)) {
-            if (tdt->mProperties.contains(QString::fromLatin1("GrimeType"))) {
-                if (props) {
-                    if (tdt->mProperties.contains(QString::fromLatin1("DoorWallW")) ||
-                            tdt->mProperties.contains(QString::fromLatin1("WallW")) ||
-                            tdt->mProperties.contains(QString::fromLatin1("WallWTrans")) ||
-                            tdt->mProperties.contains(QString::fromLatin1("windowW")))
-                        props->West = true;
-                    else if (tdt->mProperties.contains(QString::fromLatin1("DoorWallN")) ||
-                             tdt->mProperties.contains(QString::fromLatin1("WallN")) ||
-                             tdt->mProperties.contains(QString::fromLatin1("WallNTrans")) ||
-                             tdt->mProperties.contains(QString::fromLatin1("windowN")))
-                        props->North = true;
-                    else if (tdt->mProperties.contains(QString::fromLatin1("WallNW")))
-                        props->West = props->North = true;
-                    else if (tdt->mProperties.contains(QString::fromLatin1("WallSE")))
-                        props->SouthEast = true;
-                    if (tdt->mProperties.contains(QLatin1String("GrimeType"))) {
-                        props->FullWindow = tdt->mProperties[QLatin1String("GrimeType")] == QLatin1String("FullWindow");
-                        props->Trim = tdt->mProperties[QLatin1String("GrimeType")] == QLatin1String("Trim");
-                        props->DoubleLeft = tdt->mProperties[QLatin1String("GrimeType")] == QLatin1String("DoubleLeft");
-                        props->DoubleRight = tdt->mProperties[QLatin1String("GrimeType")] == QLatin1String("DoubleRight");
-                    }
-                }
-                return true;
-            }
-            if (tdt->mProperties.contains(QString::fromLatin1("WallW"))) {
-                if (props) {
-                    props->West = true; // regular west wall
-                }
-                return true;
-            }
-            if (tdt->mProperties.contains(QString::fromLatin1("WallN"))) {
-                if (props) {
-                    props->North = true; // regular north wall
-                }
-                return true;
-            }
-        }
+        props->West = flags & W::GrimeWest;
+        props->North = flags & W::GrimeNorth;
+        props->SouthEast = flags & W::GrimeSouthEast;
+        props->FullWindow = flags & W::GrimeFullWindow;
+        props->Trim = flags & W::GrimeTrim;
+        props->DoubleLeft = flags & W::GrimeDoubleLeft;
+        props->DoubleRight = flags & W::GrimeDoubleRight;
     }
 
-    return false;
+    return flags & W::GrimeTile;
 }
 
 #if 1
@@ -2599,7 +2941,7 @@ void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const
     }
 
     if (!userTileWalls.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls)) {
+        if (BuildingTile *btile = getUserTile(userTileWalls)) {
             if (tileHasGrimeProperties(btile, &props)) {
                 if (props.FullWindow) {
                     if (props.West) grimeEnumW = -1;
@@ -2630,7 +2972,7 @@ void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const
         }
     }
     if (!userTileWalls2.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls2)) {
+        if (BuildingTile *btile = getUserTile(userTileWalls2)) {
             if (tileHasGrimeProperties(btile, &props)) {
                 if (props.FullWindow) {
                     if (props.West) grimeEnumW = -1;
@@ -2818,7 +3160,7 @@ void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const
     }
 
     if (!userTileWalls.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls)) {
+        if (BuildingTile *btile = getUserTile(userTileWalls)) {
             if (tileHasGrimeProperties(btile, &props)) {
                 if (props.FullWindow) {
                     if (props.West) grimeEnumW = -1;
@@ -2845,7 +3187,7 @@ void BuildingFloor::Square::ReplaceWallGrime(BuildingTileEntry *grimeTile, const
         }
     }
     if (!userTileWalls2.isEmpty()) {
-        if (BuildingTile *btile = BuildingTilesMgr::instance()->get(userTileWalls2)) {
+        if (BuildingTile *btile = getUserTile(userTileWalls2)) {
             if (tileHasGrimeProperties(btile, &props)) {
                 if (props.FullWindow) {
                     if (props.West) grimeEnumW = -1;
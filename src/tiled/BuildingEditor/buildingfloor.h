@@ -18,11 +18,15 @@
 #ifndef BUILDINGFLOOR_H
 #define BUILDINGFLOOR_H
 
+#include "tilenametable.h"
+
 #include <QHash>
 #include <QList>
 #include <QMap>
+#include <QMutex>
 #include <QObject>
 #include <QRegion>
+#include <QSet>
 #include <QString>
 #include <QStringList>
 #include <QVector>
@@ -42,6 +46,7 @@ class Room;
 class Stairs;
 class Window;
 
+// User-drawn tiles.  Each cell holds a TileNameTable ID, 0 for no tile.
 class FloorTileGrid
 {
 public:
@@ -56,16 +61,34 @@ public:
     QRect bounds() const
     { return QRect(0, 0, mWidth, mHeight); }
 
-    const QString &at(int index) const;
+    uint idAt(int index) const
+    {
+        if (mUseVector)
+            return mCellsVector[index];
+        return mCells.value(index, 0);
+    }
 
-    const QString &at(int x, int y) const
+    uint idAt(int x, int y) const
     {
         Q_ASSERT(contains(x, y));
-        return at(x + y * mWidth);
+        return idAt(x + y * mWidth);
     }
 
+    const QString &at(int index) const
+    { return TileNameTable::name(idAt(index)); }
+
+    const QString &at(int x, int y) const
+    { return TileNameTable::name(idAt(x, y)); }
+
     bool matches(int x, int y, const FloorTileGrid &other) const;
 
+    void replaceId(int index, uint tileId);
+    void replaceId(int x, int y, uint tileId)
+    {
+        Q_ASSERT(contains(x, y));
+        replaceId(x + y * mWidth, tileId);
+    }
+
     void replace(int index, const QString &tile);
     void replace(int x, int y, const QString &tile);
     bool replace(const QString &tile);
@@ -87,14 +110,14 @@ public:
     FloorTileGrid *clone(const QRect &r, const QRegion &rgn);
 
 private:
+    bool replaceIds(const QRect &r, uint tileId);
     void swapToVector();
 
     int mWidth, mHeight;
     int mCount;
-    QHash<int,QString> mCells;
-    QVector<QString> mCellsVector;
+    QHash<int,uint> mCells;
+    QVector<uint> mCellsVector;
     bool mUseVector;
-    QString mEmptyCell;
 };
 
 class BuildingFloor
@@ -153,13 +176,13 @@ public:
         };
 
         Square();
-        ~Square();
 
-        QVector<BuildingTileEntry*> mEntries;
-        QVector<int> mEntryEnum;
+        // Fixed-size arrays so a Square never allocates.
+        BuildingTileEntry *mEntries[MaxSection];
+        int mEntryEnum[MaxSection];
         WallOrientation mWallOrientation;
         bool mExterior;
-        QVector<BuildingTile*> mTiles;
+        BuildingTile *mTiles[MaxSection];
 
         struct WallInfo {
             WallInfo() :
@@ -200,7 +223,59 @@ public:
         int getWallOffset();
     };
 
-    QVector<QVector<Square> > squares;
+    // The squares of a floor are stored row by row in a single array that is
+    // only reallocated when the size of the floor changes.  squares[x][y]
+    // works as it did when this was a vector of columns.
+    class SquareGrid
+    {
+    public:
+        class Column
+        {
+        public:
+            Column(Square *first, int stride) :
+                mFirst(first),
+                mStride(stride)
+            {}
+
+            Square &operator[](int y) const
+            { return mFirst[y * mStride]; }
+
+        private:
+            Square *mFirst;
+            int mStride;
+        };
+
+        SquareGrid() :
+            mWidth(0),
+            mHeight(0)
+        {}
+
+        int width() const
+        { return mWidth; }
+
+        int height() const
+        { return mHeight; }
+
+        void resize(int width, int height);
+
+        void fill(const Square &square)
+        { mSquares.fill(square); }
+
+        Column operator[](int x)
+        {
+            Q_ASSERT(x >= 0 && x < mWidth);
+            return Column(mSquares.data() + x, mWidth);
+        }
+
+        const Square &at(int x, int y) const
+        { return mSquares.at(x + y * mWidth); }
+
+    private:
+        int mWidth, mHeight;
+        QVector<Square> mSquares;
+    };
+
+    SquareGrid squares;
 
     BuildingFloor(Building *building, int level);
     ~BuildingFloor();
@@ -233,6 +308,8 @@ public:
     { return mObjects.size(); }
 
     BuildingObject *objectAt(int x, int y);
+    QList<BuildingObject*> objectsInRect(const QRect &rect);
+    void objectMoved(BuildingObject *object);
 
     inline BuildingObject *objectAt(const QPoint &pos)
     { return objectAt(pos.x(), pos.y()); }
@@ -257,6 +334,8 @@ public:
     { return mRoomAtPos; }
 
     void LayoutToSquares();
+    void LayoutToSquares(const QRect &area);
+    QRect roomChangesSinceLayout() const;
 
     int width() const;
     int height() const;
@@ -286,6 +365,7 @@ public:
     { return mGrimeGrid.keys(); }
 
     QString grimeAt(const QString &layerName, int x, int y) const;
+    uint grimeIdAt(const QString &layerName, int x, int y) const;
     FloorTileGrid *grimeAt(const QString &layerName, const QRect &r);
     FloorTileGrid *grimeAt(const QString &layerName, const QRect &r, const QRegion &rgn);
 
@@ -293,6 +373,7 @@ public:
 
     QMap<QString,FloorTileGrid*> setGrime(const QMap<QString,FloorTileGrid*> &grime);
     void setGrime(const QString &layerName, int x, int y, const QString &tileName);
+    void setGrimeId(const QString &layerName, int x, int y, uint tileId);
     void setGrime(const QString &layerName, const QPoint &p, const FloorTileGrid *other);
     void setGrime(const QString &layerName, const QRegion &rgn, const QString &tileName);
     void setGrime(const QString &layerName, const QRegion &rgn, const QPoint &pos, const FloorTileGrid *other);
@@ -324,13 +405,39 @@ private:
     Building *mBuilding;
     QVector<QVector<Room*> > mRoomAtPos;
     QVector<QVector<int> > mIndexAtPos;
+    QVector<QVector<Room*> > mLayoutGrid; // mRoomAtPos as of the last LayoutToSquares
     int mLevel;
+    QHash<Room*,QVector<QRect> > mRoomRects; // roomRegion() for every room
+    bool mRoomRectsValid;
     QList<BuildingObject*> mObjects;
+
+    // The objects in mObjects bucketed by the cells their bounds overlap,
+    // each bucket sorted by the position of the object in mObjects.  Built
+    // on the first lookup; objects whose bounds changed are re-bucketed on
+    // the next lookup.  Floors read the objects on the floor below while
+    // being laid out in parallel, hence the mutex.
+    struct IndexedObject
+    {
+        BuildingObject *object;
+        QRect bounds;
+        int order;
+    };
+    void updateRoomRects();
+    QList<BuildingObject*> objectsLaidOutIn(const QRect &area);
+    void findObjects(const QRect &rect, QMap<int,BuildingObject*> &found);
+    const QVector<IndexedObject> *objectCell(int x, int y) const;
+    void updateObjectIndex();
+    void indexObject(BuildingObject *object, int order);
+    void unindexObject(BuildingObject *object);
+    QMutex mObjectIndexMutex;
+    bool mObjectIndexValid;
+    QHash<BuildingObject*,IndexedObject> mIndexedObjects;
+    QHash<quint32,QVector<IndexedObject> > mObjectCells;
+    QSet<BuildingObject*> mMovedObjects;
+    QSet<BuildingObject*> mIndexedRoofs; // tile offsets may place tiles outside the bounds
     QMap<QString,FloorTileGrid*> mGrimeGrid;
     QMap<QString,qreal> mLayerOpacity;
     QMap<QString,bool> mLayerVisibility;
-    QList<RoofObject*> mFlatRoofsWithDepthThree;
-    QList<Stairs*> mStairs;
 };
 
 } // namespace BuildingEditor
@@ -348,14 +455,40 @@ public:
 
     void check();
 
+    // Wall and grime properties of each tile, from the .tiles file.
+    enum GrimeFlag {
+        GrimeTile = 0x01, // the tile has grime or is a regular wall
+        GrimeWest = 0x02,
+        GrimeNorth = 0x04,
+        GrimeSouthEast = 0x08,
+        GrimeFullWindow = 0x10,
+        GrimeTrim = 0x20,
+        GrimeDoubleLeft = 0x40,
+        GrimeDoubleRight = 0x80
+    };
+
+    quint8 grimeFlags(const QString &tilesetName, int index) const
+    {
+        QHash<QString,QVector<quint8> >::const_iterator it = mGrimeFlags.find(tilesetName);
+        if (it == mGrimeFlags.end() || index < 0 || index >= it.value().size())
+            return 0;
+        return it.value().at(index);
+    }
+
 public slots:
     void fileChanged(const QString &path);
 
+private:
+    void updateGrimeFlags();
+
 public:
     Tiled::Internal::FileSystemWatcher *mWatcher;
     Tiled::Internal::TileDefFile *mTileDefFile;
     bool tileDefFileChecked;
     bool watching;
+
+private:
+    QHash<QString,QVector<quint8> > mGrimeFlags;
 };
 
 }
@@ -541,20 +541,24 @@ void BuildingIsoScene::setToolTiles(const FloorTileGrid *tiles,
     QSize tilesSize(tiles->width(), tiles->height());
     mToolTiles.resize(tilesSize, QPoint());
 
+    QHash<uint,Tile*> tileById;
+    tileById[0] = 0;
+
     for (int x = 0; x < tiles->width(); x++) {
         for (int y = 0; y < tiles->height(); y++) {
-            QString tileName = tiles->at(x, y);
-            Tile *tile = 0;
-            if (!tileName.isEmpty()) {
-                tile = TilesetManager::instance()->missingTile();
+            uint tileId = tiles->idAt(x, y);
+            QHash<uint,Tile*>::const_iterator it = tileById.constFind(tileId);
+            if (it == tileById.constEnd()) {
+                Tile *tile = TilesetManager::instance()->missingTile();
                 QString tilesetName;
                 int index;
-                if (BuildingTilesMgr::parseTileName(tileName, tilesetName, index)) {
+                if (BuildingTilesMgr::parseTileName(TileNameTable::name(tileId), tilesetName, index)) {
                     if (tilesetByName.contains(tilesetName))
                         tile = tilesetByName[tilesetName]->tileAt(index);
                 }
+                it = tileById.insert(tileId, tile);
             }
-            mToolTiles.setCell(x, y, Cell(tile));
+            mToolTiles.setCell(x, y, Cell(*it));
         }
     }
 
@@ -613,26 +617,15 @@ void BuildingIsoScene::resetDrag(BuildingFloor *floor, BuildingObject *object)
     mBuildingMap->resetDrag(floor, object);
 }
 
-void BuildingIsoScene::changeFloorGrid(BuildingFloor *floor,
-                                            const QVector<QVector<Room*> > &grid)
-{
-    mBuildingMap->changeFloorGrid(floor, grid);
-}
-
-void BuildingIsoScene::resetFloorGrid(BuildingFloor *floor)
-{
-    mBuildingMap->resetFloorGrid(floor);
-}
-
-void BuildingIsoScene::changeUserTiles(BuildingFloor *floor,
-                                       const QMap<QString,FloorTileGrid*> &tiles)
+void BuildingIsoScene::dragRooms(BuildingFloor *floor, const QRegion &selection,
+                                 const QPoint &offset)
 {
-    mBuildingMap->changeUserTiles(floor, tiles);
+    mBuildingMap->dragRooms(floor, selection, offset);
 }
 
-void BuildingIsoScene::resetUserTiles(BuildingFloor *floor)
+void BuildingIsoScene::resetDragRooms(BuildingFloor *floor)
 {
-    mBuildingMap->resetUserTiles(floor);
+    mBuildingMap->resetDragRooms(floor);
 }
 
 bool BuildingIsoScene::shouldShowFloorItem(BuildingFloor *floor) const
@@ -811,7 +804,7 @@ void BuildingIsoScene::floorEdited(BuildingFloor *floor)
 {
     BuildingBaseScene::floorEdited(floor);
 
-    mBuildingMap->floorEdited(floor);
+    mBuildingMap->floorGridChanged(floor);
 }
 
 void BuildingIsoScene::floorTilesChanged(BuildingFloor *floor)
@@ -899,7 +892,7 @@ void BuildingIsoScene::currentLayerChanged()
 void BuildingIsoScene::roomAtPositionChanged(BuildingFloor *floor, const QPoint &pos)
 {
     Q_UNUSED(pos);
-    mBuildingMap->floorEdited(floor);
+    mBuildingMap->floorGridChanged(floor);
 }
 
 void BuildingIsoScene::roomDefinitionChanged()
@@ -190,10 +190,8 @@ public:
     void setCursorObject(BuildingObject *object);
     void dragObject(BuildingFloor *floor, BuildingObject *object, const QPoint &offset);
     void resetDrag(BuildingFloor *floor, BuildingObject *object);
-    void changeFloorGrid(BuildingFloor *floor, const QVector<QVector<Room*> > &grid);
-    void resetFloorGrid(BuildingFloor *floor);
-    void changeUserTiles(BuildingFloor *floor, const QMap<QString,FloorTileGrid*> &tiles);
-    void resetUserTiles(BuildingFloor *floor);
+    void dragRooms(BuildingFloor *floor, const QRegion &selection, const QPoint &offset);
+    void resetDragRooms(BuildingFloor *floor);
 
     bool shouldShowFloorItem(BuildingFloor *floor) const;
     bool shouldShowObjectItem(BuildingObject *object) const;
@@ -42,11 +42,28 @@
 #include "zlevelrenderer.h"
 
 #include <QDebug>
+#include <QHash>
+#include <QPair>
 
 using namespace BuildingEditor;
 using namespace Tiled;
 using namespace Tiled::Internal;
 
+// Walls are placed on the north and west edges of a square and the wall
+// corners and trim look at the squares to the north and west, while window
+// curtains and shutters go on the squares either side of the window.  So any
+// change to a square can affect the squares up to two away from it.
+static const int LAYOUT_MARGIN = 2;
+
+// Past this many rectangles it is cheaper to lay out the bounding rectangle
+// than to loop over every object on the floor once per rectangle.
+static const int MAX_LAYOUT_RECTS = 8;
+
+// Laying out fewer squares than this is quicker than waking the worker threads.
+static const int PARALLEL_LAYOUT_AREA = 32 * 32;
+
+static const int MAX_LAYOUT_THREADS = 4;
+
 BuildingMap::BuildingMap(Building *building) :
     mBuilding(building),
     mMapComposite(0),
@@ -54,7 +71,6 @@ BuildingMap::BuildingMap(Building *building) :
     mBlendMapComposite(0),
     mBlendMap(0),
     mMapRenderer(0),
-    mCursorObjectFloor(0),
     mShadowBuilding(0),
     pending(false),
     pendingRecreateAll(false),
@@ -220,71 +236,32 @@ QStringList BuildingMap::requiredLayerNames()
 
 void BuildingMap::setCursorObject(BuildingFloor *floor, BuildingObject *object)
 {
-    if (mCursorObjectFloor && (mCursorObjectFloor != floor)) {
-        pendingLayoutToSquares.insert(mCursorObjectFloor);
-        if (mCursorObjectFloor->floorAbove())
-            pendingLayoutToSquares.insert(mCursorObjectFloor->floorAbove());
-        schedulePending();
-        mCursorObjectFloor = nullptr;
-    }
-
-    if (mShadowBuilding->setCursorObject(floor, object)) {
-        pendingLayoutToSquares.insert(floor);
-        if (floor && floor->floorAbove())
-            pendingLayoutToSquares.insert(floor->floorAbove());
-        schedulePending();
-        mCursorObjectFloor = object ? floor : nullptr;
-    }
+    if (mShadowBuilding->setCursorObject(floor, object))
+        takeShadowChanges();
 }
 
 void BuildingMap::dragObject(BuildingFloor *floor, BuildingObject *object, const QPoint &offset)
 {
     mShadowBuilding->dragObject(floor, object, offset);
-    pendingLayoutToSquares.insert(floor);
-    if (floor->floorAbove())
-        pendingLayoutToSquares.insert(floor->floorAbove());
-    schedulePending();
+    takeShadowChanges();
 }
 
 void BuildingMap::resetDrag(BuildingFloor *floor, BuildingObject *object)
 {
+    Q_UNUSED(floor)
     mShadowBuilding->resetDrag(object);
-    pendingLayoutToSquares.insert(floor);
-    if (floor->floorAbove())
-        pendingLayoutToSquares.insert(floor->floorAbove());
-    schedulePending();
+    takeShadowChanges();
 }
 
-void BuildingMap::changeFloorGrid(BuildingFloor *floor, const QVector<QVector<Room*> > &grid)
+void BuildingMap::dragRooms(BuildingFloor *floor, const QRegion &selection,
+                            const QPoint &offset)
 {
-    mShadowBuilding->changeFloorGrid(floor, grid);
-    pendingLayoutToSquares.insert(floor);
-    schedulePending();
-}
-
-void BuildingMap::resetFloorGrid(BuildingFloor *floor)
-{
-    mShadowBuilding->resetFloorGrid(floor);
-    pendingLayoutToSquares.insert(floor);
-    schedulePending();
-}
-
-void BuildingMap::changeUserTiles(BuildingFloor *floor, const QMap<QString,FloorTileGrid*> &tiles)
-{
-    mShadowBuilding->changeUserTiles(floor, tiles);
-    pendingSquaresToTileLayers[floor] |= floor->bounds(1, 1);
-    foreach (QString layerName, floor->grimeLayers())
-        pendingUserTilesToLayer[floor][layerName] |= floor->bounds(1, 1);
-    schedulePending();
+    roomsDragged(floor, mShadowBuilding->dragRooms(floor, selection, offset));
 }
 
-void BuildingMap::resetUserTiles(BuildingFloor *floor)
+void BuildingMap::resetDragRooms(BuildingFloor *floor)
 {
-    mShadowBuilding->resetUserTiles(floor);
-    pendingSquaresToTileLayers[floor] |= floor->bounds();
-    foreach (QString layerName, floor->grimeLayers())
-        pendingUserTilesToLayer[floor][layerName] |= floor->bounds(1, 1);
-    schedulePending();
+    roomsDragged(floor, mShadowBuilding->resetDragRooms(floor));
 }
 
 void BuildingMap::suppressTiles(BuildingFloor *floor, const QRegion &rgn)
@@ -341,36 +318,23 @@ void BuildingMap::loadNeededTilesets(Building *building)
     }
 }
 
-// Copied from BuildingFloor::roomRegion()
 static QList<QRect> cleanupRegion(QRegion region)
 {
     // Clean up the region by merging vertically-adjacent rectangles of the
-    // same width.
-    QVector<QRect> rects(region.begin(), region.end());
-    for (int i = 0; i < rects.size(); i++) {
-        QRect r = rects[i];
-        if (!r.isValid()) continue;
-        for (int j = 0; j < rects.size(); j++) {
-            if (i == j) continue;
-            QRect r2 = rects.at(j);
-            if (!r2.isValid()) continue;
-            if (r2.left() == r.left() && r2.right() == r.right()) {
-                if (r.bottom() + 1 == r2.top()) {
-                    r.setBottom(r2.bottom());
-                    rects[j] = QRect();
-                } else if (r.top() == r2.bottom() + 1) {
-                    r.setTop(r2.top());
-                    rects[j] = QRect();
-                }
-            }
-        }
-        rects[i] = r;
-    }
-
+    // same width.  QRegion's rectangles are sorted top-to-bottom, so each
+    // one can only extend the last rectangle with the same left and right.
     QList<QRect> ret;
-    foreach (QRect r, rects) {
-        if (r.isValid())
+    QHash<QPair<int,int>,int> lastWithSpan;
+    for (QRegion::const_iterator it = region.begin(); it != region.end(); ++it) {
+        const QRect &r = *it;
+        QPair<int,int> span(r.left(), r.right());
+        QHash<QPair<int,int>,int>::iterator last = lastWithSpan.find(span);
+        if (last != lastWithSpan.end() && ret[last.value()].bottom() + 1 == r.top()) {
+            ret[last.value()].setBottom(r.bottom());
+        } else {
+            lastWithSpan[span] = ret.size();
             ret += r;
+        }
     }
     return ret;
 }
@@ -469,7 +433,6 @@ void BuildingMap::BuildingToMap()
     if (mShadowBuilding)
         delete mShadowBuilding;
     mShadowBuilding = new ShadowBuilding(mBuilding);
-    mCursorObjectFloor = nullptr;
 
     Map::Orientation orient = static_cast<Map::Orientation>(defaultOrientation());
 
@@ -539,9 +502,16 @@ void BuildingMap::BuildingToMap()
     mMapComposite->setBlendOverMap(mBlendMapComposite);
 
     // Set the automatically-generated tiles.
+    QList<BuildingLayoutJobs::Job> jobs;
+    foreach (BuildingFloor *floor, mBuilding->floors()) {
+        BuildingLayoutJobs::Job job = { floor, floor->bounds(1, 1) };
+        jobs += job;
+        job.floor = mShadowBuilding->floor(floor->level());
+        jobs += job;
+    }
+    layoutFloors(jobs);
     foreach (CompositeLayerGroup *layerGroup, mBlendMapComposite->layerGroups()) {
         BuildingFloor *floor = mBuilding->floor(layerGroup->level());
-        floor->LayoutToSquares();
         BuildingSquaresToTileLayers(floor, floor->bounds(1, 1), layerGroup);
     }
 
@@ -569,6 +539,9 @@ void BuildingMap::BuildingSquaresToTileLayers(BuildingFloor *floor,
     if (mSuppressTiles.contains(floor))
         suppress = mSuppressTiles[floor];
 
+    BuildingTilesMgr *btiles = BuildingTilesMgr::instance();
+    const BuildingFloor::SquareGrid &squares = shadowFloor->squares;
+
     int layerIndex = 0;
     foreach (TileLayer *tl, layerGroup->layers()) {
         int section = mLayerToSection[tl->name()];
@@ -578,15 +551,16 @@ void BuildingMap::BuildingSquaresToTileLayers(BuildingFloor *floor,
             tl->erase();
         else
             tl->erase(area/*.adjusted(0,0,1,1)*/);
-        for (int x = area.x(); x <= area.right(); x++) {
-            for (int y = area.y(); y <= area.bottom(); y++) {
+        // Row by row, the same order the squares and the layer's cells are stored.
+        for (int y = area.y(); y <= area.bottom(); y++) {
+            for (int x = area.x(); x <= area.right(); x++) {
                 if (section != BuildingFloor::Square::SectionFloor
-                        && suppress.contains(QPoint(x, y)))
+                        && !suppress.isEmpty() && suppress.contains(QPoint(x, y)))
                     continue;
-                const BuildingFloor::Square &square = shadowFloor->squares[x][y];
+                const BuildingFloor::Square &square = squares.at(x, y);
                 if (BuildingTile *btile = square.mTiles[section]) {
                     if (!btile->isNone()) {
-                        if (Tiled::Tile *tile = BuildingTilesMgr::instance()->tileFor(btile))
+                        if (Tiled::Tile *tile = btiles->tileFor(btile))
                             tl->setCell(x + offset, y + offset, Cell(tile));
                     }
                     continue;
@@ -595,7 +569,7 @@ void BuildingMap::BuildingSquaresToTileLayers(BuildingFloor *floor,
                     int tileOffset = square.mEntryEnum[section];
                     if (entry->isNone() || entry->tile(tileOffset)->isNone())
                         continue;
-                    if (Tiled::Tile *tile = BuildingTilesMgr::instance()->tileFor(entry->tile(tileOffset)))
+                    if (Tiled::Tile *tile = btiles->tileFor(entry->tile(tileOffset)))
                         tl->setCell(x + offset, y + offset, Cell(tile));
                 }
 
@@ -635,25 +609,30 @@ void BuildingMap::userTilesToLayer(BuildingFloor *floor,
 
     BuildingFloor *shadowFloor = mShadowBuilding->floor(floor->level());
 
+    // Each distinct tile name is parsed once.
+    QHash<uint,Tile*> tileById;
+    tileById[0] = nullptr;
+
     for (int x = bounds.left(); x <= bounds.right(); x++) {
         for (int y = bounds.top(); y <= bounds.bottom(); y++) {
             if (suppress.contains(QPoint(x, y))) {
                 layer->setCell(x, y, Cell());
                 continue;
             }
-            QString tileName = shadowFloor->grimeAt(layerName, x, y);
-            Tile *tile = nullptr;
-            if (!tileName.isEmpty()) {
-                tile = TilesetManager::instance()->missingTile();
+            uint tileId = shadowFloor->grimeIdAt(layerName, x, y);
+            QHash<uint,Tile*>::const_iterator it = tileById.constFind(tileId);
+            if (it == tileById.constEnd()) {
+                Tile *tile = TilesetManager::instance()->missingTile();
                 QString tilesetName;
                 int index;
-                if (BuildingTilesMgr::parseTileName(tileName, tilesetName, index)) {
+                if (BuildingTilesMgr::parseTileName(TileNameTable::name(tileId), tilesetName, index)) {
                     if (tilesetByName.contains(tilesetName)) {
                         tile = tilesetByName[tilesetName]->tileAt(index);
                     }
                 }
+                it = tileById.insert(tileId, tile);
             }
-            layer->setCell(x, y, Cell(tile));
+            layer->setCell(x, y, Cell(*it));
         }
     }
 
@@ -676,10 +655,17 @@ void BuildingMap::floorEdited(BuildingFloor *floor)
 {
     mShadowBuilding->floorEdited(floor);
 
-    pendingLayoutToSquares.insert(floor);
+    pendingLayoutToSquares[floor] |= floor->bounds(1, 1);
     schedulePending();
 }
 
+void BuildingMap::floorGridChanged(BuildingFloor *floor)
+{
+    mShadowBuilding->floorEdited(floor);
+
+    roomsChanged(floor);
+}
+
 void BuildingMap::floorTilesChanged(BuildingFloor *floor)
 {
     mShadowBuilding->floorTilesChanged(floor);
@@ -688,7 +674,7 @@ void BuildingMap::floorTilesChanged(BuildingFloor *floor)
 
     // Painting tiles in the Walls/Walls2 layer affects which grime tiles are chosen.
 //    if (tiles.contains(QLatin1Literal("Walls")) || tiles.contains(QLatin1Literal("Walls2")))
-        pendingLayoutToSquares.insert(floor);
+        pendingLayoutToSquares[floor] |= floor->bounds(1, 1);
 
     schedulePending();
 }
@@ -702,43 +688,23 @@ void BuildingMap::floorTilesChanged(BuildingFloor *floor, const QString &layerNa
 
     // Painting tiles in the Walls/Walls2 layer affects which grime tiles are chosen.
     if (layerName == QLatin1String("Walls") || layerName == QLatin1String("Walls2"))
-        pendingLayoutToSquares.insert(floor);
+        pendingLayoutToSquares[floor] |= bounds;
 
     schedulePending();
 }
 
 void BuildingMap::objectAdded(BuildingObject *object)
 {
-    BuildingFloor *floor = object->floor();
-    pendingLayoutToSquares.insert(floor);
-
-    // Stairs affect the floor tiles on the floor above.
-    // Roofs sometimes affect the floor tiles on the floor above.
-    if (BuildingFloor *floorAbove = floor->floorAbove()) {
-        if (object->affectsFloorAbove())
-            pendingLayoutToSquares.insert(floorAbove);
-    }
-
-    schedulePending();
-
+    // The ShadowBuilding records the area covered by the object before and
+    // after the change, including the floor above for stairs and roofs.
     mShadowBuilding->objectAdded(object);
+    takeShadowChanges();
 }
 
 void BuildingMap::objectAboutToBeRemoved(BuildingObject *object)
 {
-    BuildingFloor *floor = object->floor();
-    pendingLayoutToSquares.insert(floor);
-
-    // Stairs affect the floor tiles on the floor above.
-    // Roofs sometimes affect the floor tiles on the floor above.
-    if (BuildingFloor *floorAbove = floor->floorAbove()) {
-        if (object->affectsFloorAbove())
-            pendingLayoutToSquares.insert(floorAbove);
-    }
-
-    schedulePending();
-
     mShadowBuilding->objectAboutToBeRemoved(object);
+    takeShadowChanges();
 }
 
 void BuildingMap::objectRemoved(BuildingObject *object)
@@ -748,36 +714,14 @@ void BuildingMap::objectRemoved(BuildingObject *object)
 
 void BuildingMap::objectMoved(BuildingObject *object)
 {
-    BuildingFloor *floor = object->floor();
-    pendingLayoutToSquares.insert(floor);
-
-    // Stairs affect the floor tiles on the floor above.
-    // Roofs sometimes affect the floor tiles on the floor above.
-    if (BuildingFloor *floorAbove = floor->floorAbove()) {
-        if (object->affectsFloorAbove())
-            pendingLayoutToSquares.insert(floorAbove);
-    }
-
-    schedulePending();
-
     mShadowBuilding->objectMoved(object);
+    takeShadowChanges();
 }
 
 void BuildingMap::objectTileChanged(BuildingObject *object)
 {
-    BuildingFloor *floor = object->floor();
-    pendingLayoutToSquares.insert(floor);
-
-    // Stairs affect the floor tiles on the floor above.
-    // Roofs sometimes affect the floor tiles on the floor above.
-    if (BuildingFloor *floorAbove = floor->floorAbove()) {
-        if (object->affectsFloorAbove())
-            pendingLayoutToSquares.insert(floorAbove);
-    }
-
-    schedulePending();
-
     mShadowBuilding->objectTileChanged(object);
+    takeShadowChanges();
 }
 
 void BuildingMap::roomAdded(Room *room)
@@ -849,6 +793,76 @@ void BuildingMap::tilesetRemoved(Tileset *tileset)
 
 // FIXME: tilesetChanged?
 
+void BuildingMap::roomsChanged(BuildingFloor *floor)
+{
+    BuildingFloor *shadowFloor = mShadowBuilding->floor(floor->level());
+    QRect changed = floor->roomChangesSinceLayout() | shadowFloor->roomChangesSinceLayout();
+    if (changed.isEmpty())
+        return;
+    pendingLayoutToSquares[floor] |= changed.adjusted(-LAYOUT_MARGIN, -LAYOUT_MARGIN,
+                                                      LAYOUT_MARGIN, LAYOUT_MARGIN);
+    schedulePending();
+}
+
+void BuildingMap::roomsDragged(BuildingFloor *floor, const QRegion &changed)
+{
+    if (changed.isEmpty())
+        return;
+    for (const QRect &r : changed)
+        pendingLayoutToSquares[floor] |= r.adjusted(-LAYOUT_MARGIN, -LAYOUT_MARGIN,
+                                                    LAYOUT_MARGIN, LAYOUT_MARGIN);
+    pendingSquaresToTileLayers[floor] |= changed;
+    foreach (QString layerName, floor->grimeLayers())
+        pendingUserTilesToLayer[floor][layerName] |= changed;
+    schedulePending();
+}
+
+void BuildingMap::takeShadowChanges()
+{
+    QMap<int,QRegion> changed = mShadowBuilding->takeChangedAreas();
+    foreach (int level, changed.keys()) {
+        if (BuildingFloor *floor = mBuilding->floor(level))
+            pendingLayoutToSquares[floor] |= changed[level];
+    }
+    if (!changed.isEmpty())
+        schedulePending();
+}
+
+// Each floor only looks at its own squares and the objects on the floor below,
+// so the floors can be laid out at the same time.  Only the work is parallel:
+// the app thread blocks until every floor is done, laying out floors itself
+// rather than sitting idle, so the UI still waits on a big edit.  Nothing else
+// can touch the building meanwhile, which is also why a batch is never
+// cancelled; a newer edit only starts once this one is in the tile layers.
+// Copying the squares into the tile layers afterwards stays on the app thread,
+// since the layers share the map's tileset references and draw margins.
+void BuildingMap::layoutFloors(const QList<BuildingLayoutJobs::Job> &jobs)
+{
+    int area = 0;
+    foreach (const BuildingLayoutJobs::Job &job, jobs) {
+        for (const QRect &r : job.rgn)
+            area += r.width() * r.height();
+    }
+
+    if (jobs.size() < 2 || area < PARALLEL_LAYOUT_AREA
+            || BuildingLayoutJobs::instance()->threadCount() == 0) {
+        foreach (const BuildingLayoutJobs::Job &job, jobs) {
+            for (const QRect &r : job.rgn)
+                job.floor->LayoutToSquares(r); // not sure this belongs in this class
+        }
+        return;
+    }
+
+    // The workers don't (re)read newtiledefinitions.tiles themselves.
+    getTileDefWatcher()->check();
+
+    BuildingLayoutJobs::Batch batch;
+    batch.jobs = jobs;
+    batch.next = 0;
+    batch.unfinished = jobs.size();
+    BuildingLayoutJobs::instance()->run(&batch);
+}
+
 void BuildingMap::handlePending()
 {
     QMap<int,QRegion> updatedLevels;
@@ -861,10 +875,14 @@ void BuildingMap::handlePending()
     }
 
     if (pendingRecreateAll || pendingBuildingResized) {
-        QList<BuildingFloor*> floors = mBuilding->floors();
-        pendingLayoutToSquares = QSet<BuildingFloor*>(floors.begin(), floors.end());
+        pendingLayoutToSquares.clear();
         pendingUserTilesToLayer.clear();
         foreach (BuildingFloor *floor, mBuilding->floors()) {
+            // BuildingToMap() already laid out every floor.
+            if (pendingRecreateAll)
+                updatedLevels[floor->level()] |= floor->bounds(1, 1);
+            else
+                pendingLayoutToSquares[floor] = floor->bounds(1, 1);
             foreach (QString layerName, floor->grimeLayers()) {
                 pendingUserTilesToLayer[floor][layerName] = floor->bounds(1, 1);
             }
@@ -899,26 +917,35 @@ void BuildingMap::handlePending()
     }
 
     if (!pendingLayoutToSquares.isEmpty()) {
-        foreach (BuildingFloor *floor, pendingLayoutToSquares) {
-            floor->LayoutToSquares(); // not sure this belongs in this class
-            pendingSquaresToTileLayers[floor] = floor->bounds(1, 1);
-
-            mShadowBuilding->floor(floor->level())->LayoutToSquares();
+        QList<BuildingLayoutJobs::Job> jobs;
+        foreach (BuildingFloor *floor, mBuilding->floors()) {
+            if (!pendingLayoutToSquares.contains(floor))
+                continue;
+            QRegion rgn = pendingLayoutToSquares[floor] & floor->bounds(1, 1);
+            if (rgn.rectCount() > MAX_LAYOUT_RECTS)
+                rgn = rgn.boundingRect();
+            BuildingLayoutJobs::Job job = { floor, rgn };
+            jobs += job;
+            job.floor = mShadowBuilding->floor(floor->level());
+            jobs += job;
+            pendingSquaresToTileLayers[floor] |= rgn;
         }
+        layoutFloors(jobs);
     }
 
     if (!pendingSquaresToTileLayers.isEmpty()) {
         foreach (BuildingFloor *floor, pendingSquaresToTileLayers.keys()) {
             CompositeLayerGroup *layerGroup = mBlendMapComposite->layerGroupForLevel(floor->level());
-            QRect area = pendingSquaresToTileLayers[floor].boundingRect(); // TODO: only affected region
-            BuildingSquaresToTileLayers(floor, area, layerGroup);
+            QRegion rgn = pendingSquaresToTileLayers[floor];
+            for (const QRect &r : rgn)
+                BuildingSquaresToTileLayers(floor, r, layerGroup);
             if (layerGroup->needsSynch()) {
                 mMapComposite->layerGroupForLevel(floor->level())->setNeedsSynch(true);
                 layerGroup->synch(); // Don't really need to synch the blend-over-map, but do need
                                      // to update its draw margins so MapComposite::regionAltered
                                      // doesn't set mNeedsSynch repeatedly.
             }
-            updatedLevels[floor->level()] |= area;
+            updatedLevels[floor->level()] |= rgn;
         }
     }
 
@@ -990,6 +1017,16 @@ public:
         mObject = object;
         mShadowObject = mShadowBuilding->cloneObject(shadowFloor, object);
         shadowFloor->insertObject(shadowFloor->objectCount(), mShadowObject);
+        mShadowBuilding->shadowObjectChanged(mShadowObject);
+    }
+
+    void setPos(const QPoint &pos)
+    {
+        if (pos == mShadowObject->pos())
+            return;
+        mShadowBuilding->shadowObjectChanged(mShadowObject);
+        mShadowObject->setPos(pos);
+        mShadowBuilding->shadowObjectChanged(mShadowObject);
     }
 
     ~AddObjectModifier()
@@ -1045,58 +1082,103 @@ public:
     void setOffset(const QPoint &offset)
     {
         BuildingObject *shadowObject = mShadowBuilding->shadowObject(mObject);
-        shadowObject->setPos(mObject->pos() + offset);
+        QPoint pos = mObject->pos() + offset;
+        if (pos == shadowObject->pos())
+            return;
+        mShadowBuilding->shadowObjectChanged(shadowObject);
+        shadowObject->setPos(pos);
+        mShadowBuilding->shadowObjectChanged(shadowObject);
     }
 
     BuildingObject *mObject;
 };
 
-class ChangeFloorGridModifier : public BuildingModifier
+// Previews SelectMoveRoomsTool dragging rooms and user tiles.  Only the
+// squares under the selection and its offset copy differ from the real floor.
+class DragRoomsModifier : public BuildingModifier
 {
 public:
-    ChangeFloorGridModifier(ShadowBuilding *sb, BuildingFloor *floor) :
+    DragRoomsModifier(ShadowBuilding *sb, BuildingFloor *floor) :
         BuildingModifier(sb),
         mFloor(floor)
     {
     }
 
-    ~ChangeFloorGridModifier()
+    ~DragRoomsModifier()
     {
-        BuildingFloor *shadowFloor = mShadowBuilding->floor(mFloor->level());
-        shadowFloor->setGrid(mFloor->grid());
+        restore();
     }
 
-    void setGrid(const QVector<QVector<Room*> > &grid)
+    // Returns the squares that changed since the previous call.
+    QRegion setDrag(const QRegion &selection, const QPoint &offset)
     {
-        BuildingFloor *shadowFloor = mShadowBuilding->floor(mFloor->level());
-        shadowFloor->setGrid(grid);
-    }
+        QRegion changed = restore();
 
-    BuildingFloor *mFloor;
-};
+        BuildingFloor *shadowFloor = mShadowBuilding->floor(mFloor->level());
+        if (!shadowFloor)
+            return changed;
+
+        QRect bounds = mFloor->bounds(1, 1);
+        QRegion src = selection & bounds;
+        QStringList layerNames = mFloor->grimeLayers();
+
+        // Erase the area being moved.
+        for (QRect r : src) {
+            r &= mFloor->bounds();
+            for (int x = r.left(); x <= r.right(); x++)
+                for (int y = r.top(); y <= r.bottom(); y++)
+                    shadowFloor->SetRoomAt(x, y, 0);
+        }
+        foreach (QString layerName, layerNames)
+            shadowFloor->setGrime(layerName, src, QString());
+
+        // Copy the moved area to its new location.
+        for (const QRect &r : src) {
+            for (int x = r.left(); x <= r.right(); x++) {
+                for (int y = r.top(); y <= r.bottom(); y++) {
+                    QPoint p = QPoint(x, y) + offset;
+                    if (!bounds.contains(p))
+                        continue;
+                    if (mFloor->contains(p.x(), p.y()))
+                        shadowFloor->SetRoomAt(p.x(), p.y(), mFloor->GetRoomAt(x, y));
+                    foreach (QString layerName, layerNames)
+                        shadowFloor->setGrimeId(layerName, p.x(), p.y(),
+                                                mFloor->grimeIdAt(layerName, x, y));
+                }
+            }
+        }
 
-class ChangeUserTilesModifier : public BuildingModifier
-{
-public:
-    ChangeUserTilesModifier(ShadowBuilding *sb, BuildingFloor *floor) :
-        BuildingModifier(sb),
-        mFloor(floor)
-    {
+        mDirty = src | (src.translated(offset) & bounds);
+        return changed | mDirty;
     }
 
-    ~ChangeUserTilesModifier()
+    // Copies the real floor back over the squares changed by setDrag().
+    QRegion restore()
     {
-        BuildingFloor *shadowFloor = mShadowBuilding->floor(mFloor->level());
-        qDeleteAll(shadowFloor->setGrime(mFloor->grimeClone()));
-    }
+        QRegion changed = mDirty;
+        mDirty = QRegion();
 
-    void setTiles(const QMap<QString,FloorTileGrid*> &tiles)
-    {
         BuildingFloor *shadowFloor = mShadowBuilding->floor(mFloor->level());
-        qDeleteAll(shadowFloor->setGrime(tiles));
+        if (!shadowFloor)
+            return changed;
+
+        QStringList layerNames = shadowFloor->grimeLayers();
+        for (const QRect &r : changed) {
+            for (int x = r.left(); x <= r.right(); x++) {
+                for (int y = r.top(); y <= r.bottom(); y++) {
+                    if (mFloor->contains(x, y))
+                        shadowFloor->SetRoomAt(x, y, mFloor->GetRoomAt(x, y));
+                    foreach (QString layerName, layerNames)
+                        shadowFloor->setGrimeId(layerName, x, y,
+                                                mFloor->grimeIdAt(layerName, x, y));
+                }
+            }
+        }
+        return changed;
     }
 
     BuildingFloor *mFloor;
+    QRegion mDirty;
 };
 
 ShadowBuilding::ShadowBuilding(const Building *building) :
@@ -1107,11 +1189,9 @@ ShadowBuilding::ShadowBuilding(const Building *building) :
     mShadowBuilding->setTiles(mBuilding->tiles());
     foreach (Room *room, mBuilding->rooms())
         mShadowBuilding->insertRoom(mShadowBuilding->roomCount(), room);
-    foreach (BuildingFloor *floor, mBuilding->floors()) {
-        BuildingFloor *f = cloneFloor(floor);
-        f->LayoutToSquares();
-    }
-
+    // BuildingMap lays out the floors.
+    foreach (BuildingFloor *floor, mBuilding->floors())
+        cloneFloor(floor);
 }
 
 ShadowBuilding::~ShadowBuilding()
@@ -1196,10 +1276,13 @@ void ShadowBuilding::objectAdded(BuildingObject *object)
         BuildingObject *shadowObject = mOriginalToShadowObject[object];
         shadowFloor->removeObject(shadowObject->index());
         shadowFloor->insertObject(object->index(), shadowObject);
+        shadowObjectChanged(shadowObject);
         return;
     }
 
-    shadowFloor->insertObject(object->index(), cloneObject(shadowFloor, object));
+    BuildingObject *shadowObject = cloneObject(shadowFloor, object);
+    shadowFloor->insertObject(object->index(), shadowObject);
+    shadowObjectChanged(shadowObject);
 }
 
 void ShadowBuilding::objectAboutToBeRemoved(BuildingObject *object)
@@ -1215,6 +1298,7 @@ void ShadowBuilding::objectAboutToBeRemoved(BuildingObject *object)
 
     if (mOriginalToShadowObject.contains(object)) {
         BuildingObject *shadowObject = mOriginalToShadowObject[object];
+        shadowObjectChanged(shadowObject);
         shadowObject->floor()->removeObject(shadowObject->index());
         delete shadowObject;
         mOriginalToShadowObject.remove(object);
@@ -1275,6 +1359,7 @@ void ShadowBuilding::recreateObject(BuildingFloor *originalFloor, BuildingObject
         BuildingObject *shadowObject = mOriginalToShadowObject[object];
         int index = shadowObject->index();
         BuildingFloor *shadowFloor = shadowObject->floor();
+        shadowObjectChanged(shadowObject);
         shadowFloor->removeObject(index);
         delete shadowObject;
         mOriginalToShadowObject.remove(object);
@@ -1282,9 +1367,43 @@ void ShadowBuilding::recreateObject(BuildingFloor *originalFloor, BuildingObject
         shadowFloor = mShadowBuilding->floor(originalFloor->level());
         shadowObject = cloneObject(shadowFloor, object);
         shadowFloor->insertObject(index, shadowObject);
+        shadowObjectChanged(shadowObject);
     }
 }
 
+// Remember which squares must be laid out again because a shadow object was
+// added, removed or changed.  Called both before and after the change.
+void ShadowBuilding::shadowObjectChanged(BuildingObject *shadowObject)
+{
+    BuildingFloor *shadowFloor = shadowObject->floor();
+    if (!shadowFloor)
+        return;
+
+    // Roof tiles may be placed some distance from the object.
+    int margin = LAYOUT_MARGIN;
+    foreach (BuildingTileEntry *entry, shadowObject->tiles()) {
+        if (!entry)
+            continue;
+        foreach (const QPoint &offset, entry->mOffsets)
+            margin = qMax(margin, LAYOUT_MARGIN + qMax(qAbs(offset.x()), qAbs(offset.y())));
+    }
+
+    QRect r = shadowObject->bounds().adjusted(-margin, -margin, margin, margin);
+    mChangedAreas[shadowFloor->level()] |= r;
+
+    // Stairs affect the floor tiles on the floor above.
+    // Roofs sometimes affect the floor tiles on the floor above.
+    if (shadowObject->affectsFloorAbove())
+        mChangedAreas[shadowFloor->level() + 1] |= r;
+}
+
+QMap<int,QRegion> ShadowBuilding::takeChangedAreas()
+{
+    QMap<int,QRegion> changed = mChangedAreas;
+    mChangedAreas.clear();
+    return changed;
+}
+
 void ShadowBuilding::addModifier(BuildingModifier *modifier)
 {
     mModifiers += modifier;
@@ -1337,13 +1456,13 @@ void ShadowBuilding::dragObject(BuildingFloor *floor, BuildingObject *object, co
         foreach (BuildingModifier *bmod, mModifiers) {
             if (AddObjectModifier *mod = dynamic_cast<AddObjectModifier*>(bmod)) {
                 if (mod->mObject == object) {
-                    mod->mShadowObject->setPos(object->pos() + offset);
+                    mod->setPos(object->pos() + offset);
                     return;
                 }
             }
         }
         AddObjectModifier *mod = new AddObjectModifier(this, floor, object);
-        mod->mShadowObject->setPos(object->pos() + offset);
+        mod->setPos(object->pos() + offset);
         return;
     }
 
@@ -1378,56 +1497,137 @@ void ShadowBuilding::resetDrag(BuildingObject *object)
     }
 }
 
-void ShadowBuilding::changeFloorGrid(BuildingFloor *floor, const QVector<QVector<Room*> > &grid)
+QRegion ShadowBuilding::dragRooms(BuildingFloor *floor, const QRegion &selection,
+                                  const QPoint &offset)
 {
     foreach (BuildingModifier *bmod, mModifiers) {
-        if (ChangeFloorGridModifier *mod = dynamic_cast<ChangeFloorGridModifier*>(bmod)) {
-            if (mod->mFloor == floor) {
-                mod->setGrid(grid);
-                return;
-            }
+        if (DragRoomsModifier *mod = dynamic_cast<DragRoomsModifier*>(bmod)) {
+            if (mod->mFloor == floor)
+                return mod->setDrag(selection, offset);
         }
     }
 
-    ChangeFloorGridModifier *mod = new ChangeFloorGridModifier(this, floor);
-    mod->setGrid(grid);
+    DragRoomsModifier *mod = new DragRoomsModifier(this, floor);
+    return mod->setDrag(selection, offset);
 }
 
-void ShadowBuilding::resetFloorGrid(BuildingFloor *floor)
+QRegion ShadowBuilding::resetDragRooms(BuildingFloor *floor)
 {
     foreach (BuildingModifier *bmod, mModifiers) {
-        if (ChangeFloorGridModifier *mod = dynamic_cast<ChangeFloorGridModifier*>(bmod)) {
+        if (DragRoomsModifier *mod = dynamic_cast<DragRoomsModifier*>(bmod)) {
             if (mod->mFloor == floor) {
+                QRegion changed = mod->restore();
                 delete mod;
-                return;
+                return changed;
             }
         }
     }
+    return QRegion();
 }
 
-void ShadowBuilding::changeUserTiles(BuildingFloor *floor, const QMap<QString,FloorTileGrid*> &tiles)
+/////
+
+BuildingLayoutJobs *BuildingLayoutJobs::mInstance = nullptr;
+
+BuildingLayoutJobs *BuildingLayoutJobs::instance()
 {
-    foreach (BuildingModifier *bmod, mModifiers) {
-        if (ChangeUserTilesModifier *mod = dynamic_cast<ChangeUserTilesModifier*>(bmod)) {
-            if (mod->mFloor == floor) {
-                mod->setTiles(tiles);
-                return;
-            }
-        }
+    if (!mInstance)
+        mInstance = new BuildingLayoutJobs;
+    return mInstance;
+}
+
+void BuildingLayoutJobs::deleteInstance()
+{
+    delete mInstance;
+    mInstance = nullptr;
+}
+
+BuildingLayoutJobs::BuildingLayoutJobs()
+{
+    // The thread calling run() does its share, so one less thread is needed.
+    int threads = qMin(QThread::idealThreadCount() - 1, MAX_LAYOUT_THREADS);
+    for (int i = 0; i < threads; i++) {
+        InterruptibleThread *thread = new InterruptibleThread;
+        BuildingLayoutWorker *worker = new BuildingLayoutWorker(thread, this);
+        worker->moveToThread(thread);
+        thread->start();
+        mThreads += thread;
+        mWorkers += worker;
+    }
+}
+
+BuildingLayoutJobs::~BuildingLayoutJobs()
+{
+    for (int i = 0; i < mThreads.size(); i++) {
+        mThreads[i]->interrupt();
+        mThreads[i]->quit();
+        mThreads[i]->wait();
+        delete mWorkers[i];
+        delete mThreads[i];
     }
+}
+
+void BuildingLayoutJobs::run(Batch *batch)
+{
+    QMutexLocker locker(&mMutex);
+    mBatches += batch;
+    foreach (BaseWorker *worker, mWorkers)
+        QMetaObject::invokeMethod(worker, "jobsAdded", Qt::QueuedConnection);
+    locker.unlock();
+
+    work(batch, nullptr);
 
-    ChangeUserTilesModifier *mod = new ChangeUserTilesModifier(this, floor);
-    mod->setTiles(tiles);
+    locker.relock();
+    while (batch->unfinished > 0)
+        mFinished.wait(&mMutex);
 }
 
-void ShadowBuilding::resetUserTiles(BuildingFloor *floor)
+// Lays out floors of the given batch, or of any batch if it is null, until
+// there are none left to start.
+void BuildingLayoutJobs::work(Batch *batch, BaseWorker *worker)
 {
-    foreach (BuildingModifier *bmod, mModifiers) {
-        if (ChangeUserTilesModifier *mod = dynamic_cast<ChangeUserTilesModifier*>(bmod)) {
-            if (mod->mFloor == floor) {
-                delete mod;
-                return;
-            }
+    QMutexLocker locker(&mMutex);
+    forever {
+        Batch *b = batch;
+        if (b == nullptr) {
+            if (mBatches.isEmpty())
+                break;
+            b = mBatches.first();
+        }
+        if (b->next == b->jobs.size())
+            break;
+        const Job job = b->jobs.at(b->next++);
+        if (b->next == b->jobs.size())
+            mBatches.removeOne(b);
+        locker.unlock();
+
+        if (worker == nullptr || !worker->aborted()) {
+            for (const QRect &r : job.rgn)
+                job.floor->LayoutToSquares(r);
         }
+
+        locker.relock();
+        // Always count the job, the owner of the batch is waiting for all of them.
+        if (--b->unfinished == 0)
+            mFinished.wakeAll();
     }
 }
+
+BuildingLayoutWorker::BuildingLayoutWorker(InterruptibleThread *thread,
+                                           BuildingLayoutJobs *jobs) :
+    BaseWorker(thread),
+    mJobs(jobs)
+{
+}
+
+void BuildingLayoutWorker::work()
+{
+    IN_WORKER_THREAD
+
+    mJobs->work(nullptr, this);
+}
+
+void BuildingLayoutWorker::jobsAdded()
+{
+    scheduleWork();
+}
@@ -20,10 +20,13 @@
 
 #include <QObject>
 
+#include "threads.h"
+
 #include <QMap>
 #include <QRegion>
 #include <QSet>
 #include <QStringList>
+#include <QVector>
 
 class CompositeLayerGroup;
 class MapComposite;
@@ -91,11 +94,8 @@ public:
     void dragObject(BuildingFloor *floor, BuildingObject *object, const QPoint &offset);
     void resetDrag(BuildingObject *object);
 
-    void changeFloorGrid(BuildingFloor *floor, const QVector<QVector<Room *> > &grid);
-    void resetFloorGrid(BuildingFloor *floor);
-
-    void changeUserTiles(BuildingFloor *floor, const QMap<QString,FloorTileGrid*> &tiles);
-    void resetUserTiles(BuildingFloor *floor);
+    QRegion dragRooms(BuildingFloor *floor, const QRegion &selection, const QPoint &offset);
+    QRegion resetDragRooms(BuildingFloor *floor);
     /////
 
     BuildingFloor *cloneFloor(BuildingFloor *floor);
@@ -105,12 +105,71 @@ public:
     void addModifier(BuildingModifier *modifier);
     void removeModifier(BuildingModifier *modifier);
 
+    void shadowObjectChanged(BuildingObject *shadowObject);
+    QMap<int,QRegion> takeChangedAreas();
+
 private:
     const Building *mBuilding;
     Building *mShadowBuilding;
     QList<BuildingModifier*> mModifiers;
     BuildingModifier *mCursorObjectModifier;
     QMap<BuildingObject*,BuildingObject*> mOriginalToShadowObject;
+    QMap<int,QRegion> mChangedAreas; // level -> squares affected by shadow objects
+};
+
+// Floors waiting to be laid out.  One set of BuildingLayoutWorkers is shared
+// by every BuildingMap.  The thread that calls run() lays out floors of its own
+// batch too, and waits on mFinished until the workers are done with the rest.
+class BuildingLayoutJobs
+{
+public:
+    struct Job
+    {
+        BuildingFloor *floor;
+        QRegion rgn;
+    };
+
+    struct Batch
+    {
+        QList<Job> jobs;
+        int next;
+        int unfinished;
+    };
+
+    static BuildingLayoutJobs *instance();
+    static void deleteInstance();
+
+    int threadCount() const
+    { return mThreads.size(); }
+
+    void run(Batch *batch);
+    void work(Batch *batch, BaseWorker *worker);
+
+private:
+    BuildingLayoutJobs();
+    ~BuildingLayoutJobs();
+
+    static BuildingLayoutJobs *mInstance;
+
+    QMutex mMutex;
+    QWaitCondition mFinished;
+    QList<Batch*> mBatches;
+    QVector<InterruptibleThread*> mThreads;
+    QVector<BaseWorker*> mWorkers;
+};
+
+class BuildingLayoutWorker : public BaseWorker
+{
+    Q_OBJECT
+public:
+    BuildingLayoutWorker(InterruptibleThread *thread, BuildingLayoutJobs *jobs);
+
+public slots:
+    void work();
+    void jobsAdded();
+
+private:
+    BuildingLayoutJobs *mJobs;
 };
 
 class BuildingMap : public QObject
@@ -141,11 +200,8 @@ public:
     void dragObject(BuildingFloor *floor, BuildingObject *object, const QPoint &offset);
     void resetDrag(BuildingFloor *floor, BuildingObject *object);
 
-    void changeFloorGrid(BuildingFloor *floor, const QVector<QVector<Room*> > &grid);
-    void resetFloorGrid(BuildingFloor *floor);
-
-    void changeUserTiles(BuildingFloor *floor, const QMap<QString,FloorTileGrid*> &tiles);
-    void resetUserTiles(BuildingFloor *floor);
+    void dragRooms(BuildingFloor *floor, const QRegion &selection, const QPoint &offset);
+    void resetDragRooms(BuildingFloor *floor);
 
     void suppressTiles(BuildingFloor *floor, const QRegion &rgn);
     /////
@@ -168,6 +224,7 @@ public:
     void floorAdded(BuildingFloor *floor);
     void floorRemoved(BuildingFloor *floor);
     void floorEdited(BuildingFloor *floor);
+    void floorGridChanged(BuildingFloor *floor);
 
     void floorTilesChanged(BuildingFloor *floor);
     void floorTilesChanged(BuildingFloor *floor, const QString &layerName,
@@ -205,6 +262,12 @@ private:
     void userTilesToLayer(BuildingFloor *floor, const QString &layerName,
                           const QRect &bounds);
 
+    void roomsChanged(BuildingFloor *floor);
+    void roomsDragged(BuildingFloor *floor, const QRegion &changed);
+    void takeShadowChanges();
+
+    void layoutFloors(const QList<BuildingLayoutJobs::Job> &jobs);
+
     inline void schedulePending()
     {
         if (!pending) {
@@ -222,14 +285,13 @@ private:
     Tiled::MapRenderer *mMapRenderer;
     QMap<QString,int> mLayerToSection;
 
-    BuildingFloor *mCursorObjectFloor;
     ShadowBuilding *mShadowBuilding;
     QMap<BuildingFloor*,QRegion> mSuppressTiles;
 
     bool pending;
     bool pendingRecreateAll;
     bool pendingBuildingResized;
-    QSet<BuildingFloor*> pendingLayoutToSquares; // LayoutToSquares
+    QMap<BuildingFloor*,QRegion> pendingLayoutToSquares; // LayoutToSquares
     QMap<BuildingFloor*,QRegion> pendingSquaresToTileLayers; // BuildingSquaresToTileLayers
     QSet<BuildingFloor*> pendingEraseUserTiles; // TileLayer::erase on all user-tile layers
     QMap<BuildingFloor*,QMap<QString,QRegion> > pendingUserTilesToLayer; // floorTilesToLayer
@@ -65,6 +65,12 @@ QSet<BuildingTile*> BuildingObject::buildingTiles() const
     return ret;
 }
 
+void BuildingObject::boundsChanged()
+{
+    if (mFloor)
+        mFloor->objectMoved(this);
+}
+
 bool BuildingObject::isValidPos(const QPoint &offset, BuildingFloor *floor) const
 {
     if (!floor)
@@ -479,6 +485,7 @@ void FurnitureObject::setFurnitureTile(FurnitureTile *tile)
     }
 #endif
     mFurnitureTile = tile;
+    boundsChanged();
 }
 
 bool FurnitureObject::inWallLayer() const
@@ -889,6 +896,7 @@ void RoofObject::setWidth(int width)
     default:
         break;
     }
+    boundsChanged();
 }
 
 void RoofObject::setHeight(int height)
@@ -1007,6 +1015,7 @@ void RoofObject::setHeight(int height)
     default:
         break;
     }
+    boundsChanged();
 }
 
 void RoofObject::resize(int width, int height, bool halfDepth)
@@ -64,7 +64,7 @@ public:
     { return QRect(mX, mY, 1, 1); }
 
     void setPos(int x, int y)
-    { mX = x, mY = y; }
+    { mX = x, mY = y; boundsChanged(); }
 
     void setPos(const QPoint &pos)
     { setPos(pos.x(), pos.y()); }
@@ -76,7 +76,7 @@ public:
     int y() const { return mY; }
 
     void setDir(Direction dir)
-    { mDir = dir; }
+    { mDir = dir; boundsChanged(); }
 
     Direction dir() const
     { return mDir; }
@@ -133,6 +133,8 @@ public:
     virtual WallObject *asWall() { return 0; }
 
 protected:
+    void boundsChanged();
+
     BuildingFloor *mFloor;
     int mX;
     int mY;
@@ -259,7 +261,7 @@ public:
     WallObject *asWall() { return this; }
 
     void setLength(int length)
-    { mLength = length; }
+    { mLength = length; boundsChanged(); }
 
     int length() const
     { return mLength; }
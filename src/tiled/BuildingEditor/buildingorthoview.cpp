@@ -645,16 +645,37 @@ void GraphicsFloorItem::paint(QPainter *painter,
 {
     painter->setPen(Qt::NoPen);
 
+    // Only look at the tiles under the exposed area.
+    const QRectF &exposed = option->exposedRect;
+    int level = mFloor->level();
+    QPolygon corners;
+    corners << mEditor->sceneToTile(exposed.topLeft(), level)
+            << mEditor->sceneToTile(exposed.topRight(), level)
+            << mEditor->sceneToTile(exposed.bottomRight(), level)
+            << mEditor->sceneToTile(exposed.bottomLeft(), level);
+    QRect visible = corners.boundingRect().adjusted(-1, -1, 1, 1) & mFloor->bounds();
+    if (visible.isEmpty())
+        return;
+
+    // Draw each run of same-coloured tiles in a row as one polygon.
     QImage *bmp = mDragBmp ? mDragBmp : mBmp;
-    for (int x = 0; x < mFloor->width(); x++) {
-        for (int y = 0; y < mFloor->height(); y++) {
-            QRgb c = bmp->pixel(x, y);
-            if (c == qRgb(0, 0, 0))
+    const QRgb black = qRgb(0, 0, 0);
+    QRgb brushColor = black;
+    for (int y = visible.top(); y <= visible.bottom(); y++) {
+        const QRgb *row = reinterpret_cast<const QRgb*>(bmp->constScanLine(y));
+        int x = visible.left();
+        while (x <= visible.right()) {
+            QRgb c = row[x];
+            int start = x;
+            while (x <= visible.right() && row[x] == c)
+                ++x;
+            if (c == black)
                 continue;
-            painter->setBrush(QColor(c));
-            QPolygonF polygon = mEditor->tileToScenePolygon(QPoint(x, y), mFloor->level());
-            if (option->exposedRect.intersects(polygon.boundingRect()))
-                painter->drawConvexPolygon(polygon);
+            if (c != brushColor) {
+                painter->setBrush(QColor(c));
+                brushColor = c;
+            }
+            painter->drawConvexPolygon(mEditor->tileToScenePolygon(QRect(start, y, x - start, 1), level));
         }
     }
 }
@@ -734,7 +755,7 @@ void GraphicsFloorItem::roomAtPositionChanged(const QPoint &pos)
 {
     Room *room = mFloor->GetRoomAt(pos);
     mBmp->setPixel(pos, room ? room->Color : qRgb(0, 0, 0));
-    update(); // FIXME: only affected area
+    update(mEditor->tileToScenePolygon(pos, mFloor->level()).boundingRect());
 }
 
 void GraphicsFloorItem::setDragBmp(QImage *bmp)
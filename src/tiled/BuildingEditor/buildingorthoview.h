@@ -468,15 +468,10 @@ public:
     { Q_UNUSED(floor) Q_UNUSED(object) Q_UNUSED(offset) }
     virtual void resetDrag(BuildingFloor *floor, BuildingObject *object)
     { Q_UNUSED(floor) Q_UNUSED(object) }
-    virtual void changeFloorGrid(BuildingFloor *floor,
-                                 const QVector<QVector<Room*> > &grid)
-    { Q_UNUSED(floor) Q_UNUSED(grid) }
-    virtual void resetFloorGrid(BuildingFloor *floor)
-    { Q_UNUSED(floor) }
-    virtual void changeUserTiles(BuildingFloor *floor,
-                                 const QMap<QString,FloorTileGrid*> &tiles)
-    { Q_UNUSED(floor) Q_UNUSED(tiles) }
-    virtual void resetUserTiles(BuildingFloor *floor)
+    virtual void dragRooms(BuildingFloor *floor, const QRegion &selection,
+                           const QPoint &offset)
+    { Q_UNUSED(floor) Q_UNUSED(selection) Q_UNUSED(offset) }
+    virtual void resetDragRooms(BuildingFloor *floor)
     { Q_UNUSED(floor) }
 
     virtual void setEditingTiles(bool editing);
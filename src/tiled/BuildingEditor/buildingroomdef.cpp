@@ -27,17 +27,8 @@ BuildingRoomDefecator::BuildingRoomDefecator(BuildingFloor *floor, Room *room) :
     mFloor(floor),
     mRoom(room)
 {
-    for (int y = 0; y < floor->height(); y++) {
-        for (int x = 0; x < floor->width(); x++) {
-            int wid = 0;
-            while (floor->GetRoomAt(x + wid, y) == room)
-                wid++;
-            if (wid > 0) {
-                mRoomRegion += QRect(x, y, wid, 1);
-                x += wid;
-            }
-        }
-    }
+    foreach (const QRect &r, floor->roomRegion(room))
+        mRoomRegion += r;
 
     initWallObjects();
 }
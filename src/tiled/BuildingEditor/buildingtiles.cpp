@@ -59,7 +59,8 @@ BuildingTilesMgr::BuildingTilesMgr() :
     mNoneTiledTile(0),
     mNoneBuildingTile(0),
     mNoneCategory(0),
-    mNoneTileEntry(0)
+    mNoneTileEntry(0),
+    mTileCacheGeneration(0)
 {
     mCatCurtains = new BTC_Curtains(QLatin1String("Curtains"));
     mCatDoors = new BTC_Doors(QLatin1String("Doors"));
@@ -130,6 +131,16 @@ BuildingTilesMgr::BuildingTilesMgr() :
             this, &BuildingTilesMgr::tilesetAboutToBeRemoved);
     connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetRemoved,
              this, &BuildingTilesMgr::tilesetRemoved);
+
+    // Any of these may change which Tiled::Tile a tile name resolves to.
+    connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetAdded,
+            this, &BuildingTilesMgr::invalidateTileCache);
+    connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetAboutToBeRemoved,
+            this, &BuildingTilesMgr::invalidateTileCache);
+    connect(TileMetaInfoMgr::instance(), &TileMetaInfoMgr::tilesetRemoved,
+            this, &BuildingTilesMgr::invalidateTileCache);
+    connect(TilesetManager::instance(), &TilesetManager::tilesetChanged,
+            this, &BuildingTilesMgr::invalidateTileCache);
 }
 
 BuildingTilesMgr::~BuildingTilesMgr()
@@ -627,27 +638,50 @@ bool BuildingTilesMgr::mergeTxt()
 
 Tiled::Tile *BuildingTilesMgr::tileFor(const QString &tileName)
 {
+    QHash<QString,Tiled::Tile*>::const_iterator it = mTiledTileByName.constFind(tileName);
+    if (it != mTiledTileByName.constEnd())
+        return it.value();
+
+    Tiled::Tile *result = mMissingTile;
     QString tilesetName;
     int index;
     parseTileName(tileName, tilesetName, index);
     Tileset *tileset = TileMetaInfoMgr::instance()->tileset(tilesetName);
-    if (!tileset)
-        return mMissingTile;
-    if (index >= tileset->tileCount())
-        return mMissingTile;
-    return tileset->tileAt(index);
+    if (tileset && index < tileset->tileCount())
+        result = tileset->tileAt(index);
+    mTiledTileByName.insert(tileName, result);
+    return result;
 }
 
 Tile *BuildingTilesMgr::tileFor(BuildingTile *tile, int offset)
 {
     if (tile->isNone())
         return mNoneTiledTile;
+    if (offset == 0 && tile->mTiledTileGeneration == mTileCacheGeneration)
+        return tile->mTiledTile;
+
+    Tile *result;
     Tileset *tileset = TileMetaInfoMgr::instance()->tileset(tile->mTilesetName);
     if (!tileset)
-        return mMissingTile;
-    if (tile->mIndex + offset >= tileset->tileCount())
-        return tileset->isMissing() ? tileset->tileAt(0) : mMissingTile;
-    return tileset->tileAt(tile->mIndex + offset);
+        result = mMissingTile;
+    else if (tile->mIndex + offset >= tileset->tileCount())
+        result = tileset->isMissing() ? tileset->tileAt(0) : mMissingTile;
+    else
+        result = tileset->tileAt(tile->mIndex + offset);
+
+    if (offset == 0) {
+        tile->mTiledTile = result;
+        tile->mTiledTileGeneration = mTileCacheGeneration;
+    }
+    return result;
+}
+
+void BuildingTilesMgr::invalidateTileCache()
+{
+    // BuildingTiles check their cached Tiled::Tile against the generation, so
+    // there is no need to visit every one of them here.
+    ++mTileCacheGeneration;
+    mTiledTileByName.clear();
 }
 
 BuildingTile *BuildingTilesMgr::fromTiledTile(Tile *tile)
@@ -18,6 +18,7 @@
 #ifndef BUILDINGTILES_H
 #define BUILDINGTILES_H
 
+#include <QHash>
 #include <QImage>
 #include <QMap>
 #include <QObject>
@@ -40,7 +41,9 @@ class BuildingTile
 public:
     BuildingTile(const QString &tilesetName, int index) :
         mTilesetName(tilesetName),
-        mIndex(index)
+        mIndex(index),
+        mTiledTile(0),
+        mTiledTileGeneration(-1)
     {}
     virtual ~BuildingTile() {}
 
@@ -51,6 +54,11 @@ public:
 
     QString mTilesetName;
     int mIndex;
+
+    // Cached result of BuildingTilesMgr::tileFor(), valid while
+    // mTiledTileGeneration matches BuildingTilesMgr's tile-cache generation.
+    Tiled::Tile *mTiledTile;
+    int mTiledTileGeneration;
 };
 
 class NoneBuildingTile : public BuildingTile
@@ -792,6 +800,9 @@ private:
     bool upgradeTxt();
     bool mergeTxt();
 
+private slots:
+    void invalidateTileCache();
+
 signals:
     void tilesetAdded(Tiled::Tileset *tileset);
     void tilesetAboutToBeRemoved(Tiled::Tileset *tileset);
@@ -808,6 +819,10 @@ private:
     QList<BuildingTile*> mTiles;
     QMap<QString,BuildingTile*> mTileByName;
 
+    // Bumped whenever a tileset is added, removed or reloaded.
+    int mTileCacheGeneration;
+    QHash<QString,Tiled::Tile*> mTiledTileByName;
+
     Tiled::Tile *mMissingTile;
     Tiled::Tile *mNoneTiledTile;
     BuildingTile *mNoneBuildingTile;
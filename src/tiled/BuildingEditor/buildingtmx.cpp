@@ -27,6 +27,7 @@
 
 #include "mapcomposite.h"
 #include "mapmanager.h"
+#include "newmapbinaryfile.h"
 #include "preferences.h"
 #include "tilemetainfomgr.h"
 #include "tilesetmanager.h"
@@ -178,6 +179,36 @@ bool BuildingTMX::exportTMX(Building *building, const QString &fileName)
 #endif // WORLDED
 }
 
+bool BuildingTMX::exportNewBinary(Building *building, const QString &fileName)
+{
+#ifdef WORLDED
+    Q_UNUSED(building)
+    Q_UNUSED(fileName)
+    return false;
+#else
+    BuildingMap bmap(building);
+
+    Map *map = bmap.mergedMap();
+
+    foreach (BuildingFloor *floor, building->floors())
+        bmap.addRoomDefObjects(map, floor);
+
+    MapInfo *mapInfo = MapManager::instance()->newFromMap(map);
+    bool ok;
+    {
+        MapComposite mapComposite(mapInfo);
+        NewMapBinaryFile file;
+        ok = file.write(&mapComposite, fileName);
+        if (!ok)
+            mError = file.errorString();
+    }
+    delete mapInfo;
+    TilesetManager::instance()->removeReferences(map->tilesets());
+    delete map;
+    return ok;
+#endif // WORLDED
+}
+
 QString BuildingTMX::txtName()
 {
     return QLatin1String(TXT_FILE);
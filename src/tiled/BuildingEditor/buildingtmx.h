@@ -44,6 +44,7 @@ public:
 
     QStringList tileLayerNamesForLevel(int level);
     bool exportTMX(Building *building, const QString &fileName);
+    bool exportNewBinary(Building *building, const QString &fileName);
 
     QString txtName();
     QString txtPath();
@@ -639,6 +639,9 @@ void SelectMoveRoomsTool::startMoving()
 {
     mMode = Moving;
     mDragOffset = QPoint();
+    mDragDirty.clear();
+    mFloorDragOffset.clear();
+    mObjectDragOffset.clear();
 
     foreach (BuildingFloor *floor, mEditor->building()->floors()) {
         GraphicsFloorItem *item = mEditor->itemForFloor(floor);
@@ -654,66 +657,96 @@ void SelectMoveRoomsTool::updateMovingItems()
 
     foreach (BuildingFloor *floor, mEditor->building()->floors()) {
         GraphicsFloorItem *floorItem = mEditor->itemForFloor(floor);
-        QImage *bmp = floorItem->bmp();
-        QImage *dragBmp = floorItem->dragBmp();
 
-        QVector<QVector<Room*> > dragGrid = floor->grid();
-        QMap<QString,FloorTileGrid*> dragTiles = floor->grimeClone();
+        bool moveThisFloor = (floor == this->floor()) || allFloors;
+        bool wasMoving = mFloorDragOffset.contains(floor);
 
-        *dragBmp = *bmp;
+        if (moveThisFloor && (!wasMoving || mFloorDragOffset[floor] != mDragOffset)) {
+            QImage *bmp = floorItem->bmp();
+            QImage *dragBmp = floorItem->dragBmp();
 
-        bool moveThisFloor = (floor == this->floor()) || allFloors;
-        if (moveThisFloor) {
+            // Only the squares under the selection and under its moved copy differ
+            // from the floor, so restore the previous ones and redo the new ones.
+            QRegion oldDirty = mDragDirty.take(floor);
+            QRect floorBounds = floor->bounds();
+            for (const QRect &r : oldDirty) {
+                for (int x = r.left(); x <= r.right(); x++)
+                    for (int y = r.top(); y <= r.bottom(); y++)
+                        dragBmp->setPixel(x, y, bmp->pixel(x, y));
+            }
+
+            QRegion src = selectedArea() & floorBounds;
 
             // Erase the area being moved.
-            QRect floorBounds = floor->bounds();
-            for (QRect r : selectedArea()) {
-                r &= floorBounds;
+            for (const QRect &r : src) {
                 for (int x = r.left(); x <= r.right(); x++)
-                    for (int y = r.top(); y <= r.bottom(); y++) {
+                    for (int y = r.top(); y <= r.bottom(); y++)
                         dragBmp->setPixel(x, y, qRgb(0,0,0));
-                        dragGrid[x][y] = 0;
-                        foreach (QString layerName, dragTiles.keys())
-                            dragTiles[layerName]->replace(x, y, QString());
-                    }
             }
 
             // Copy the moved area to its new location.
-            for (QRect src : selectedArea()) {
-                src &= floorBounds;
-                for (int x = src.left(); x <= src.right(); x++) {
-                    for (int y = src.top(); y <= src.bottom(); y++) {
+            for (const QRect &r : src) {
+                for (int x = r.left(); x <= r.right(); x++) {
+                    for (int y = r.top(); y <= r.bottom(); y++) {
                         QPoint p = QPoint(x, y) + mDragOffset;
-                        if (floorBounds.contains(p)) {
+                        if (floorBounds.contains(p))
                             dragBmp->setPixel(p, bmp->pixel(x, y));
-                            dragGrid[p.x()][p.y()] = floor->GetRoomAt(x, y);
-                            foreach (QString layerName, dragTiles.keys())
-                                dragTiles[layerName]->replace(p.x(), p.y(), floor->grimeAt(layerName, x, y));
-                        }
                     }
                 }
             }
 
-            mEditor->changeFloorGrid(floor, dragGrid);
-            mEditor->changeUserTiles(floor, dragTiles);
+            QRegion newDirty = src | (src.translated(mDragOffset) & floorBounds);
+            mDragDirty[floor] = newDirty;
+            mFloorDragOffset[floor] = mDragOffset;
+            mEditor->dragRooms(floor, selectedArea(), mDragOffset);
+            updateFloorItem(floorItem, oldDirty | newDirty);
+        } else if (!moveThisFloor && wasMoving) {
+            QImage *bmp = floorItem->bmp();
+            QImage *dragBmp = floorItem->dragBmp();
+            QRegion oldDirty = mDragDirty.take(floor);
+            for (const QRect &r : oldDirty) {
+                for (int x = r.left(); x <= r.right(); x++)
+                    for (int y = r.top(); y <= r.bottom(); y++)
+                        dragBmp->setPixel(x, y, bmp->pixel(x, y));
+            }
+            mFloorDragOffset.remove(floor);
+            mEditor->resetDragRooms(floor);
+            updateFloorItem(floorItem, oldDirty);
         }
 
-        floorItem->update();
-
-        // Update objects
+        // Update objects.  Only those that start or stop moving, or whose
+        // offset changed, touch the shadow building.
         foreach (BuildingObject *object, floor->objects()) {
-            GraphicsObjectItem *objectItem = floorItem->itemForObject(object);
             bool moveThisObject = moveThisFloor && objectsToo &&
                     selectedArea().intersects(object->bounds());
-            objectItem->setDragOffset(mDragOffset);
-            objectItem->setDragging(moveThisObject);
-            mEditor->dragObject(floor, object, moveThisObject ? mDragOffset : QPoint());
+            QMap<BuildingObject*,QPoint>::iterator it = mObjectDragOffset.find(object);
+            bool wasDragged = (it != mObjectDragOffset.end());
+            if (moveThisObject) {
+                if (wasDragged && it.value() == mDragOffset)
+                    continue;
+                GraphicsObjectItem *objectItem = floorItem->itemForObject(object);
+                objectItem->setDragOffset(mDragOffset);
+                objectItem->setDragging(true);
+                mEditor->dragObject(floor, object, mDragOffset);
+                mObjectDragOffset[object] = mDragOffset;
+            } else if (wasDragged) {
+                floorItem->itemForObject(object)->setDragging(false);
+                mEditor->resetDrag(floor, object);
+                mObjectDragOffset.erase(it);
+            }
         }
     }
 
     mEditor->roomSelectionItem()->setDragOffset(mDragOffset);
 }
 
+void SelectMoveRoomsTool::updateFloorItem(GraphicsFloorItem *item, const QRegion &tiles)
+{
+    int level = item->floor()->level();
+    for (const QRect &r : tiles)
+        item->update(mEditor->tileToScenePolygon(r, level).boundingRect());
+}
+
 void SelectMoveRoomsTool::finishMoving(const QPointF &pos)
 {
     Q_UNUSED(pos)
@@ -728,14 +761,17 @@ void SelectMoveRoomsTool::finishMoving(const QPointF &pos)
         GraphicsFloorItem *item = mEditor->itemForFloor(floor);
         delete item->dragBmp();
         item->setDragBmp(0);
-        mEditor->resetFloorGrid(floor);
-        mEditor->resetUserTiles(floor);
+        mEditor->resetDragRooms(floor);
         foreach (BuildingObject *object, floor->objects()) {
             item->itemForObject(object)->setDragging(false);
             mEditor->resetDrag(floor, object);
         }
     }
 
+    mDragDirty.clear();
+    mFloorDragOffset.clear();
+    mObjectDragOffset.clear();
+
     if (mDragOffset.isNull()) // Move is a no-op
         return;
 
@@ -763,14 +799,17 @@ void SelectMoveRoomsTool::cancelMoving()
         GraphicsFloorItem *item = mEditor->itemForFloor(floor);
         delete item->dragBmp();
         item->setDragBmp(0);
-        mEditor->resetFloorGrid(floor);
-        mEditor->resetUserTiles(floor);
+        mEditor->resetDragRooms(floor);
         foreach (BuildingObject *object, floor->objects()) {
             item->itemForObject(object)->setDragging(false);
             mEditor->resetDrag(floor, object);
         }
     }
 
+    mDragDirty.clear();
+    mFloorDragOffset.clear();
+    mObjectDragOffset.clear();
+
     mEditor->roomSelectionItem()->setDragOffset(QPoint());
 
     mMode = CancelMoving;
@@ -814,7 +853,7 @@ void SelectMoveRoomsTool::finishMovingFloor(BuildingFloor *floor, bool objectsTo
         for (int x = src.left(); x <= src.right(); x++) {
             for (int y = src.top(); y <= src.bottom(); y++) {
                 foreach (FloorTileGrid *stg, grime.values())
-                    stg->replace(x, y, QString());
+                    stg->replaceId(x, y, 0);
             }
         }
     }
@@ -826,7 +865,7 @@ void SelectMoveRoomsTool::finishMovingFloor(BuildingFloor *floor, bool objectsTo
                 QPoint p = QPoint(x, y) + mDragOffset;
                 if (floorBounds.contains(p)) {
                     foreach (QString key, grime.keys())
-                        grime[key]->replace(p.x(), p.y(), floor->grimeAt(key, x, y));
+                        grime[key]->replaceId(p.x(), p.y(), floor->grimeIdAt(key, x, y));
                 }
             }
         }
@@ -21,6 +21,7 @@
 #include "buildingobjects.h" // need RoofType enum
 
 #include <QGraphicsItem>
+#include <QMap>
 #include <QObject>
 #include <QPointF>
 #include <QRegion>
@@ -39,11 +40,13 @@ namespace BuildingEditor {
 
 class BuildingDocument;
 class BuildingFloor;
+class BuildingObject;
 class BuildingRegionItem;
 class BuildingTile;
 class Door;
 class BuildingBaseScene;
 class FurnitureTile;
+class GraphicsFloorItem;
 class GraphicsObjectItem;
 class GraphicsRoofItem;
 class GraphicsRoofCornerItem;
@@ -243,6 +246,7 @@ private:
 
     void startMoving();
     void updateMovingItems();
+    void updateFloorItem(GraphicsFloorItem *item, const QRegion &tiles);
     void finishMoving(const QPointF &pos);
     void cancelMoving();
 
@@ -261,6 +265,9 @@ private:
     QPointF mStartScenePos;
     QPoint mStartTilePos;
     QPoint mDragOffset;
+    QMap<BuildingFloor*,QRegion> mDragDirty;
+    QMap<BuildingFloor*,QPoint> mFloorDragOffset;
+    QMap<BuildingObject*,QPoint> mObjectDragOffset;
     BuildingRegionItem *mCursorItem;
     QPoint mCursorTilePos;
     QRect mCursorTileBounds;
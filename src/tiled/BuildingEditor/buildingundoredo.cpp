@@ -23,9 +23,30 @@
 #include "buildingtemplates.h"
 
 #include <QCoreApplication>
+#include <QUndoStack>
 
 using namespace BuildingEditor;
 
+qint64 BuildingEditor::undoCommandMemory(const QUndoCommand *cmd)
+{
+    qint64 bytes = 0;
+    if (const UndoMemoryUsage *usage = dynamic_cast<const UndoMemoryUsage*>(cmd))
+        bytes += usage->memoryUsage();
+    for (int i = 0; i < cmd->childCount(); i++)
+        bytes += undoCommandMemory(cmd->child(i));
+    return bytes;
+}
+
+qint64 BuildingEditor::undoStackMemory(const QUndoStack *undoStack)
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < undoStack->count(); i++)
+        bytes += undoCommandMemory(undoStack->command(i));
+    return bytes;
+}
+
+/////
+
 ChangeRoomAtPosition::ChangeRoomAtPosition(BuildingDocument *doc, BuildingFloor *floor,
                                            const QPoint &pos, Room *room) :
     QUndoCommand(QCoreApplication::translate("Undo Commands", "Change Room At Position")),
@@ -33,10 +54,7 @@ ChangeRoomAtPosition::ChangeRoomAtPosition(BuildingDocument *doc, BuildingFloor
     mFloor(floor),
     mMergeable(false)
 {
-    Changed changed;
-    changed.mPosition = pos;
-    changed.mRoom = room;
-    mChanged += changed;
+    mChanged.add(pos.x(), pos.y(), room);
 }
 
 bool ChangeRoomAtPosition::mergeWith(const QUndoCommand *other)
@@ -46,16 +64,11 @@ bool ChangeRoomAtPosition::mergeWith(const QUndoCommand *other)
             o->mMergeable))
         return false;
 
-    foreach (Changed changedOther, o->mChanged) {
-        bool ignore = false;
-        foreach (Changed changedSelf, mChanged) {
-            if (changedSelf.mPosition == changedOther.mPosition) {
-                ignore = true;
-                break;
-            }
+    foreach (const CellRuns<Room*>::Run &run, o->mChanged.runs()) {
+        for (int x = run.x; x < run.x + run.length; x++) {
+            if (!mChanged.contains(x, run.y))
+                mChanged.add(x, run.y, run.value);
         }
-        if (!ignore)
-            mChanged += changedOther;
     }
 
     return true;
@@ -63,15 +76,16 @@ bool ChangeRoomAtPosition::mergeWith(const QUndoCommand *other)
 
 void ChangeRoomAtPosition::swap()
 {
-    QVector<Changed> old;
+    CellRuns<Room*> old;
 
-    foreach (Changed changed, mChanged) {
-        Changed changed2;
-        changed2.mRoom = mDocument->changeRoomAtPosition(mFloor, changed.mPosition, changed.mRoom);
-        changed2.mPosition = changed.mPosition;
-        old += changed2;
+    foreach (const CellRuns<Room*>::Run &run, mChanged.runs()) {
+        for (int x = run.x; x < run.x + run.length; x++) {
+            Room *room = mDocument->changeRoomAtPosition(mFloor, QPoint(x, run.y), run.value);
+            old.add(x, run.y, room);
+        }
     }
 
+    old.squeeze();
     mChanged = old;
 }
 
@@ -305,14 +319,50 @@ SwapFloorGrid::SwapFloorGrid(BuildingDocument *doc, BuildingFloor *floor,
                              const char *undoText) :
     QUndoCommand(QCoreApplication::translate("Undo Commands", undoText)),
     mDocument(doc),
-    mFloor(floor),
-    mGrid(grid)
+    mFloor(floor)
 {
+    bool sameSize = (grid.size() == floor->width());
+    for (int x = 0; sameSize && x < grid.size(); x++)
+        sameSize = (grid[x].size() == floor->height());
+    if (!sameSize) {
+        mGrid = grid;
+        return;
+    }
+
+    for (int y = 0; y < floor->height(); y++) {
+        for (int x = 0; x < floor->width(); x++) {
+            if (grid[x][y] != floor->GetRoomAt(x, y))
+                mChanged.add(x, y, grid[x][y]);
+        }
+    }
+    mChanged.squeeze();
+}
+
+qint64 SwapFloorGrid::memoryUsage() const
+{
+    qint64 bytes = mChanged.memoryUsage();
+    foreach (const QVector<Room*> &column, mGrid)
+        bytes += column.capacity() * sizeof(Room*);
+    return bytes;
 }
 
 void SwapFloorGrid::swap()
 {
-    mGrid = mDocument->swapFloorGrid(mFloor, mGrid);
+    if (!mGrid.isEmpty()) {
+        mGrid = mDocument->swapFloorGrid(mFloor, mGrid);
+        return;
+    }
+
+    CellRuns<Room*> old;
+    foreach (const CellRuns<Room*>::Run &run, mChanged.runs()) {
+        for (int x = run.x; x < run.x + run.length; x++) {
+            old.add(x, run.y, mFloor->GetRoomAt(x, run.y));
+            mFloor->SetRoomAt(x, run.y, run.value);
+        }
+    }
+    old.squeeze();
+    mChanged = old;
+    mDocument->emitFloorEdited(mFloor);
 }
 
 /////
@@ -323,9 +373,39 @@ SwapFloorGrime::SwapFloorGrime(BuildingDocument *doc, BuildingFloor *floor,
     QUndoCommand(QCoreApplication::translate("Undo Commands", undoText)),
     mDocument(doc),
     mFloor(floor),
-    mGrid(grid),
     mEmitSignal(emitSignal)
 {
+    int width = floor->width() + 1, height = floor->height() + 1;
+    foreach (FloorTileGrid *tiles, grid) {
+        if (tiles->width() != width || tiles->height() != height) {
+            mGrid = grid;
+            return;
+        }
+    }
+
+    QStringList layerNames = floor->grimeLayers();
+    foreach (QString layerName, grid.keys()) {
+        if (!layerNames.contains(layerName))
+            layerNames += layerName;
+    }
+
+    foreach (QString layerName, layerNames) {
+        FloorTileGrid *tiles = grid.value(layerName);
+        CellRuns<uint> changed;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint tileId = tiles ? tiles->idAt(x, y) : 0;
+                if (tileId != floor->grimeIdAt(layerName, x, y))
+                    changed.add(x, y, tileId);
+            }
+        }
+        if (!changed.isEmpty()) {
+            changed.squeeze();
+            mChanged[layerName] = changed;
+        }
+    }
+
+    qDeleteAll(grid);
 }
 
 SwapFloorGrime::~SwapFloorGrime()
@@ -333,9 +413,50 @@ SwapFloorGrime::~SwapFloorGrime()
     qDeleteAll(mGrid.values());
 }
 
+qint64 SwapFloorGrime::memoryUsage() const
+{
+    qint64 bytes = 0;
+    foreach (const CellRuns<uint> &changed, mChanged)
+        bytes += changed.memoryUsage();
+    foreach (FloorTileGrid *tiles, mGrid)
+        bytes += tiles->size() * sizeof(uint);
+    return bytes;
+}
+
 void SwapFloorGrime::swap()
 {
-    mGrid = mDocument->swapFloorTiles(mFloor, mGrid, mEmitSignal);
+    if (!mGrid.isEmpty()) {
+        mGrid = mDocument->swapFloorTiles(mFloor, mGrid, mEmitSignal);
+        return;
+    }
+
+    foreach (QString layerName, mChanged.keys()) {
+        CellRuns<uint> old;
+        foreach (const CellRuns<uint>::Run &run, mChanged[layerName].runs()) {
+            for (int x = run.x; x < run.x + run.length; x++) {
+                old.add(x, run.y, mFloor->grimeIdAt(layerName, x, run.y));
+                mFloor->setGrimeId(layerName, x, run.y, run.value);
+            }
+        }
+        old.squeeze();
+        mChanged[layerName] = old;
+    }
+
+    // Drop the layers left empty, like swapping in a whole map did.  Flipping
+    // and rotating the building expect there to be no grime of the old size.
+    QMap<QString,FloorTileGrid*> grime = mFloor->grime();
+    bool removed = false;
+    foreach (QString layerName, mChanged.keys()) {
+        if (grime.contains(layerName) && grime[layerName]->isEmpty()) {
+            delete grime.take(layerName);
+            removed = true;
+        }
+    }
+    if (removed)
+        mFloor->setGrime(grime);
+
+    if (mEmitSignal) // The signal should not be emitted when flipping/resizing/rotating.
+        mDocument->emitFloorTilesChanged(mFloor);
 }
 
 /////
@@ -23,9 +23,12 @@
 #include <QMap>
 #include <QRectF>
 #include <QRegion>
+#include <QSet>
 #include <QUndoCommand>
 #include <QVector>
 
+class QUndoStack;
+
 namespace BuildingEditor {
 
 class Building;
@@ -44,6 +47,80 @@ class Room;
 class WallObject;
 class Window;
 
+// Cells of a grid changed by an undo command, run-length encoded along rows.
+// The commands below keep these instead of copies of whole grids.
+template<typename T>
+class CellRuns
+{
+public:
+    struct Run
+    {
+        int x, y;
+        int length;
+        T value;
+    };
+
+    void add(int x, int y, const T &value)
+    {
+        if (!mIndex.isEmpty())
+            mIndex.insert(key(x, y));
+        if (!mRuns.isEmpty()) {
+            Run &last = mRuns.last();
+            if (last.y == y && last.x + last.length == x && last.value == value) {
+                ++last.length;
+                return;
+            }
+        }
+        Run run = { x, y, 1, value };
+        mRuns += run;
+    }
+
+    // The index is built on first use, which is while merging commands.
+    bool contains(int x, int y) const
+    {
+        if (mIndex.isEmpty()) {
+            foreach (const Run &run, mRuns) {
+                for (int i = 0; i < run.length; i++)
+                    mIndex.insert(key(run.x + i, run.y));
+            }
+        }
+        return mIndex.contains(key(x, y));
+    }
+
+    bool isEmpty() const
+    { return mRuns.isEmpty(); }
+
+    const QVector<Run> &runs() const
+    { return mRuns; }
+
+    void squeeze()
+    {
+        mRuns.squeeze();
+        mIndex.clear();
+    }
+
+    qint64 memoryUsage() const
+    { return mRuns.capacity() * sizeof(Run) + mIndex.capacity() * sizeof(quint64); }
+
+private:
+    static quint64 key(int x, int y)
+    { return (quint64(uint(y)) << 32) | uint(x); }
+
+    QVector<Run> mRuns;
+    mutable QSet<quint64> mIndex;
+};
+
+// Implemented by commands that hold enough data to be worth reporting.
+class UndoMemoryUsage
+{
+public:
+    virtual ~UndoMemoryUsage() {}
+    virtual qint64 memoryUsage() const = 0;
+};
+
+qint64 undoCommandMemory(const QUndoCommand *cmd);
+qint64 undoStackMemory(const QUndoStack *undoStack);
+
 enum {
     UndoCmd_PaintRoom = 1000,
     UndoCmd_EraseRoom = 1001,
@@ -53,7 +130,7 @@ enum {
     UndoCmd_ChangeObjectTile = 1005
 };
 
-class ChangeRoomAtPosition : public QUndoCommand
+class ChangeRoomAtPosition : public QUndoCommand, public UndoMemoryUsage
 {
 public:
     ChangeRoomAtPosition(BuildingDocument *doc, BuildingFloor *floor,
@@ -67,17 +144,15 @@ public:
     void setMergeable(bool mergeable)
     { mMergeable = mergeable; }
 
+    qint64 memoryUsage() const
+    { return mChanged.memoryUsage(); }
+
 private:
     void swap();
 
     BuildingDocument *mDocument;
     BuildingFloor *mFloor;
-    class Changed {
-    public:
-        QPoint mPosition;
-        Room *mRoom;
-    };
-    QVector<Changed> mChanged;
+    CellRuns<Room*> mChanged;
     bool mMergeable;
 };
 
@@ -281,7 +356,7 @@ private:
     Room *mData;
 };
 
-class SwapFloorGrid : public QUndoCommand
+class SwapFloorGrid : public QUndoCommand, public UndoMemoryUsage
 {
 public:
     SwapFloorGrid(BuildingDocument *doc, BuildingFloor *floor,
@@ -290,15 +365,18 @@ public:
     void undo() { swap(); }
     void redo() { swap(); }
 
+    qint64 memoryUsage() const;
+
 private:
     void swap();
 
     BuildingDocument *mDocument;
     BuildingFloor *mFloor;
-    QVector<QVector<Room*> > mGrid;
+    CellRuns<Room*> mChanged;
+    QVector<QVector<Room*> > mGrid; // only if the size differs from the floor's
 };
 
-class SwapFloorGrime : public QUndoCommand
+class SwapFloorGrime : public QUndoCommand, public UndoMemoryUsage
 {
 public:
     SwapFloorGrime(BuildingDocument *doc, BuildingFloor *floor,
@@ -310,12 +388,15 @@ public:
     void undo() { swap(); }
     void redo() { swap(); }
 
+    qint64 memoryUsage() const;
+
 private:
     void swap();
 
     BuildingDocument *mDocument;
     BuildingFloor *mFloor;
-    QMap<QString,FloorTileGrid*> mGrid;
+    QMap<QString,CellRuns<uint> > mChanged;
+    QMap<QString,FloorTileGrid*> mGrid; // only if the size differs from the floor's
     bool mEmitSignal;
 };
 
@@ -28,6 +28,7 @@
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QSet>
 #include <QTemporaryFile>
 #include <QXmlStreamWriter>
 
@@ -254,20 +255,27 @@ public:
 
     void writeUserTiles(QXmlStreamWriter &w)
     {
+        mUserTileIndex.clear();
+
+        QSet<uint> tileIds;
         foreach (BuildingFloor *floor, mBuilding->floors()) {
             foreach (QString layerName, floor->grimeLayers()) {
                 for (int x = 0; x <= floor->width(); x++) {
                     for (int y = 0; y <= floor->height(); y++) {
-                        QString tileName = floor->grimeAt(layerName, x, y);
-                        if (!tileName.isEmpty() && !mUserTilesMap.contains(tileName))
-                            mUserTilesMap[tileName] = tileName;
+                        if (uint tileId = floor->grimeIdAt(layerName, x, y))
+                            tileIds.insert(tileId);
                     }
                 }
             }
         }
 
+        QMap<QString,uint> sorted;
+        foreach (uint tileId, tileIds)
+            sorted[TileNameTable::name(tileId)] = tileId;
+
         w.writeStartElement(QLatin1String("user_tiles"));
-        foreach (QString tileName, mUserTilesMap.values()) { // sorted
+        foreach (QString tileName, sorted.keys()) {
+            mUserTileIndex[sorted[tileName]] = mUserTileIndex.size() + 1;
             w.writeStartElement(QLatin1String("tile"));
             w.writeAttribute(QLatin1String("tile"), tileName);
             w.writeEndElement(); // </tile>
@@ -313,11 +321,11 @@ public:
             count = 0, max = (floor->height() + 1) * (floor->width() + 1);
             for (int y = 0; y <= floor->height(); y++) {
                 for (int x = 0; x <= floor->width(); x++) {
-                    QString tileName = floor->grimeAt(layerName, x, y);
-                    if (tileName.isEmpty())
+                    uint tileId = floor->grimeIdAt(layerName, x, y);
+                    if (!tileId)
                         text += zero;
                     else
-                        text += QString::number(mUserTilesMap.values().indexOf(tileName) + 1);
+                        text += QString::number(mUserTileIndex[tileId]);
                     if (++count < max)
                         text += comma;
                 }
@@ -470,7 +478,7 @@ public:
     QList<FurnitureTiles*> mFurnitureTiles;
     QList<BuildingTileEntry*> mTileEntries;
     QMap<QString,BuildingTileEntry*> mEntriesByCategoryName;
-    QMap<QString,QString> mUserTilesMap;
+    QHash<uint,int> mUserTileIndex; // TileNameTable ID -> index in <user_tiles>
 };
 
 /////
@@ -5,16 +5,20 @@
 #include "buildingdocumentmgr.h"
 #include "buildingtemplates.h"
 #include "buildingtools.h"
+#include "buildingundoredo.h"
 
 #include <QAction>
 #include <QComboBox>
 #include <QLabel>
+#include <QLocale>
+#include <QUndoStack>
 #include <QVBoxLayout>
 
 using namespace BuildingEditor;
 
 EditModeStatusBar::EditModeStatusBar(const QString &prefix, QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    mDocument(0)
 {
     setObjectName(prefix + QLatin1String("object"));
 
@@ -33,12 +37,19 @@ EditModeStatusBar::EditModeStatusBar(const QString &prefix, QObject *parent) :
     spacer = new QSpacerItem(40, 20, QSizePolicy::Expanding, QSizePolicy::Minimum);
     statusBarLayout->addItem(spacer);
 
+    undoMemoryLabel = new QLabel();
+    undoMemoryLabel->setObjectName(prefix + QLatin1String("undoMemoryLabel"));
+    undoMemoryLabel->setToolTip(tr("Memory used by the undo history"));
+    statusBarLayout->addWidget(undoMemoryLabel);
+
     editorScaleComboBox = new QComboBox();
     editorScaleComboBox->setObjectName(prefix + QLatin1String("editorScaleComboBox"));
     statusBarLayout->addWidget(editorScaleComboBox);
 
     connect(BuildingDocumentMgr::instance(), &BuildingDocumentMgr::currentDocumentChanged,
             this, &EditModeStatusBar::resizeCoordsLabel);
+    connect(BuildingDocumentMgr::instance(), &BuildingDocumentMgr::currentDocumentChanged,
+            this, &EditModeStatusBar::currentDocumentChanged);
     connect(ToolManager::instance(), &ToolManager::statusTextChanged,
             this, &EditModeStatusBar::updateToolStatusText);
     connect(ToolManager::instance(), &ToolManager::currentToolChanged,
@@ -76,3 +87,23 @@ void EditModeStatusBar::updateToolStatusText()
         statusLabel->clear();
     }
 }
+
+void EditModeStatusBar::currentDocumentChanged(BuildingDocument *doc)
+{
+    disconnect(mUndoStackConnection);
+    mDocument = doc;
+    if (mDocument)
+        mUndoStackConnection = connect(mDocument->undoStack(), &QUndoStack::indexChanged,
+                                       this, &EditModeStatusBar::updateUndoMemory);
+    updateUndoMemory();
+}
+
+void EditModeStatusBar::updateUndoMemory()
+{
+    if (mDocument) {
+        qint64 bytes = undoStackMemory(mDocument->undoStack());
+        undoMemoryLabel->setText(tr("Undo: %1").arg(QLocale().formattedDataSize(bytes)));
+    } else {
+        undoMemoryLabel->clear();
+    }
+}
@@ -13,6 +13,7 @@ class QComboBox;
 namespace BuildingEditor {
 
 class BaseTool;
+class BuildingDocument;
 
 class EditModeStatusBar : public QObject
 {
@@ -25,13 +26,20 @@ public slots:
     void mouseCoordinateChanged(const QPoint &tilePos);
     void updateToolStatusText();
     void resizeCoordsLabel();
+    void currentDocumentChanged(BuildingEditor::BuildingDocument *doc);
+    void updateUndoMemory();
 
 public:
     QHBoxLayout *statusBarLayout;
     QLabel *coordLabel;
     QSpacerItem *spacer;
     QLabel *statusLabel;
+    QLabel *undoMemoryLabel;
     QComboBox *editorScaleComboBox;
+
+private:
+    BuildingDocument *mDocument;
+    QMetaObject::Connection mUndoStackConnection;
 };
 
 }
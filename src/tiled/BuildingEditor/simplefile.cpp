@@ -21,6 +21,7 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QStringList>
+#include <QStringView>
 #include <QTemporaryFile>
 #include <QTextStream>
 
@@ -29,22 +30,63 @@ SimpleFile::SimpleFile() :
 {
 }
 
+// Returns the lines of a decoded file without copying them.
+class SimpleFile::LineReader
+{
+public:
+    LineReader(const QString &text) :
+        mText(text),
+        mPos(0)
+    {
+        if (mText.startsWith(QChar(0xFEFF)))
+            mPos = 1;
+    }
+
+    bool atEnd() const
+    { return mPos >= mText.size(); }
+
+    QStringView readLine()
+    {
+        int end = mText.indexOf(QLatin1Char('\n'), mPos);
+        if (end < 0)
+            end = mText.size();
+        int length = end - mPos;
+        if (length > 0 && mText.at(end - 1) == QLatin1Char('\r'))
+            --length;
+        QStringView line = QStringView(mText).mid(mPos, length);
+        mPos = end + 1;
+        return line;
+    }
+
+private:
+    const QString &mText;
+    int mPos;
+};
+
 bool SimpleFile::read(const QString &filePath)
 {
     values.clear();
     blocks.clear();
 
     QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!file.open(QIODevice::ReadOnly)) {
         mError = file.errorString();
         return false;
     }
 
-    QTextStream ts(&file);
+    // Decode the whole file at once rather than a line at a time.
+    QString text;
+    if (const uchar *data = file.map(0, file.size()))
+        text = QString::fromUtf8((const char *) data, int(file.size()));
+    else
+        text = QString::fromUtf8(file.readAll());
+    file.close();
+
+    LineReader in(text);
 
     int lineNumber = 0;
     bool ok;
-    SimpleFileBlock block = readBlock(ts, lineNumber, ok);
+    SimpleFileBlock block = readBlock(in, lineNumber, ok);
     if (!ok)
         return false;
     blocks = block.blocks;
@@ -124,23 +166,24 @@ static QString rtrim(QString str)
   return str;
 }
 
-SimpleFileBlock SimpleFile::readBlock(QTextStream &ts, int &lineNumber, bool &ok)
+SimpleFileBlock SimpleFile::readBlock(LineReader &in, int &lineNumber, bool &ok)
 {
     SimpleFileBlock block;
     block.lineNumber = lineNumber - 1; // approximate
     QString buf;
-    while (!ts.atEnd()) {
-        QString line = ts.readLine();
+    while (!in.atEnd()) {
+        QStringView line = in.readLine();
         ++lineNumber;
-        if (line.contains(QLatin1Char('='))) {
-            int n = line.indexOf(QLatin1Char('='));
+        int n = line.indexOf(QLatin1Char('='));
+        if (n >= 0) {
             SimpleFileKeyValue kv;
-            kv.name = line.left(n).trimmed();
-            kv.value = line.mid(n + 1).trimmed();
+            kv.name = line.left(n).trimmed().toString();
+            kv.value = line.mid(n + 1).trimmed().toString();
             kv.lineNumber = lineNumber;
             if (kv.value.startsWith(QLatin1Char('['))) {
-                while (!ts.atEnd() && !rtrim(kv.value).endsWith(QLatin1Char(']'))) {
-                    kv.value += ts.readLine();
+                while (!in.atEnd() && !rtrim(kv.value).endsWith(QLatin1Char(']'))) {
+                    QStringView more = in.readLine();
+                    kv.value.append(more.data(), int(more.size()));
                     ++lineNumber;
                 }
                 kv.value = kv.value.mid(1);
@@ -155,7 +198,7 @@ SimpleFileBlock SimpleFile::readBlock(QTextStream &ts, int &lineNumber, bool &ok
                 ok = false;
                 return block;
             }
-            SimpleFileBlock childBlock = readBlock(ts, lineNumber, ok);
+            SimpleFileBlock childBlock = readBlock(in, lineNumber, ok);
             if (!ok) return block;
             childBlock.name = buf;
             block.blocks += childBlock;
@@ -170,8 +213,10 @@ SimpleFileBlock SimpleFile::readBlock(QTextStream &ts, int &lineNumber, bool &ok
             }
             break;
         }
-        else
-            buf += line.trimmed();
+        else {
+            QStringView trimmed = line.trimmed();
+            buf.append(trimmed.data(), int(trimmed.size()));
+        }
     }
     ok = true;
     return block;
@@ -204,7 +249,10 @@ void SimpleFile::writeBlock(QTextStream &ts, const SimpleFileBlock &block)
 
 /////
 
-int SimpleFileBlock::findBlock(const QString &key) const
+// The QLatin1String overloads compare without converting the key to a
+// QString first.
+template<typename Key>
+static int findBlockByName(const QList<SimpleFileBlock> &blocks, Key key)
 {
     for (int i = 0; i < blocks.size(); i++) {
         if (blocks[i].name == key)
@@ -213,18 +261,39 @@ int SimpleFileBlock::findBlock(const QString &key) const
     return -1;
 }
 
+template<typename Key>
+static int findValueByName(const QList<SimpleFileKeyValue> &values, Key key)
+{
+    for (int i = 0; i < values.size(); i++) {
+        if (values[i].name == key)
+            return i;
+    }
+    return -1;
+}
+
+int SimpleFileBlock::findBlock(QLatin1String key) const
+{
+    return findBlockByName(blocks, key);
+}
+
+int SimpleFileBlock::findBlock(const QString &key) const
+{
+    return findBlockByName(blocks, key);
+}
+
 bool SimpleFileBlock::hasValue(const QString &key) const
 {
     return findValue(key) >= 0;
 }
 
+int SimpleFileBlock::findValue(QLatin1String key) const
+{
+    return findValueByName(values, key);
+}
+
 int SimpleFileBlock::findValue(const QString &key) const
 {
-    for (int i = 0; i < values.size(); i++) {
-        if (values[i].name == key)
-            return i;
-    }
-    return -1;
+    return findValueByName(values, key);
 }
 
 bool SimpleFileBlock::keyValue(const QString &name, SimpleFileKeyValue &kv)
@@ -241,13 +310,16 @@ bool SimpleFileBlock::keyValue(const QString &name, SimpleFileKeyValue &kv)
     return false;
 }
 
+QString SimpleFileBlock::value(QLatin1String key) const
+{
+    int i = findValueByName(values, key);
+    return (i >= 0) ? values[i].value : QString();
+}
+
 QString SimpleFileBlock::value(const QString &key) const
 {
-    for (const SimpleFileKeyValue& kv : values) {
-        if (kv.name == key)
-            return kv.value;
-    }
-    return QString();
+    int i = findValueByName(values, key);
+    return (i >= 0) ? values[i].value : QString();
 }
 
 void SimpleFileBlock::addValue(const QString &key, const QString &value)
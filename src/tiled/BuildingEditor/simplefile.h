@@ -74,12 +74,14 @@ public:
     QList<SimpleFileBlock> blocks;
     int lineNumber;
 
+    int findBlock(QLatin1String key) const;
     int findBlock(const QString &key) const;
 
     bool hasValue(const char *key) const
-    { return hasValue(QLatin1String(key)); }
+    { return findValue(QLatin1String(key)) >= 0; }
     bool hasValue(const QString &key) const;
 
+    int findValue(QLatin1String key) const;
     int findValue(const QString &key) const;
 
     bool keyValue(const char *name, SimpleFileKeyValue &kv)
@@ -89,6 +91,7 @@ public:
     QString value(const char *key) const
     { return value(QLatin1String(key)); }
 
+    QString value(QLatin1String key) const;
     QString value(const QString &key) const;
 
     void addValue(const char *key, const QString &value)
@@ -159,7 +162,8 @@ public:
     { return mVersion; }
 
 private:
-    SimpleFileBlock readBlock(QTextStream &ts, int &lineNumber, bool &ok);
+    class LineReader;
+    SimpleFileBlock readBlock(LineReader &in, int &lineNumber, bool &ok);
     void writeBlock(QTextStream &ts, const SimpleFileBlock &block);
 
     QString mError;
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2013, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tilenametable.h"
+
+using namespace BuildingEditor;
+
+TileNameTable::TileNameTable() :
+    mCount(1) // ID 0 is the empty name
+{
+    for (int i = 0; i < MaxChunks; i++)
+        mChunks[i].store(nullptr);
+}
+
+TileNameTable &TileNameTable::instance()
+{
+    static TileNameTable table;
+    return table;
+}
+
+uint TileNameTable::id(const QString &tileName)
+{
+    if (tileName.isEmpty())
+        return 0;
+
+    TileNameTable &table = instance();
+    {
+        QReadLocker locker(&table.mLock);
+        QHash<QString,uint>::const_iterator it = table.mIDs.constFind(tileName);
+        if (it != table.mIDs.constEnd())
+            return *it;
+    }
+
+    QWriteLocker locker(&table.mLock);
+    QHash<QString,uint>::const_iterator it = table.mIDs.constFind(tileName);
+    if (it != table.mIDs.constEnd())
+        return *it;
+
+    uint id = table.mCount;
+    uint chunk = id / ChunkSize;
+    Q_ASSERT(chunk < MaxChunks);
+    QString *names = table.mChunks[chunk].load();
+    if (!names) {
+        names = new QString[ChunkSize];
+        table.mChunks[chunk].storeRelease(names);
+    }
+    names[id % ChunkSize] = tileName;
+    table.mIDs.insert(tileName, id);
+    ++table.mCount;
+    return id;
+}
+
+const QString &TileNameTable::name(uint id)
+{
+    TileNameTable &table = instance();
+    if (id == 0)
+        return table.mEmptyName;
+    QString *names = table.mChunks[id / ChunkSize].loadAcquire();
+    Q_ASSERT(names);
+    return names[id % ChunkSize];
+}
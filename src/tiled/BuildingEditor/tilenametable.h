@@ -0,0 +1,60 @@
+/*
+ * Copyright 2013, Tim Baker <treectrl@users.sf.net>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILENAMETABLE_H
+#define TILENAMETABLE_H
+
+#include <QAtomicPointer>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+namespace BuildingEditor {
+
+/**
+  * Hands out a small integer for every distinct tile name, so grids of
+  * user-drawn tiles can store and compare those instead of strings.
+  * ID 0 is always the empty name.  IDs are never released.
+  *
+  * name() doesn't lock, so it can be called from the layout threads.
+  */
+class TileNameTable
+{
+public:
+    static uint id(const QString &tileName);
+    static const QString &name(uint id);
+
+private:
+    TileNameTable();
+
+    static TileNameTable &instance();
+
+    enum {
+        ChunkSize = 4096,
+        MaxChunks = 4096
+    };
+
+    QReadWriteLock mLock;
+    QHash<QString,uint> mIDs;
+    QAtomicPointer<QString> mChunks[MaxChunks];
+    uint mCount;
+    QString mEmptyName;
+};
+
+} // namespace BuildingEditor
+
+#endif // TILENAMETABLE_H
@@ -36,17 +36,24 @@
 #include <QImage>
 #include <QSet>
 #include <QTextStream>
+#include <QtAlgorithms>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
 
 static QString STR_0Floor = QLatin1String("0_Floor");
 
+// Regions are blended in square chunks of this size, on several threads when
+// there are enough of them.
+static const int BLEND_CHUNK_SIZE = 64;
+static const int PARALLEL_BLEND_AREA = 2 * BLEND_CHUNK_SIZE * BLEND_CHUNK_SIZE;
+
 BmpBlender::BmpBlender(QObject *parent) :
     QObject(parent),
     mMap(nullptr),
     mFakeTileGrid(nullptr),
     mInitTilesLater(true),
+    mFloorGridIndex(-1),
     mHack(false),
     mBlendEdgesEverywhere(false)
 {
@@ -57,6 +64,7 @@ BmpBlender::BmpBlender(Map *map, QObject *parent) :
     mMap(map),
     mFakeTileGrid(nullptr),
     mInitTilesLater(true),
+    mFloorGridIndex(-1),
     mHack(false),
     mBlendEdgesEverywhere(false)
 {
@@ -134,17 +142,10 @@ void BmpBlender::flush(const MapRenderer *renderer, const QRect &rect, const QPo
         mInitTilesLater = false;
     }
 
-    for (QRect r : dirty) {
-        int x1 = r.left(), x2 = r.right(), y1 = r.top(), y2 = r.bottom();
-        x1 -= 2;
-        x2 += 2;
-        y1 -= 2;
-        y2 += 2;
-
-        imagesToTileGrids(x1, y1, x2, y2);
-        addEdgeTiles(x1, y1, x2, y2);
-        tileGridsToLayers(x1, y1, x2, y2);
-    }
+    QRegion rgn;
+    for (QRect r : dirty)
+        rgn |= r.adjusted(-2, -2, 2, 2);
+    blendRegion(rgn);
 }
 
 void BmpBlender::flush(const QRect &rect)
@@ -159,15 +160,7 @@ void BmpBlender::flush(const QRect &rect)
         mInitTilesLater = false;
     }
 
-    int x1 = rect.left(), x2 = rect.right(), y1 = rect.top(), y2 = rect.bottom();
-    x1 -= 2;
-    x2 += 2;
-    y1 -= 2;
-    y2 += 2;
-
-    imagesToTileGrids(x1, y1, x2, y2);
-    addEdgeTiles(x1, y1, x2, y2);
-    tileGridsToLayers(x1, y1, x2, y2);
+    blendRegion(rect.adjusted(-2, -2, 2, 2));
 }
 
 void BmpBlender::tilesetAdded(Tileset *ts)
@@ -243,17 +236,12 @@ void BmpBlender::testBlendEdgesEverywhere(bool enabled, QRegion& tileSelection)
         mInitTilesLater = false;
     }
 
-    int x1 = 0;
-    int x2 = mMap->width() - 1;
-    int y1 = 0;
-    int y2 = mMap->height() - 1;
+    QRect bounds(0, 0, mMap->width(), mMap->height());
 
     // First: blend with the setting the opposite of what it's being set to.
     mBlendEdgesEverywhere = !enabled;
     markDirty(0, 0, mMap->width() - 1, mMap->height() - 1);
-    imagesToTileGrids(x1, y1, x2, y2);
-    addEdgeTiles(x1, y1, x2, y2);
-    tileGridsToLayers(x1, y1, x2, y2);
+    blendRegion(bounds);
 
     // Save the tile layers so we can compare them.
     QMap<QString,TileLayer*> tileLayers = mTileLayers;
@@ -262,9 +250,7 @@ void BmpBlender::testBlendEdgesEverywhere(bool enabled, QRegion& tileSelection)
     // Second: blend with the setting at the desired value.
     mBlendEdgesEverywhere = enabled;
     markDirty(0, 0, mMap->width() - 1, mMap->height() - 1);
-    imagesToTileGrids(x1, y1, x2, y2);
-    addEdgeTiles(x1, y1, x2, y2);
-    tileGridsToLayers(x1, y1, x2, y2);
+    blendRegion(bounds);
 
     tileSelection = QRegion();
 
@@ -474,6 +460,9 @@ void BmpBlender::initTiles()
         }
     }
 
+    compileRules();
+    compileBlends();
+
     updateWarnings();
 
     // This list is for the benefit of PaintBMP().
@@ -500,16 +489,81 @@ static bool adjacentToNonBlack(const QImage &image1, const QImage &image2, int x
     return false;
 }
 
-void BmpBlender::imagesToTileGrids(int x1, int y1, int x2, int y2)
+void BmpBlender::compileRules()
 {
-    if (mTileGrids.isEmpty()) {
-        foreach (QString layerName, mRuleLayers + mBlendLayers) {
+    mRulesByColor[0].clear();
+    mRulesByColor[1].clear();
+    foreach (RuleWrapper *ruleW, mRules) {
+        ruleW->mLayerIndex = mRuleLayers.indexOf(ruleW->mRule->targetLayer);
+        int bitmapIndex = ruleW->mRule->bitmapIndex;
+        if (ruleW->mTiles.isEmpty() || bitmapIndex < 0 || bitmapIndex > 1)
+            continue;
+        mRulesByColor[bitmapIndex][ruleW->mRule->color] += ruleW;
+    }
+}
+
+void BmpBlender::blendRegion(const QRegion &rgn)
+{
+    QRect bounds(0, 0, mMap->width(), mMap->height());
+    QRegion clipped = rgn & bounds;
+    if (clipped.isEmpty())
+        return;
+
+    if (mFakeTileGrid == nullptr) {
+        foreach (QString layerName, mGridLayers) {
             if (!mTileGrids.contains(layerName))
                 mTileGrids[layerName] = new SparseTileGrid(mMap->width(), mMap->height());
         }
         mFakeTileGrid = new SparseTileGrid(mMap->width(), mMap->height());
     }
 
+    QVector<BlendChunk*> chunks;
+    int area = 0;
+    for (const QRect &r : clipped) {
+        for (int y = r.top(); y <= r.bottom(); y += BLEND_CHUNK_SIZE) {
+            for (int x = r.left(); x <= r.right(); x += BLEND_CHUNK_SIZE) {
+                BlendChunk *chunk = new BlendChunk;
+                chunk->mRect = QRect(x, y, BLEND_CHUNK_SIZE, BLEND_CHUNK_SIZE) & r;
+                chunk->mBounds = chunk->mRect.adjusted(-1, -1, 1, 1) & bounds;
+                chunks += chunk;
+            }
+        }
+        area += r.width() * r.height();
+    }
+
+    BmpBlendJobs *jobs = BmpBlendJobs::instance();
+    if (jobs->threadCount() == 0 || chunks.size() < 2 || area < PARALLEL_BLEND_AREA) {
+        foreach (BlendChunk *chunk, chunks)
+            blendChunk(chunk);
+    } else {
+        BmpBlendJobs::Batch batch;
+        batch.blender = this;
+        batch.chunks = chunks;
+        batch.next = 0;
+        batch.unfinished = chunks.size();
+        jobs->run(&batch);
+    }
+
+    QVector<SparseTileGrid*> grids;
+    foreach (QString layerName, mGridLayers)
+        grids += mTileGrids[layerName];
+    foreach (BlendChunk *chunk, chunks)
+        mergeChunk(chunk, grids);
+    qDeleteAll(chunks);
+
+    for (const QRect &r : clipped)
+        tileGridsToLayers(r.left(), r.top(), r.right(), r.bottom());
+}
+
+// This only reads the map and the compiled rules and blends, so it may run on
+// any thread.
+void BmpBlender::blendChunk(BlendChunk *chunk)
+{
+    const QRect &b = chunk->mBounds;
+    const int area = b.width() * b.height();
+    chunk->mTiles.fill(nullptr, mGridLayers.size() * area);
+    chunk->mFakeTiles.fill(nullptr, area);
+
     const QRgb black = qRgb(0, 0, 0);
 
     // Hack - If a pixel is black, and the user-drawn map tile in 0_Floor is
@@ -517,86 +571,83 @@ void BmpBlender::imagesToTileGrids(int x1, int y1, int x2, int y2)
     int index = mMap->indexOfLayer(STR_0Floor, Layer::TileLayerType);
     TileLayer *floorLayer = (index == -1) ? nullptr : mMap->layerAt(index)->asTileLayer();
 
-    x1 = qBound(0, x1, mMap->width() - 1);
-    x2 = qBound(0, x2, mMap->width() - 1);
-    y1 = qBound(0, y1, mMap->height() - 1);
-    y2 = qBound(0, y2, mMap->height() - 1);
+    const QImage &image0 = mMap->rbmpMain().rimage();
+    const QImage &image1 = mMap->rbmpVeg().rimage();
+    const MapRands &rands0 = mMap->rbmpMain().rands();
+    const MapRands &rands1 = mMap->rbmpVeg().rands();
+
+    // Neighbouring pixels are usually the same colour, so remember the rules
+    // for the last colour seen in each image.
+    const QVector<RuleWrapper*> noRules;
+    QRgb lastCol[2] = { black, black };
+    const QVector<RuleWrapper*> *rules[2] = { &noRules, &noRules };
+    for (int i = 0; i < 2; i++) {
+        QHash<QRgb,QVector<RuleWrapper*> >::const_iterator it = mRulesByColor[i].constFind(black);
+        if (it != mRulesByColor[i].constEnd())
+            rules[i] = &it.value();
+    }
 
-    Cell emptyCell;
+    Tile **tiles = chunk->mTiles.data();
+    Tile **fakeTiles = chunk->mFakeTiles.data();
 
-    for (int y = y1; y <= y2; y++) {
-        for (int x = x1; x <= x2; x++) {
-            for (Tiled::SparseTileGrid *tileGrid : qAsConst(mTileGrids)) {
-                tileGrid->replace(x, y, emptyCell);
-            }
-            mFakeTileGrid->replace(x, y, emptyCell);
-            for (BlendGrid &blendGrid : mBlendGrids) {
-                blendGrid.remove(x + y * mMap->width());
-            }
+    for (int y = b.top(); y <= b.bottom(); y++) {
+        for (int x = b.left(); x <= b.right(); x++) {
+            const int i = (x - b.left()) + (y - b.top()) * b.width();
 
-            QRgb col = mMap->rbmpMain().pixel(x, y);
-            QRgb col2 = mMap->rbmpVeg().pixel(x, y);
+            QRgb col = image0.pixel(x, y);
+            QRgb col2 = image1.pixel(x, y);
 
-            if (mRuleByColor.contains(col)) {
-                foreach (RuleWrapper *ruleW, mRuleByColor[col]) {
-                    if (ruleW->mRule->bitmapIndex != 0)
-                        continue;
-                    auto it = mTileGrids.find(ruleW->mRule->targetLayer);
-                    if (it == mTileGrids.end()) /*if (!mTileGrids.contains(ruleW->mRule->targetLayer))*/
-                        continue;
-                    Tiled::SparseTileGrid *tileGrid = it.value();
-                    if (!ruleW->mTiles.size())
+            if (col != lastCol[0]) {
+                QHash<QRgb,QVector<RuleWrapper*> >::const_iterator it = mRulesByColor[0].constFind(col);
+                rules[0] = (it == mRulesByColor[0].constEnd()) ? &noRules : &it.value();
+                lastCol[0] = col;
+            }
+            if (!rules[0]->isEmpty()) {
+                int rand = rands0[x][y];
+                for (RuleWrapper *ruleW : *rules[0]) {
+                    if (ruleW->mLayerIndex == -1)
                         continue;
-                    Tile *tile = ruleW->mTiles[mMap->bmp(0).rand(x, y) % ruleW->mTiles.size()];
-                    tileGrid->replace(x, y, Cell(tile));
+                    tiles[ruleW->mLayerIndex * area + i] = ruleW->mTiles[rand % ruleW->mTiles.size()];
                 }
             }
 
-            // Hack - If a pixel is black, and the user-drawn map tile in 0_Floor is
-            // one of the Rules.txt tiles, pretend that that pixel exists in the image.
             if (floorLayer && col == black) {
                 if (Tile *tile = floorLayer->cellAt(x, y).tile) {
-                    if (mFloorTileToRule.contains(tile)) {
-                        RuleWrapper *ruleW = mFloorTileToRule[tile];
-                        if (ruleW->mTiles.size()) {
-                            Tile *tile = ruleW->mTiles[mMap->bmp(0).rand(x, y) % ruleW->mTiles.count()];
-                            mFakeTileGrid->replace(x, y, Cell(tile));
-                        }
+                    if (RuleWrapper *ruleW = mFloorTileToRule.value(tile)) {
+                        if (ruleW->mTiles.size())
+                            fakeTiles[i] = ruleW->mTiles[rands0[x][y] % ruleW->mTiles.count()];
                         col = ruleW->mRule->color;
                     }
                 }
             }
 
-            if (col2 != black && mRuleByColor.contains(col2)) {
-                foreach (RuleWrapper *ruleW, mRuleByColor[col2]) {
-                    if (ruleW->mRule->bitmapIndex != 1)
-                        continue;
+            if (col2 == black)
+                continue;
+            if (col2 != lastCol[1]) {
+                QHash<QRgb,QVector<RuleWrapper*> >::const_iterator it = mRulesByColor[1].constFind(col2);
+                rules[1] = (it == mRulesByColor[1].constEnd()) ? &noRules : &it.value();
+                lastCol[1] = col2;
+            }
+            if (!rules[1]->isEmpty()) {
+                int rand = rands1[x][y];
+                for (RuleWrapper *ruleW : *rules[1]) {
                     if (ruleW->mRule->condition != col && ruleW->mRule->condition != black)
                         continue;
-                    auto it = mTileGrids.find(ruleW->mRule->targetLayer);
-                    if (it == mTileGrids.end() /*!mTileGrids.contains(ruleW->mRule->targetLayer)*/)
-                        continue;
-                    Tiled::SparseTileGrid *tileGrid = it.value();
-                    if (!ruleW->mTiles.size())
+                    if (ruleW->mLayerIndex == -1)
                         continue;
-                    Tile *tile = ruleW->mTiles[mMap->bmp(1).rand(x, y) % ruleW->mTiles.size()];
-                    tileGrid->replace(x, y, Cell(tile)); /*mTileGrids[ruleW->mRule->targetLayer]->replace(x, y, Cell(tile))*/
+                    tiles[ruleW->mLayerIndex * area + i] = ruleW->mTiles[rand % ruleW->mTiles.size()];
                 }
             }
         }
     }
-}
 
-void BmpBlender::addEdgeTiles(int x1, int y1, int x2, int y2)
-{
-    x1 = qBound(0, x1, mMap->width() - 1);
-    x2 = qBound(0, x2, mMap->width() - 1);
-    y1 = qBound(0, y1, mMap->height() - 1);
-    y2 = qBound(0, y2, mMap->height() - 1);
+    const QRect &r = chunk->mRect;
+    const int rectArea = r.width() * r.height();
+    chunk->mBlends.fill(nullptr, mBlendTables.size() * rectArea);
 
-    if (mTileGrids.contains(STR_0Floor) == false)
+    if (mFloorGridIndex == -1)
         return;
-    SparseTileGrid *grid = mTileGrids[STR_0Floor];
+    Tile **floorTiles = tiles + mFloorGridIndex * area;
 
     QMap<QString,TileLayer*> mapLayers;
     foreach (QString layerName, mBlendExclude2Layers) {
@@ -605,30 +656,42 @@ void BmpBlender::addEdgeTiles(int x1, int y1, int x2, int y2)
             mapLayers[layerName] = mMap->layerAt(n)->asTileLayer();
     }
 
-    QVector<Tile*> neighbors(9);
+    const int nullIndex = mBlendTileIndex.value(nullptr, 0);
+    int neighbors[4]; // N, S, E, W
+    static const int dx[4] = { 0, 0, 1, -1 };
+    static const int dy[4] = { -1, 1, 0, 0 };
 
-    const Cell emptyCell;
-
-    for (int y = y1; y <= y2; y++) {
-        for (int x = x1; x <= x2; x++) {
-            Tile *tile = grid->at(x, y).tile;
+    for (int y = r.top(); y <= r.bottom(); y++) {
+        for (int x = r.left(); x <= r.right(); x++) {
+            const int i = (x - b.left()) + (y - b.top()) * b.width();
+            Tile *tile = floorTiles[i];
             if ((tile == nullptr) && ((mBlendEdgesEverywhere == true) ||
-                                      adjacentToNonBlack(mMap->rbmpMain().rimage(), mMap->rbmpVeg().rimage(), x, y))) {
-                tile = mFakeTileGrid->at(x, y).tile;
+                                      adjacentToNonBlack(image0, image1, x, y))) {
+                tile = fakeTiles[i];
             }
 
-            for (int dy = -1; dy <= +1; dy++)
-                for (int dx = -1; dx <= +1; dx++)
-                    neighbors[(dx + 1) + (dy + 1) * 3] = getNeighbouringTile(x + dx, y + dy);
+            int tileIndex = mBlendTileIndex.value(tile, 0);
+            for (int n = 0; n < 4; n++) {
+                if (!b.contains(x + dx[n], y + dy[n])) {
+                    neighbors[n] = nullIndex; // off the map
+                    continue;
+                }
+                int ni = i + dx[n] + dy[n] * b.width();
+                Tile *neighbor = floorTiles[ni] ? floorTiles[ni] : fakeTiles[ni];
+                neighbors[n] = mBlendTileIndex.value(neighbor, 0);
+            }
 
-            foreach (QString layerName, mBlendLayers) {
-                BlendWrapper *blendW = getBlendRule(x, y, tile, layerName, neighbors);
+            for (int t = 0; t < mBlendTables.size(); t++) {
+                const BlendTable &table = mBlendTables[t];
+                BlendWrapper *blendW = nullptr;
+                if (mBlendEdgesEverywhere || (tile != nullptr))
+                    blendW = getBlendRule(table, tileIndex, neighbors);
                 if (blendW != nullptr) {
-                    for (int i = 0; i < blendW->mBlend->exclude2.size(); i += 2) {
-                        if (mapLayers.contains(blendW->mBlend->exclude2[i + 1])) {
-                            TileLayer *mapLayer = mapLayers[blendW->mBlend->exclude2[i + 1]];
+                    for (int e = 0; e < blendW->mBlend->exclude2.size(); e += 2) {
+                        if (mapLayers.contains(blendW->mBlend->exclude2[e + 1])) {
+                            TileLayer *mapLayer = mapLayers[blendW->mBlend->exclude2[e + 1]];
                             if (Tile *tile = mapLayer->cellAt(x, y).tile) {
-                                if (blendW->mExclude2Tiles[i/2].contains(tile)) {
+                                if (blendW->mExclude2Tiles[e/2].contains(tile)) {
                                     blendW = nullptr;
                                     break;
                                 }
@@ -636,23 +699,49 @@ void BmpBlender::addEdgeTiles(int x1, int y1, int x2, int y2)
                         }
                     }
                 }
+                Tile *&dest = tiles[table.mGridIndex * area + i];
                 if (blendW == nullptr) {
-                    mTileGrids[layerName]->replace(x, y, emptyCell);
-                    if (true/*mHack*/) {
-                        int index = x + y * mMap->width();
-                        mBlendGrids[layerName].remove(index);
-                    }
+                    dest = nullptr;
                     continue;
                 }
-                const QVector<Tile*> tiles = blendW->mBlendTiles;
-                if (tiles.size()) {
-                    Tile *tile = tiles[mMap->bmp(0).rand(x, y) % tiles.size()];
-                    mTileGrids[layerName]->replace(x, y, Cell(tile));
-                }
-                if (true/*mHack*/) {
-                    int index = x + y * mMap->width();
-                    mBlendGrids[layerName][index] = blendW;
-                }
+                const QVector<Tile*> &blendTiles = blendW->mBlendTiles;
+                if (blendTiles.size())
+                    dest = blendTiles[rands0[x][y] % blendTiles.size()];
+                chunk->mBlends[t * rectArea + (x - r.left()) + (y - r.top()) * r.width()] = blendW;
+            }
+        }
+    }
+}
+
+void BmpBlender::mergeChunk(const BlendChunk *chunk, const QVector<SparseTileGrid*> &grids)
+{
+    const QRect &b = chunk->mBounds;
+    const QRect &r = chunk->mRect;
+    const int area = b.width() * b.height();
+    const int rectArea = r.width() * r.height();
+    const Cell emptyCell;
+
+    QVector<BlendGrid*> blendGrids;
+    foreach (const BlendTable &table, mBlendTables)
+        blendGrids += &mBlendGrids[table.mLayerName];
+
+    for (int y = r.top(); y <= r.bottom(); y++) {
+        for (int x = r.left(); x <= r.right(); x++) {
+            const int i = (x - b.left()) + (y - b.top()) * b.width();
+            for (int g = 0; g < grids.size(); g++) {
+                Tile *tile = chunk->mTiles[g * area + i];
+                grids[g]->replace(x, y, tile ? Cell(tile) : emptyCell);
+            }
+            Tile *fake = chunk->mFakeTiles[i];
+            mFakeTileGrid->replace(x, y, fake ? Cell(fake) : emptyCell);
+
+            int index = x + y * mMap->width();
+            int ri = (x - r.left()) + (y - r.top()) * r.width();
+            for (int t = 0; t < blendGrids.size(); t++) {
+                if (BlendWrapper *blendW = chunk->mBlends[t * rectArea + ri])
+                    blendGrids[t]->insert(index, blendW);
+                else
+                    blendGrids[t]->remove(index);
             }
         }
     }
@@ -696,10 +785,10 @@ void BmpBlender::tileGridsToLayers(int x1, int y1, int x2, int y2)
                 // be there from being overriden by this automatic one.
                 if (mapLayer != nullptr) {
                     int index = x + y * mMap->width();
-                    if (blendGrid.contains(index)) {
-                        BlendWrapper *blendW = blendGrid[index];
+                    BlendGrid::const_iterator it = blendGrid.constFind(index);
+                    if (it != blendGrid.constEnd()) {
                         Tile *tile = mapLayer->cellAt(x, y).tile;
-                        if (blendW->mBlendTiles.contains(tile)) {
+                        if (it.value()->mBlendTiles.contains(tile)) {
                             tl->setCell(x, y, emptyCell);
                             continue;
                         }
@@ -817,80 +906,79 @@ void BmpBlender::updateWarnings()
     }
 }
 
-Tile *BmpBlender::getNeighbouringTile(int x, int y)
+void BmpBlender::compileBlends()
 {
-    if (x < 0 || y < 0 || x >= mMap->width() || y >= mMap->height())
-        return nullptr;
-    SparseTileGrid *grid = mTileGrids[STR_0Floor];
-    Tile *tile = grid->at(x, y).tile;
-    if (!tile)
-        tile = mFakeTileGrid->at(x, y).tile;
-    return tile;
+    mBlendTileIndex.clear();
+    foreach (BlendWrapper *blendW, mBlendList) {
+        foreach (Tile *tile, blendW->mMainTiles + blendW->mExcludeTiles) {
+            if (!mBlendTileIndex.contains(tile))
+                mBlendTileIndex.insert(tile, mBlendTileIndex.size() + 1);
+        }
+    }
+    int tileCount = mBlendTileIndex.size() + 1;
+
+    mGridLayers = mRuleLayers;
+    foreach (QString layerName, mBlendLayers) {
+        if (!mGridLayers.contains(layerName))
+            mGridLayers += layerName;
+    }
+    mFloorGridIndex = mRuleLayers.indexOf(STR_0Floor);
+
+    mBlendTables.clear();
+    foreach (QString layerName, mBlendLayers) {
+        BlendTable table;
+        table.mLayerName = layerName;
+        table.mGridIndex = mGridLayers.indexOf(layerName);
+        table.mBlends = mBlendsByLayer[layerName].toVector();
+        int words = table.mWords = (table.mBlends.size() + 63) / 64;
+        table.mDirMasks.fill(0, (BmpBlend::SE + 1) * words);
+        table.mMainMasks.fill(0, tileCount * words);
+        table.mExcludeMasks.fill(0, tileCount * words);
+        for (int i = 0; i < table.mBlends.size(); i++) {
+            BlendWrapper *blendW = table.mBlends[i];
+            int word = i / 64;
+            quint64 bit = quint64(1) << (i % 64);
+            table.mDirMasks[blendW->mBlend->dir * words + word] |= bit;
+            foreach (Tile *tile, blendW->mMainTiles)
+                table.mMainMasks[mBlendTileIndex[tile] * words + word] |= bit;
+            foreach (Tile *tile, blendW->mExcludeTiles)
+                table.mExcludeMasks[mBlendTileIndex[tile] * words + word] |= bit;
+        }
+        mBlendTables += table;
+    }
 }
 
-BmpBlender::BlendWrapper *BmpBlender::getBlendRule(int x, int y, Tile *tile,
-                                   const QString &layer,
-                                   const QVector<Tile*> &neighbors)
+// Returns the last blend in the layer whose direction matches the
+// neighbouring tiles.  'tile' and 'neighbors' (N, S, E, W) are indices
+// from mBlendTileIndex.
+BmpBlender::BlendWrapper *BmpBlender::getBlendRule(const BlendTable &table, int tile,
+                                                   const int *neighbors) const
 {
-    if ((mBlendEdgesEverywhere == false) && (tile == nullptr))
-        return nullptr;
-
-    BlendWrapper *lastBlend = nullptr;
-
-#define NEIGHBOR(X,Y) neighbors[((X) - x + 1) + ((Y) - y + 1) * 3]
-
-    foreach (BlendWrapper *blendW, mBlendsByLayer[layer]) {
-        QVector<Tile*> &mainTiles = blendW->mMainTiles;
-        if (mainTiles.contains(tile))
-            continue;
-        if (blendW->mExcludeTiles.contains(tile))
-            continue;
-        bool bPass = false;
-        switch (blendW->mBlend->dir) {
-        case BmpBlend::N:
-            bPass = mainTiles.contains(NEIGHBOR(x, y - 1)) &&
-                    !mainTiles.contains(NEIGHBOR(x - 1, y)) &&
-                    !mainTiles.contains(NEIGHBOR(x + 1, y));
-            break;
-        case BmpBlend::S:
-            bPass = mainTiles.contains(NEIGHBOR(x, y + 1)) &&
-                    !mainTiles.contains(NEIGHBOR(x - 1, y)) &&
-                    !mainTiles.contains(NEIGHBOR(x + 1, y));
-            break;
-        case BmpBlend::E:
-            bPass = mainTiles.contains(NEIGHBOR(x + 1, y)) &&
-                    !mainTiles.contains(NEIGHBOR(x, y - 1)) &&
-                    !mainTiles.contains(NEIGHBOR(x, y + 1));
-            break;
-        case BmpBlend::W:
-            bPass = mainTiles.contains(NEIGHBOR(x - 1, y)) &&
-                    !mainTiles.contains(NEIGHBOR(x, y - 1)) &&
-                    !mainTiles.contains(NEIGHBOR(x, y + 1));
-            break;
-        case BmpBlend::NE:
-            bPass = mainTiles.contains(NEIGHBOR(x, y - 1)) &&
-                    mainTiles.contains(NEIGHBOR(x + 1, y));
-            break;
-        case BmpBlend::SE:
-            bPass = mainTiles.contains(NEIGHBOR(x, y + 1)) &&
-                    mainTiles.contains(NEIGHBOR(x + 1, y));
-            break;
-        case BmpBlend::NW:
-            bPass = mainTiles.contains(NEIGHBOR(x, y - 1)) &&
-                    mainTiles.contains(NEIGHBOR(x - 1, y));
-            break;
-        case BmpBlend::SW:
-            bPass = mainTiles.contains(NEIGHBOR(x, y + 1)) &&
-                    mainTiles.contains(NEIGHBOR(x - 1, y));
-            break;
-        default:
-            break;
-        }
-        if (bPass)
-            lastBlend = blendW;
+    const int words = table.mWords;
+    const quint64 *dirs = table.mDirMasks.constData();
+    const quint64 *main = table.mMainMasks.constData();
+    const quint64 *exclude = table.mExcludeMasks.constData();
+
+    for (int w = words - 1; w >= 0; w--) {
+        quint64 n = main[neighbors[0] * words + w];
+        quint64 s = main[neighbors[1] * words + w];
+        quint64 e = main[neighbors[2] * words + w];
+        quint64 west = main[neighbors[3] * words + w];
+        quint64 pass =
+                (dirs[BmpBlend::N * words + w] & n & ~west & ~e) |
+                (dirs[BmpBlend::S * words + w] & s & ~west & ~e) |
+                (dirs[BmpBlend::E * words + w] & e & ~n & ~s) |
+                (dirs[BmpBlend::W * words + w] & west & ~n & ~s) |
+                (dirs[BmpBlend::NE * words + w] & n & e) |
+                (dirs[BmpBlend::SE * words + w] & s & e) |
+                (dirs[BmpBlend::NW * words + w] & n & west) |
+                (dirs[BmpBlend::SW * words + w] & s & west);
+        pass &= ~main[tile * words + w] & ~exclude[tile * words + w];
+        if (pass)
+            return table.mBlends[w * 64 + 63 - qCountLeadingZeroBits(pass)];
     }
 
-    return lastBlend;
+    return nullptr;
 }
 
 /////
@@ -1519,3 +1607,111 @@ QString BmpBlendsFile::unpaddedTileName(const QString &tileName)
 }
 
 /////
+
+static const int MAX_BLEND_THREADS = 8;
+
+// flush() may be called from the map-image threads as well as the app thread.
+QMutex BmpBlendJobs::mInstanceMutex;
+BmpBlendJobs *BmpBlendJobs::mInstance = nullptr;
+
+BmpBlendJobs *BmpBlendJobs::instance()
+{
+    QMutexLocker locker(&mInstanceMutex);
+    if (mInstance == nullptr)
+        mInstance = new BmpBlendJobs;
+    return mInstance;
+}
+
+void BmpBlendJobs::deleteInstance()
+{
+    QMutexLocker locker(&mInstanceMutex);
+    delete mInstance;
+    mInstance = nullptr;
+}
+
+BmpBlendJobs::BmpBlendJobs()
+{
+    // The thread calling flush() does its share, so one less thread is needed.
+    int threads = qMin(QThread::idealThreadCount() - 1, MAX_BLEND_THREADS);
+    for (int i = 0; i < threads; i++) {
+        InterruptibleThread *thread = new InterruptibleThread;
+        BmpBlendWorker *worker = new BmpBlendWorker(thread, this);
+        worker->moveToThread(thread);
+        thread->start();
+        mThreads += thread;
+        mWorkers += worker;
+    }
+}
+
+BmpBlendJobs::~BmpBlendJobs()
+{
+    for (int i = 0; i < mThreads.size(); i++) {
+        mThreads[i]->interrupt();
+        mThreads[i]->quit();
+        mThreads[i]->wait();
+        delete mWorkers[i];
+        delete mThreads[i];
+    }
+}
+
+void BmpBlendJobs::run(Batch *batch)
+{
+    QMutexLocker locker(&mMutex);
+    mBatches += batch;
+    foreach (BaseWorker *worker, mWorkers)
+        QMetaObject::invokeMethod(worker, "jobsAdded", Qt::QueuedConnection);
+    locker.unlock();
+
+    work(batch, nullptr);
+
+    locker.relock();
+    while (batch->unfinished > 0)
+        mFinished.wait(&mMutex);
+}
+
+// Blends chunks of the given batch, or of any batch if it is null, until
+// there are none left to start.
+void BmpBlendJobs::work(Batch *batch, BaseWorker *worker)
+{
+    QMutexLocker locker(&mMutex);
+    forever {
+        Batch *b = batch;
+        if (b == nullptr) {
+            if (mBatches.isEmpty())
+                break;
+            b = mBatches.first();
+        }
+        if (b->next == b->chunks.size())
+            break;
+        BmpBlender::BlendChunk *chunk = b->chunks[b->next++];
+        if (b->next == b->chunks.size())
+            mBatches.removeOne(b);
+        locker.unlock();
+
+        if (worker == nullptr || !worker->aborted())
+            b->blender->blendChunk(chunk);
+
+        locker.relock();
+        // Always count the chunk, the owner of the batch is waiting for all of them.
+        if (--b->unfinished == 0)
+            mFinished.wakeAll();
+    }
+}
+
+BmpBlendWorker::BmpBlendWorker(InterruptibleThread *thread, BmpBlendJobs *jobs) :
+    BaseWorker(thread),
+    mJobs(jobs)
+{
+}
+
+void BmpBlendWorker::work()
+{
+    IN_WORKER_THREAD
+
+    mJobs->work(nullptr, this);
+}
+
+void BmpBlendWorker::jobsAdded()
+{
+    scheduleWork();
+}
@@ -18,7 +18,10 @@
 #ifndef BMPBLENDER_H
 #define BMPBLENDER_H
 
+#include "threads.h"
+
 #include <QCoreApplication>
+#include <QHash>
 #include <QMap>
 #include <QRegion>
 #include <QRgb>
@@ -167,8 +170,7 @@ private:
     QList<Tile *> tileNameToTiles(const QString& name);
     QList<Tile *> tileNamesToTiles(const QStringList &names);
     void initTiles();
-    void imagesToTileGrids(int x1, int y1, int x2, int y2);
-    void addEdgeTiles(int x1, int y1, int x2, int y2);
+    void blendRegion(const QRegion &rgn);
     void tileGridsToLayers(int x1, int y1, int x2, int y2);
     QString resolveAlias(const QString &tileName, int randForPos) const;
 
@@ -182,10 +184,14 @@ private:
     QMap<QString,Tile*> mTileByName;
     bool mInitTilesLater;
 
-    Tile *getNeighbouringTile(int x, int y);
     class BlendWrapper;
-    BlendWrapper *getBlendRule(int x, int y, Tile *tile, const QString &layer,
-                               const QVector<Tile *> &neighbors);
+    class BlendTable;
+    class BlendChunk;
+    void blendChunk(BlendChunk *chunk);
+    void mergeChunk(const BlendChunk *chunk, const QVector<SparseTileGrid*> &grids);
+    BlendWrapper *getBlendRule(const BlendTable &table, int tile, const int *neighbors) const;
+    void compileRules();
+    void compileBlends();
 
     class AliasWrapper
     {
@@ -204,16 +210,19 @@ private:
     {
     public:
         RuleWrapper(BmpRule *rule) :
-            mRule(rule)
+            mRule(rule),
+            mLayerIndex(-1)
         {
         }
         BmpRule *mRule;
         QStringList mTileNames;
         QVector<Tile*> mTiles;
+        int mLayerIndex; // in mRuleLayers
     };
 
     QList<RuleWrapper*> mRules;
     QMap<QRgb,QList<RuleWrapper*> > mRuleByColor;
+    QHash<QRgb,QVector<RuleWrapper*> > mRulesByColor[2]; // by bitmapIndex, only rules with tiles
     QStringList mRuleLayers;
     QList<RuleWrapper*> mFloor0Rules;
     QMap<Tile*,RuleWrapper*> mFloorTileToRule;
@@ -236,6 +245,38 @@ private:
     QMap<QString,QList<BlendWrapper*> > mBlendsByLayer;
     QSet<QString> mBlendExclude2Layers;
 
+    // The blends for one layer as bitmasks, bit N being mBlends[N].  The masks
+    // for a tile are at (tile index * mWords), the masks for a direction at
+    // (BmpBlend::Direction * mWords).
+    class BlendTable
+    {
+    public:
+        QString mLayerName;
+        int mGridIndex; // in mGridLayers
+        QVector<BlendWrapper*> mBlends;
+        int mWords;
+        QVector<quint64> mDirMasks;
+        QVector<quint64> mMainMasks;
+        QVector<quint64> mExcludeMasks;
+    };
+    QVector<BlendTable> mBlendTables; // same order as mBlendLayers
+    QHash<Tile*,int> mBlendTileIndex; // main or exclude tile -> index > 0
+    QStringList mGridLayers; // mRuleLayers then the other mBlendLayers
+    int mFloorGridIndex; // 0_Floor in mGridLayers
+
+    // The result of blending one part of a region.  Rule tiles are computed
+    // over mBounds, which includes the neighbours the edge tiles look at.
+    class BlendChunk
+    {
+    public:
+        QRect mRect;
+        QRect mBounds;
+        QVector<Tile*> mTiles; // mBounds for each of mGridLayers
+        QVector<Tile*> mFakeTiles; // mBounds
+        QVector<BlendWrapper*> mBlends; // mRect for each of mBlendTables
+    };
+    friend class BmpBlendJobs;
+
     QSet<Tile*> mKnownBlendTiles;
     bool mHack;
     bool mBlendEdgesEverywhere;
@@ -249,6 +290,58 @@ private:
     QString mError;
 };
 
+// Chunks of regions waiting to be blended.  These are shared by every
+// BmpBlender.  The thread that calls BmpBlender::flush() blends chunks of its
+// own region too, and waits on mFinished until the workers are done with the
+// rest.
+class BmpBlendJobs
+{
+public:
+    struct Batch
+    {
+        BmpBlender *blender;
+        QVector<BmpBlender::BlendChunk*> chunks;
+        int next;
+        int unfinished;
+    };
+
+    static BmpBlendJobs *instance();
+    static void deleteInstance();
+
+    int threadCount() const
+    { return mThreads.size(); }
+
+    void run(Batch *batch);
+    void work(Batch *batch, BaseWorker *worker);
+
+private:
+    BmpBlendJobs();
+    ~BmpBlendJobs();
+
+    static QMutex mInstanceMutex;
+    static BmpBlendJobs *mInstance;
+
+    QMutex mMutex;
+    QWaitCondition mFinished;
+    QList<Batch*> mBatches;
+    QVector<InterruptibleThread*> mThreads;
+    QVector<BaseWorker*> mWorkers;
+};
+
+class BmpBlendWorker : public BaseWorker
+{
+    Q_OBJECT
+public:
+    BmpBlendWorker(InterruptibleThread *thread, BmpBlendJobs *jobs);
+
+public slots:
+    void work();
+    void jobsAdded();
+
+private:
+    BmpBlendJobs *mJobs;
+};
+
 } // namespace Internal
 } // namespace Tiled
 
@@ -26,12 +26,17 @@
 #include "tiledapplication.h"
 #include "zprogress.h"
 
+#include "bmpblender.h"
 #include "tilemetainfomgr.h"
+#include "tilesetmanager.h"
 #ifdef VIRTUAL_TILESETS
 #include "texturemanager.h"
 #include "virtualtileset.h"
 #endif
+#include "BuildingEditor/buildingbatchexport.h"
+#include "BuildingEditor/buildingbenchmark.h"
 #include "BuildingEditor/buildingeditorwindow.h"
+#include "BuildingEditor/buildingmap.h"
 #include "BuildingEditor/buildingtemplates.h"
 #include "BuildingEditor/buildingtiles.h"
 #include "BuildingEditor/buildingtilesdialog.h"
@@ -40,6 +45,7 @@
 
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QtPlugin>
@@ -68,11 +74,23 @@ public:
     bool quit;
     bool showedVersion;
     bool disableOpenGL;
+    bool exportTMX;
+    bool exportNewBinary;
+    bool singleProcess;
+    bool benchmarkBlend;
+    bool benchmarkTxt;
+    bool benchmarkGid;
 
 private:
     void showVersion();
     void justQuit();
     void setDisableOpenGL();
+    void setExportTMX();
+    void setExportNewBinary();
+    void setSingleProcess();
+    void setBenchmarkBlend();
+    void setBenchmarkTxt();
+    void setBenchmarkGid();
 
     // Convenience wrapper around registerOption
     template <void (CommandLineHandler::*memberFunction)()>
@@ -94,6 +112,12 @@ CommandLineHandler::CommandLineHandler()
     : quit(false)
     , showedVersion(false)
     , disableOpenGL(false)
+    , exportTMX(false)
+    , exportNewBinary(false)
+    , singleProcess(false)
+    , benchmarkBlend(false)
+    , benchmarkTxt(false)
+    , benchmarkGid(false)
 {
     option<&CommandLineHandler::showVersion>(
                 QLatin1Char('v'),
@@ -110,6 +134,42 @@ CommandLineHandler::CommandLineHandler()
                 QChar(),
                 QLatin1String("--disable-opengl"),
                 QLatin1String("Disable hardware accelerated rendering"));
+
+    option<&CommandLineHandler::setExportTMX>(
+                QChar(),
+                QLatin1String("--export-tmx"),
+                QLatin1String("Export the given .tbx files or directories to .tmx "
+                              "next to each file, then quit"));
+
+    option<&CommandLineHandler::setExportNewBinary>(
+                QChar(),
+                QLatin1String("--export-pzby"),
+                QLatin1String("Export the given .tbx files or directories to .pzby "
+                              "next to each file, then quit"));
+
+    option<&CommandLineHandler::setSingleProcess>(
+                QChar(),
+                QLatin1String("--single-process"),
+                QLatin1String("Export in this process instead of one worker "
+                              "process per core"));
+
+    option<&CommandLineHandler::setBenchmarkBlend>(
+                QChar(),
+                QLatin1String("--benchmark-blend"),
+                QLatin1String("Time blending a 300x300 cell using the given "
+                              "Rules.txt and Blends.txt, then quit"));
+
+    option<&CommandLineHandler::setBenchmarkTxt>(
+                QChar(),
+                QLatin1String("--benchmark-txt"),
+                QLatin1String("Time parsing the given .txt files or the .txt "
+                              "files in the given directories, then quit"));
+
+    option<&CommandLineHandler::setBenchmarkGid>(
+                QChar(),
+                QLatin1String("--benchmark-gid"),
+                QLatin1String("Time looking up the GIDs of tiles from many "
+                              "tilesets, then quit"));
 }
 
 void CommandLineHandler::showVersion()
@@ -132,6 +192,36 @@ void CommandLineHandler::setDisableOpenGL()
     disableOpenGL = true;
 }
 
+void CommandLineHandler::setExportTMX()
+{
+    exportTMX = true;
+}
+
+void CommandLineHandler::setExportNewBinary()
+{
+    exportNewBinary = true;
+}
+
+void CommandLineHandler::setSingleProcess()
+{
+    singleProcess = true;
+}
+
+void CommandLineHandler::setBenchmarkBlend()
+{
+    benchmarkBlend = true;
+}
+
+void CommandLineHandler::setBenchmarkTxt()
+{
+    benchmarkTxt = true;
+}
+
+void CommandLineHandler::setBenchmarkGid()
+{
+    benchmarkGid = true;
+}
+
 #if !defined(QT_NO_DEBUG) && defined(ZOMBOID) && defined(_MSC_VER)
 static void __cdecl invalid_parameter_handler(
    const wchar_t * expression,
@@ -147,24 +237,35 @@ static void __cdecl invalid_parameter_handler(
 
 static QString tr(const char *s)
 {
-    return BuildingEditorWindow::instance()->tr(s);
+    return BuildingEditorWindow::tr(s);
+}
+
+static void configError(const QString &message)
+{
+    if (BuildingEditorWindow::instance())
+        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
+                              message);
+    else
+        qWarning("%s", qPrintable(message));
 }
 
 static bool InitConfigFiles()
 {
-    PROGRESS progress(tr("Loading config files"), BuildingEditorWindow::instance());
+    QScopedPointer<PROGRESS> progress;
+    if (BuildingEditorWindow::instance()) {
+        progress.reset(new PROGRESS(tr("Loading config files"), BuildingEditorWindow::instance()));
 
-    // Refresh the ui before blocking while loading tilesets etc
-    qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        // Refresh the ui before blocking while loading tilesets etc
+        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+    }
 
     // Create ~/.TileZed if needed.
     QString configPath = Preferences::instance()->configPath();
     QDir dir(configPath);
     if (!dir.exists()) {
         if (!dir.mkpath(configPath)) {
-            QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                                  tr("Failed to create config directory:\n%1")
-                                  .arg(QDir::toNativeSeparators(configPath)));
+            configError(tr("Failed to create config directory:\n%1")
+                        .arg(QDir::toNativeSeparators(configPath)));
             return false;
         }
     }
@@ -184,9 +285,8 @@ static bool InitConfigFiles()
             QString source = Preferences::instance()->appConfigPath(configFile);
             if (QFileInfo(source).exists()) {
                 if (!QFile::copy(source, fileName)) {
-                    QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                                          tr("Failed to copy file:\nFrom: %1\nTo: %2")
-                                          .arg(source).arg(fileName));
+                    configError(tr("Failed to copy file:\nFrom: %1\nTo: %2")
+                                .arg(source).arg(fileName));
                     return false;
                 }
             }
@@ -196,65 +296,57 @@ static bool InitConfigFiles()
     // Read Tilesets.txt before TMXConfig.txt in case we are upgrading
     // TMXConfig.txt from VERSION0 to VERSION1.
     if (!TileMetaInfoMgr::instance()->readTxt()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("%1\n(while reading %2)")
-                              .arg(TileMetaInfoMgr::instance()->errorString())
-                              .arg(TileMetaInfoMgr::instance()->txtName()));
+        configError(tr("%1\n(while reading %2)")
+                    .arg(TileMetaInfoMgr::instance()->errorString())
+                    .arg(TileMetaInfoMgr::instance()->txtName()));
         return false;
     }
 
     if (!TileMetaInfoMgr::instance()->addNewTilesets()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("%1\n(while adding new tilesets)"));
+        configError(tr("%1\n(while adding new tilesets)"));
         return false;
     }
 
     if (!BuildingTMX::instance()->readTxt()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("Error while reading %1\n%2")
-                              .arg(BuildingTMX::instance()->txtName())
-                              .arg(BuildingTMX::instance()->errorString()));
+        configError(tr("Error while reading %1\n%2")
+                    .arg(BuildingTMX::instance()->txtName())
+                    .arg(BuildingTMX::instance()->errorString()));
         return false;
     }
 
     if (!BuildingTilesMgr::instance()->readTxt()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("Error while reading %1\n%2")
-                              .arg(BuildingTilesMgr::instance()->txtName())
-                              .arg(BuildingTilesMgr::instance()->errorString()));
+        configError(tr("Error while reading %1\n%2")
+                    .arg(BuildingTilesMgr::instance()->txtName())
+                    .arg(BuildingTilesMgr::instance()->errorString()));
         return false;
     }
 
     if (!FurnitureGroups::instance()->readTxt()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("Error while reading %1\n%2")
-                              .arg(FurnitureGroups::instance()->txtName())
-                              .arg(FurnitureGroups::instance()->errorString()));
+        configError(tr("Error while reading %1\n%2")
+                    .arg(FurnitureGroups::instance()->txtName())
+                    .arg(FurnitureGroups::instance()->errorString()));
         return false;
     }
 
     if (!BuildingTemplates::instance()->readTxt()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("Error while reading %1\n%2")
-                              .arg(BuildingTemplates::instance()->txtName())
-                              .arg(BuildingTemplates::instance()->errorString()));
+        configError(tr("Error while reading %1\n%2")
+                    .arg(BuildingTemplates::instance()->txtName())
+                    .arg(BuildingTemplates::instance()->errorString()));
         return false;
     }
 
 #ifdef VIRTUAL_TILESETS
     if (!TextureMgr::instance().readTxt()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("Error while reading %1\n%2")
-                              .arg(TextureMgr::instance().txtName())
-                              .arg(TextureMgr::instance().errorString()));
+        configError(tr("Error while reading %1\n%2")
+                    .arg(TextureMgr::instance().txtName())
+                    .arg(TextureMgr::instance().errorString()));
         return false;
     }
 
     if (!VirtualTilesetMgr::instance().readTxt()) {
-        QMessageBox::critical(BuildingEditorWindow::instance(), tr("It's no good, Jim!"),
-                              tr("Error while reading %1\n%2")
-                              .arg(VirtualTilesetMgr::instance().txtName())
-                              .arg(VirtualTilesetMgr::instance().errorString()));
+        configError(tr("Error while reading %1\n%2")
+                    .arg(VirtualTilesetMgr::instance().txtName())
+                    .arg(VirtualTilesetMgr::instance().errorString()));
         return false;
     }
 #endif
@@ -262,6 +354,84 @@ static bool InitConfigFiles()
     return true;
 }
 
+static int BatchExport(const CommandLineHandler &commandLine)
+{
+    QStringList fileNames = BuildingBatchExport::buildingFiles(commandLine.filesToOpen());
+    if (fileNames.isEmpty()) {
+        qWarning("No .tbx files to export");
+        return 1;
+    }
+
+    BuildingBatchExport batch;
+    batch.setExportTMX(commandLine.exportTMX);
+    batch.setExportNewBinary(commandLine.exportNewBinary);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ok;
+    if (commandLine.singleProcess || fileNames.size() == 1) {
+#ifdef VIRTUAL_TILESETS
+        new TextureMgr;
+        new VirtualTilesetMgr;
+#endif
+        if (!InitConfigFiles())
+            return 1;
+        TileMetaInfoMgr::instance()->loadTilesets();
+        TilesetManager::instance()->waitForTilesets();
+        ok = batch.exportFiles(fileNames);
+    } else {
+        QStringList arguments;
+        if (commandLine.exportTMX)
+            arguments += QLatin1String("--export-tmx");
+        if (commandLine.exportNewBinary)
+            arguments += QLatin1String("--export-pzby");
+        arguments += QLatin1String("--single-process");
+        ok = batch.exportFilesInWorkers(fileNames, arguments);
+    }
+
+    qWarning("Processed %d file(s) in %lld ms", fileNames.size(), timer.elapsed());
+
+    return ok ? 0 : 1;
+}
+
+static int Benchmark(const CommandLineHandler &commandLine)
+{
+    bool ok = true;
+    if (commandLine.benchmarkTxt) {
+        if (!BuildingBenchmark::simpleFiles(commandLine.filesToOpen()))
+            ok = false;
+    }
+    if (commandLine.benchmarkGid) {
+        if (!BuildingBenchmark::gidMapper())
+            ok = false;
+    }
+    if (commandLine.benchmarkBlend) {
+        QStringList fileNames = commandLine.filesToOpen();
+        if (fileNames.size() != 2) {
+            qWarning("--benchmark-blend needs a Rules.txt and a Blends.txt file");
+            return 1;
+        }
+#ifdef VIRTUAL_TILESETS
+        new TextureMgr;
+        new VirtualTilesetMgr;
+#endif
+        if (!InitConfigFiles())
+            return 1;
+        TileMetaInfoMgr::instance()->loadTilesets();
+        if (!BuildingBenchmark::blend(fileNames[0], fileNames[1]))
+            ok = false;
+    }
+    return ok ? 0 : 1;
+}
+
+// Stop the worker threads that are shared by every BuildingMap and BmpBlender.
+static void DeleteWorkerThreads()
+{
+    BuildingLayoutJobs::deleteInstance();
+    BmpBlendJobs::deleteInstance();
+}
+
 int main(int argc, char *argv[])
 {
 #if !defined(QT_NO_DEBUG) && defined(ZOMBOID) && defined(_MSC_VER)
@@ -277,6 +447,18 @@ int main(int argc, char *argv[])
     QApplication::setGraphicsSystem(QLatin1String("raster"));
 #endif
 
+    // Batch exports and benchmarks don't need a display.
+    for (int i = 1; i < argc; i++) {
+        if (!qstrcmp(argv[i], "--export-tmx") || !qstrcmp(argv[i], "--export-pzby")
+                || !qstrcmp(argv[i], "--benchmark-blend")
+                || !qstrcmp(argv[i], "--benchmark-txt")
+                || !qstrcmp(argv[i], "--benchmark-gid")) {
+            if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+                qputenv("QT_QPA_PLATFORM", "offscreen");
+            break;
+        }
+    }
+
     TiledApplication a(argc, argv);
 
     Q_INIT_RESOURCE(buildingeditor);
@@ -304,6 +486,17 @@ int main(int argc, char *argv[])
         return 0;
     if (commandLine.disableOpenGL)
         Preferences::instance()->setUseOpenGL(false);
+    if (commandLine.exportTMX || commandLine.exportNewBinary) {
+        int result = BatchExport(commandLine);
+        DeleteWorkerThreads();
+        return result;
+    }
+    if (commandLine.benchmarkBlend || commandLine.benchmarkTxt
+            || commandLine.benchmarkGid) {
+        int result = Benchmark(commandLine);
+        DeleteWorkerThreads();
+        return result;
+    }
 
     if (a.isRunning()) {
         if (!commandLine.filesToOpen().isEmpty()) {
@@ -345,5 +538,7 @@ int main(int argc, char *argv[])
 //        w.openLastFiles();
     }
 
-    return a.exec();
+    int result = a.exec();
+    DeleteWorkerThreads();
+    return result;
 }
@@ -45,6 +45,7 @@ using namespace SharedTools;
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QLoggingCategory>
 
 #ifdef QT_NO_DEBUG
 inline QNoDebug noise() { return QNoDebug(); }
@@ -52,10 +53,17 @@ inline QNoDebug noise() { return QNoDebug(); }
 inline QDebug noise() { return QDebug(QtDebugMsg); }
 #endif
 
+// Per-map load times are kept in release builds too.  Turn them off with
+// QT_LOGGING_RULES="buildinged.mapload=false".
+Q_LOGGING_CATEGORY(lcMapLoad, "buildinged.mapload", QtInfoMsg)
+
 using namespace Tiled;
 using namespace Tiled::Internal;
 using namespace BuildingEditor;
 
+// Reading maps is mostly parsing, so use a thread per core, within reason.
+static const int MAX_READER_THREADS = 16;
+
 MapManager *MapManager::mInstance = nullptr;
 
 MapManager *MapManager::instance()
@@ -75,8 +83,7 @@ MapManager::MapManager() :
     mFileSystemWatcher(new FileSystemWatcher(this)),
     mDeferralDepth(0),
     mDeferralQueued(false),
-    mWaitingForMapInfo(nullptr),
-    mNextThreadForJob(0)
+    mWaitingForMapInfo(nullptr)
 #ifdef WORLDED
     , mReferenceEpoch(0)
 #endif
@@ -92,11 +99,12 @@ MapManager::MapManager() :
     qRegisterMetaType<MapInfo*>("BuildingEditor::Building*");
     qRegisterMetaType<MapInfo*>("MapInfo*");
 
-    mMapReaderThread.resize(4);
+    mMapReaderThread.resize(qBound(2, QThread::idealThreadCount(), MAX_READER_THREADS));
     mMapReaderWorker.resize(mMapReaderThread.size());
     for (int i = 0; i < mMapReaderThread.size(); i++) {
         mMapReaderThread[i] = new InterruptibleThread;
-        mMapReaderWorker[i] = new MapReaderWorker(mMapReaderThread[i], i);
+        mMapReaderWorker[i] = new MapReaderWorker(mMapReaderThread[i], &mMapReaderJobs,
+                                                  TilesetManager::instance()->missingTile());
         mMapReaderWorker[i]->moveToThread(mMapReaderThread[i]);
         connect(mMapReaderWorker[i], qOverload<Map*,MapInfo*>(&MapReaderWorker::loaded),
                 this, &MapManager::mapLoadedByThread);
@@ -115,6 +123,7 @@ MapManager::MapManager() :
 
 MapManager::~MapManager()
 {
+    mMapReaderJobs.clear();
     for (int i = 0; i < mMapReaderThread.size(); i++) {
         mMapReaderThread[i]->interrupt(); // stop the long-running task
         mMapReaderThread[i]->quit(); // exit the event loop
@@ -201,10 +210,9 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
     if (!mapInfo)
         return nullptr;
     if (mapInfo->mLoading) {
-        foreach (MapReaderWorker *w, mMapReaderWorker)
-            QMetaObject::invokeMethod(w, "possiblyRaisePriority",
-                                      Qt::QueuedConnection, Q_ARG(MapInfo*,mapInfo),
-                                      Q_ARG(int,priority));
+        // Share the load already in progress.
+        mapInfo->mLoadStats.requests++;
+        possiblyRaisePriority(mapInfo, priority);
         if (!asynch) {
             noise() << "WAITING FOR MAP" << mapName << "with priority" << priority;
             Q_ASSERT(mWaitingForMapInfo == nullptr);
@@ -218,7 +226,7 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
                 }
             }
             while (mapInfo->mLoading) {
-                qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+                qApp->processEvents(QEventLoop::ExcludeUserInputEvents | QEventLoop::WaitForMoreEvents);
             }
             mWaitingForMapInfo = nullptr;
             if (!mapInfo->map())
@@ -227,10 +235,7 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
         return mapInfo;
     }
     mapInfo->mLoading = true;
-    QMetaObject::invokeMethod(mMapReaderWorker[mNextThreadForJob], "addJob",
-                              Qt::QueuedConnection, Q_ARG(MapInfo*,mapInfo),
-                              Q_ARG(int,priority));
-    mNextThreadForJob = (mNextThreadForJob + 1) % mMapReaderThread.size();
+    addJob(mapInfo, priority);
 
     if (asynch)
         return mapInfo;
@@ -243,10 +248,6 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
     mWaitingForMapInfo = mapInfo;
 
     PROGRESS progress(tr("Reading %1").arg(fileInfoMap.completeBaseName()));
-    foreach (MapReaderWorker *w, mMapReaderWorker)
-        QMetaObject::invokeMethod(w, "possiblyRaisePriority",
-                                  Qt::QueuedConnection, Q_ARG(MapInfo*,mapInfo),
-                                  Q_ARG(int,priority));
     noise() << "WAITING FOR MAP" << mapName << "with priority" << priority;
     for (int i = 0; i < mDeferredMaps.size(); i++) {
         MapDeferral md = mDeferredMaps[i];
@@ -257,7 +258,7 @@ MapInfo *MapManager::loadMap(const QString &mapName, const QString &relativeTo,
         }
     }
     while (mapInfo->mLoading) {
-        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+        qApp->processEvents(QEventLoop::ExcludeUserInputEvents | QEventLoop::WaitForMoreEvents);
     }
     mWaitingForMapInfo = nullptr;
     if (mapInfo->map())
@@ -578,6 +579,35 @@ void MapManager::mapParametersChanged(MapInfo *mapInfo)
     mapInfo->mTileHeight = map->tileHeight();
 }
 
+bool MapManager::cancelLoad(MapInfo *mapInfo)
+{
+    if (!mapInfo->mLoading || mapInfo == mWaitingForMapInfo)
+        return false;
+    if (!mMapReaderJobs.removeJob(mapInfo))
+        return false;
+    mapInfo->mLoading = false;
+    // Anyone waiting on an asynchronous load must stop waiting.
+    if (!mapInfo->mMap) {
+        mError = tr("Loading was cancelled.\n%1").arg(mapInfo->path());
+        emit mapFailedToLoad(mapInfo);
+    }
+    return true;
+}
+
+void MapManager::addJob(MapInfo *mapInfo, int priority)
+{
+    mapInfo->mLoadStats = MapLoadStats();
+    mapInfo->mLoadStats.requests = 1;
+    mMapReaderJobs.addJob(mapInfo, priority);
+    foreach (MapReaderWorker *w, mMapReaderWorker)
+        QMetaObject::invokeMethod(w, "jobsAdded", Qt::QueuedConnection);
+}
+
+void MapManager::possiblyRaisePriority(MapInfo *mapInfo, int priority)
+{
+    mMapReaderJobs.possiblyRaisePriority(mapInfo, priority);
+}
+
 #ifdef WORLDED
 void MapManager::addReferenceToMap(MapInfo *mapInfo)
 {
@@ -700,10 +730,7 @@ void MapManager::fileChangedTimeout()
                     Q_ASSERT(!mapInfo->isBeingEdited());
                     if (!mapInfo->isLoading()) {
                         mapInfo->mLoading = true; // FIXME: seems weird to change this for a loaded map
-                        QMetaObject::invokeMethod(mMapReaderWorker[mNextThreadForJob], "addJob",
-                                                  Qt::QueuedConnection, Q_ARG(MapInfo*,mapInfo),
-                                                  Q_ARG(int,PriorityLow));
-                        mNextThreadForJob = (mNextThreadForJob + 1) % mMapReaderThread.size();
+                        addJob(mapInfo, PriorityLow);
                     }
                 }
                 {
@@ -757,16 +784,9 @@ void MapManager::mapLoadedByThread(Map *map, MapInfo *mapInfo)
 
     MapManagerDeferral deferral;
 
-    Tile *missingTile = TilesetManager::instance()->missingTile();
-    foreach (Tileset *tileset, map->missingTilesets()) {
-        if (tileset == missingTile->tileset())
-            continue;
-        if (tileset->tileHeight() == missingTile->height() && tileset->tileWidth() == missingTile->width()) {
-            // Replace the all-red image with something nicer.
-            for (int i = 0; i < tileset->tileCount(); i++)
-                tileset->tileAt(i)->setImage(missingTile);
-        }
-    }
+    QElapsedTimer timer;
+    timer.start();
+
     TilesetManager::instance()->addReferences(map->tilesets());
 
     bool replace = mapInfo->mMap != 0;
@@ -787,6 +807,13 @@ void MapManager::mapLoadedByThread(Map *map, MapInfo *mapInfo)
     mapInfo->mPlaceholder = false;
     mapInfo->mLoading = false;
 
+    MapLoadStats &stats = mapInfo->mLoadStats;
+    stats.install = timer.elapsed();
+    qCInfo(lcMapLoad) << "MAP LOAD STATS" << QFileInfo(mapInfo->path()).fileName()
+                      << "queued" << stats.queued << "parse" << stats.parse
+                      << "resolve" << stats.resolve << "install" << stats.install
+                      << "requests" << stats.requests;
+
     if (replace)
         emit mapChanged(mapInfo);
 
@@ -803,6 +830,9 @@ void MapManager::buildingLoadedByThread(Building *building, MapInfo *mapInfo)
 {
     MapManagerDeferral deferral;
 
+    QElapsedTimer timer;
+    timer.start();
+
     BuildingReader reader;
     reader.fix(building);
 
@@ -825,6 +855,8 @@ void MapManager::buildingLoadedByThread(Building *building, MapInfo *mapInfo)
     // to them ourself below.
     TilesetManager::instance()->removeReferences(map->tilesets());
 
+    mapInfo->mLoadStats.resolve = timer.elapsed();
+
     mapLoadedByThread(map, mapInfo);
 }
 
@@ -868,78 +900,137 @@ void MapManager::processDeferrals()
 
 /////
 
-MapReaderWorker::MapReaderWorker(InterruptibleThread *thread, int id) :
-    BaseWorker(thread),
-    mID(id)
+void MapReaderJobs::addJob(MapInfo *mapInfo, int priority)
 {
+    QMutexLocker locker(&mMutex);
+
+    Job job(mapInfo, priority);
+    job.queued.start();
+
+    int index = 0;
+    while ((index < mJobs.size()) && (mJobs[index].priority >= priority))
+        ++index;
+
+    mJobs.insert(index, job);
+    debugJobs("add job");
 }
 
-MapReaderWorker::~MapReaderWorker()
+bool MapReaderJobs::takeJob(Job &job)
 {
+    QMutexLocker locker(&mMutex);
+    if (mJobs.isEmpty())
+        return false;
+    job = mJobs.takeFirst();
+    debugJobs("take job");
+    return true;
 }
 
-void MapReaderWorker::work()
+void MapReaderJobs::possiblyRaisePriority(MapInfo *mapInfo, int priority)
 {
-    IN_WORKER_THREAD
+    QMutexLocker locker(&mMutex);
 
-    if (mJobs.size()) {
-        if (aborted()) {
-            mJobs.clear();
-            return;
+    for (int i = 0; i < mJobs.size(); i++) {
+        if (mJobs[i].mapInfo == mapInfo && mJobs[i].priority < priority) {
+            int j;
+            for (j = i - 1; j >= 0 && mJobs[j].priority < priority; j--) {}
+            mJobs[i].priority = priority;
+            mJobs.move(i, j + 1);
+            debugJobs("raise priority");
+            break;
         }
+    }
+}
 
-        Job job = mJobs.takeFirst();
-        debugJobs("take job");
+bool MapReaderJobs::removeJob(MapInfo *mapInfo)
+{
+    QMutexLocker locker(&mMutex);
 
-        if (job.mapInfo->path().endsWith(QLatin1String(".tbx"))) {
-            Building *building = loadBuilding(job.mapInfo);
-            if (building)
-                emit loaded(building, job.mapInfo);
-            else
-                emit failedToLoad(mError, job.mapInfo);
-        } else {
-//            noise() << "READING STARTED" << job.mapInfo->path();
-            Map *map = loadMap(job.mapInfo);
-//            noise() << "READING FINISHED" << job.mapInfo->path();
-            if (map)
-                emit loaded(map, job.mapInfo);
-            else
-                emit failedToLoad(mError, job.mapInfo);
+    for (int i = 0; i < mJobs.size(); i++) {
+        if (mJobs[i].mapInfo == mapInfo) {
+            mJobs.removeAt(i);
+            debugJobs("remove job");
+            return true;
         }
+    }
+    return false;
+}
+
+void MapReaderJobs::clear()
+{
+    QMutexLocker locker(&mMutex);
+    mJobs.clear();
+}
 
-//        QCoreApplication::processEvents(); // handle changing job priority
+void MapReaderJobs::debugJobs(const char *msg)
+{
+    QStringList out;
+    foreach (Job job, mJobs) {
+        out += QString::fromLatin1("    %1 priority=%2\n").arg(QFileInfo(job.mapInfo->path()).fileName()).arg(job.priority);
     }
+    noise() << "MapReaderJobs: " << msg << "\n" << out;
+}
+
+/////
 
-    if (mJobs.size()) scheduleWork();
+MapReaderWorker::MapReaderWorker(InterruptibleThread *thread, MapReaderJobs *jobs,
+                                 Tile *missingTile) :
+    BaseWorker(thread),
+    mJobs(jobs),
+    mMissingTile(missingTile)
+{
+}
+
+MapReaderWorker::~MapReaderWorker()
+{
 }
 
-void MapReaderWorker::addJob(MapInfo *mapInfo, int priority)
+void MapReaderWorker::work()
 {
     IN_WORKER_THREAD
 
-    int index = 0;
-    while ((index < mJobs.size()) && (mJobs[index].priority >= priority))
-        ++index;
+    if (aborted())
+        return;
 
-    mJobs.insert(index, Job(mapInfo, priority));
-    debugJobs("add job");
+    MapReaderJobs::Job job(nullptr, 0);
+    if (!mJobs->takeJob(job))
+        return;
+
+    // The app thread doesn't touch these until it receives one of the
+    // signals below.
+    MapLoadStats &stats = job.mapInfo->mLoadStats;
+    stats.queued = job.queued.elapsed();
+    QElapsedTimer timer;
+    timer.start();
+
+    if (job.mapInfo->path().endsWith(QLatin1String(".tbx"))) {
+        Building *building = loadBuilding(job.mapInfo);
+        stats.parse = timer.elapsed();
+        if (building)
+            emit loaded(building, job.mapInfo);
+        else
+            emit failedToLoad(mError, job.mapInfo);
+    } else {
+//        noise() << "READING STARTED" << job.mapInfo->path();
+        Map *map = loadMap(job.mapInfo);
+//        noise() << "READING FINISHED" << job.mapInfo->path();
+        stats.parse = timer.restart();
+        if (map) {
+            resolveMissingTilesets(map);
+            stats.resolve = timer.elapsed();
+            emit loaded(map, job.mapInfo);
+        } else
+            emit failedToLoad(mError, job.mapInfo);
+    }
+
+    // Keep taking jobs until the shared queue is empty.
     scheduleWork();
 }
 
-void MapReaderWorker::possiblyRaisePriority(MapInfo *mapInfo, int priority)
+void MapReaderWorker::jobsAdded()
 {
     IN_WORKER_THREAD
 
-    for (int i = 0; i < mJobs.size(); i++) {
-        if (mJobs[i].mapInfo == mapInfo && mJobs[i].priority < priority) {
-            int j;
-            for (j = i - 1; j >= 0 && mJobs[j].priority < priority; j--) {}
-            mJobs[i].priority = priority;
-            mJobs.move(i, j + 1);
-            debugJobs("raise priority");
-            break;
-        }
-    }
+    scheduleWork();
 }
 
 class MapReaderWorker_MapReader : public MapReader
@@ -978,11 +1069,15 @@ Building *MapReaderWorker::loadBuilding(MapInfo *mapInfo)
     return building;
 }
 
-void MapReaderWorker::debugJobs(const char *msg)
+void MapReaderWorker::resolveMissingTilesets(Map *map)
 {
-    QStringList out;
-    foreach (Job job, mJobs) {
-        out += QString::fromLatin1("    %1 priority=%2\n").arg(QFileInfo(job.mapInfo->path()).fileName()).arg(job.priority);
+    foreach (Tileset *tileset, map->missingTilesets()) {
+        if (tileset == mMissingTile->tileset())
+            continue;
+        if (tileset->tileHeight() == mMissingTile->height() && tileset->tileWidth() == mMissingTile->width()) {
+            // Replace the all-red image with something nicer.
+            for (int i = 0; i < tileset->tileCount(); i++)
+                tileset->tileAt(i)->setImage(mMissingTile);
+        }
     }
-    noise() << "MRW #" << mID << ": " << msg << "\n" << out;
 }
@@ -23,6 +23,7 @@
 #include "threads.h"
 
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QMap>
 #include <QTimer>
 
@@ -32,11 +33,43 @@ namespace BuildingEditor {
 class Building;
 }
 
+// Maps waiting to be read, highest priority first.  Shared by all the
+// MapReaderWorkers so an idle worker always takes the next job.
+class MapReaderJobs
+{
+public:
+    class Job {
+    public:
+        Job(MapInfo *mapInfo, int priority) :
+            mapInfo(mapInfo),
+            priority(priority)
+        {
+        }
+
+        MapInfo *mapInfo;
+        int priority;
+        QElapsedTimer queued;
+    };
+
+    void addJob(MapInfo *mapInfo, int priority);
+    bool takeJob(Job &job);
+    void possiblyRaisePriority(MapInfo *mapInfo, int priority);
+    bool removeJob(MapInfo *mapInfo);
+    void clear();
+
+private:
+    void debugJobs(const char *msg);
+
+    QMutex mMutex;
+    QList<Job> mJobs;
+};
+
 class MapReaderWorker : public BaseWorker
 {
     Q_OBJECT
 public:
-    MapReaderWorker(InterruptibleThread *thread, int id);
+    MapReaderWorker(InterruptibleThread *thread, MapReaderJobs *jobs,
+                    Tiled::Tile *missingTile);
     ~MapReaderWorker();
 
 signals:
@@ -46,32 +79,37 @@ signals:
 
 public slots:
     void work();
-    void addJob(MapInfo *mapInfo, int priority);
-    void possiblyRaisePriority(MapInfo *mapInfo, int priority);
+    void jobsAdded();
 
 private:
     Tiled::Map *loadMap(MapInfo *mapInfo);
     BuildingEditor::Building *loadBuilding(MapInfo *mapInfo);
+    void resolveMissingTilesets(Tiled::Map *map);
 
-    class Job {
-    public:
-        Job(MapInfo *mapInfo, int priority) :
-            mapInfo(mapInfo),
-            priority(priority)
-        {
-        }
-
-        MapInfo *mapInfo;
-        int priority;
-    };
-    QList<Job> mJobs;
-
-    int mID;
-    void debugJobs(const char *msg);
+    MapReaderJobs *mJobs;
+    Tiled::Tile *mMissingTile;
 
     QString mError;
 };
 
+// Milliseconds spent on each step of the last load of a map.
+struct MapLoadStats
+{
+    MapLoadStats() :
+        queued(0),
+        parse(0),
+        resolve(0),
+        install(0),
+        requests(0)
+    {}
+
+    qint64 queued; // waiting for a reader thread
+    qint64 parse; // reading the file, on a reader thread
+    qint64 resolve; // missing tilesets for .tmx, BuildingMap for .tbx
+    qint64 install; // tileset references and replacing the old map
+    int requests; // loadMap() calls that shared this load
+};
+
 class MapInfo
 {
 public:
@@ -115,6 +153,8 @@ public:
 
     bool isLoading() const { return mLoading; }
 
+    const MapLoadStats &loadStats() const { return mLoadStats; }
+
     void setProperties(const Tiled::Properties &properties)
     {
         mProperties = properties;
@@ -136,9 +176,11 @@ private:
     int mReferenceEpoch;
 #endif
     bool mLoading;
+    MapLoadStats mLoadStats;
     Tiled::Properties mProperties;
 
     friend class MapManager;
+    friend class MapReaderWorker;
 };
 
 class MapManager : public QObject
@@ -193,6 +235,16 @@ public:
       * Call this when the map's size or tile size changes.
       */
     void mapParametersChanged(MapInfo *mapInfo);
+
+    /**
+      * Removes a queued asynchronous load of a map that is no longer needed.
+      * Returns false if the map isn't waiting to be read; a map already being
+      * read by a worker thread can't be cancelled.
+      * Nothing calls this yet.  Every asynchronous loadMap() of a path shares
+      * one MapInfo and nobody counts the waiters, so a caller must know it is
+      * the only one waiting; the others would get mapFailedToLoad().
+      */
+    bool cancelLoad(MapInfo *mapInfo);
 #ifdef WORLDED
     void addReferenceToMap(MapInfo *mapInfo);
     void removeReferenceToMap(MapInfo *mapInfo);
@@ -255,9 +307,12 @@ private:
     bool mDeferralQueued;
     MapInfo *mWaitingForMapInfo;
 
+    void addJob(MapInfo *mapInfo, int priority);
+    void possiblyRaisePriority(MapInfo *mapInfo, int priority);
+
     QVector<InterruptibleThread*> mMapReaderThread;
     QVector<MapReaderWorker*> mMapReaderWorker;
-    int mNextThreadForJob;
+    MapReaderJobs mMapReaderJobs;
 #ifdef WORLDED
     int mReferenceEpoch;
 #endif
@@ -55,50 +55,37 @@ bool NewMapBinaryFile::write(MapComposite *mapComposite, const QString &filePath
     }
 */
 
-    int mapWidth = mapInfo->width();
-    int mapHeight = mapInfo->height();
+    mMapWidth = mapInfo->width();
+    mMapHeight = mapInfo->height();
+    mIsometric = mapInfo->orientation() == Map::Isometric;
 
-    int NUM_CHUNKS_X = (mapInfo->width() + CHUNK_WIDTH - 1) / CHUNK_WIDTH;
-    int NUM_CHUNKS_Y = (mapInfo->height() + CHUNK_HEIGHT - 1) / CHUNK_HEIGHT;
-
-    // Resize the grid and cleanup data from the previous cell.
-    mGridData.resize(NUM_CHUNKS_X * CHUNK_WIDTH);
-    for (int x = 0; x < NUM_CHUNKS_X * CHUNK_WIDTH; x++) {
-        mGridData[x].resize(NUM_CHUNKS_Y * CHUNK_HEIGHT);
-        for (int y = 0; y < NUM_CHUNKS_Y * CHUNK_HEIGHT; y++) {
-            mGridData[x][y].fill(LotFile::Square(), MaxLevel);
-        }
-    }
+    int NUM_CHUNKS_X = (mMapWidth + CHUNK_WIDTH - 1) / CHUNK_WIDTH;
+    int NUM_CHUNKS_Y = (mMapHeight + CHUNK_HEIGHT - 1) / CHUNK_HEIGHT;
 
-    Tile *missingTile = Tiled::Internal::TilesetManager::instance()->missingTile();
-    QVector<const Tiled::Cell *> cells(40);
+    mMissingTile = Tiled::Internal::TilesetManager::instance()->missingTile();
+    mLayerGroups.fill(nullptr, MaxLevel);
     for (CompositeLayerGroup *lg : mapComposite->layerGroups()) {
         lg->prepareDrawing2();
-        int d = (mapInfo->orientation() == Map::Isometric) ? -3 : 0;
-        d *= lg->level();
-        for (int y = d; y < mapHeight; y++) {
-            for (int x = d; x < mapWidth; x++) {
-                cells.resize(0);
-                lg->orderedCellsAt2(QPoint(x, y), cells);
-                for (const Tiled::Cell *cell : cells) {
-                    if (cell->tile == missingTile) continue;
-                    int lx = x, ly = y;
-                    if (mapInfo->orientation() == Map::Isometric) {
-                        lx = x + lg->level() * 3;
-                        ly = y + lg->level() * 3;
-                    }
-                    if (lx >= mapWidth) continue;
-                    if (ly >= mapHeight) continue;
-                    LotFile::Entry *e = new LotFile::Entry(cellToGid(cell));
-                    mGridData[lx][ly][lg->level()].Entries.append(e);
-                    mTileMap[e->gid]->used = true;
-                }
+        mLayerGroups[lg->level()] = lg;
+    }
+
+    // The header lists every used tile before any chunk is written, so
+    // the cells are visited once here without keeping them, and again
+    // one chunk at a time by generateChunk().
+    QVector<uint> gids;
+    for (int z = 0; z < MaxLevel; z++) {
+        for (int y = 0; y < mMapHeight; y++) {
+            for (int x = 0; x < mMapWidth; x++) {
+                gids.resize(0);
+                gidsAt(x, y, z, gids);
+                for (uint gid : gids)
+                    mTileMap[gid]->used = true;
             }
         }
     }
 
     QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly /*| QIODevice::Text*/)) {
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
         mError = tr("Could not open file for writing.");
         return false;
     }
@@ -106,7 +93,7 @@ bool NewMapBinaryFile::write(MapComposite *mapComposite, const QString &filePath
     QDataStream out(&file);
     out.setByteOrder(QDataStream::LittleEndian);
 
-    generateBuildingObjects(mapWidth, mapHeight);
+    generateBuildingObjects(mMapWidth, mMapHeight);
 
     if (!generateHeaderAux(out, mapComposite))
         return false;
@@ -118,7 +105,8 @@ bool NewMapBinaryFile::write(MapComposite *mapComposite, const QString &filePath
         out << qint64(m);
     }
 
-    QList<qint64> PositionMap;
+    QVector<qint64> PositionMap;
+    PositionMap.reserve(NUM_CHUNKS_X * NUM_CHUNKS_Y);
 
     for (int y = 0; y < NUM_CHUNKS_Y; y++) {
         for (int x = 0; x < NUM_CHUNKS_X; x++) {
@@ -128,18 +116,13 @@ bool NewMapBinaryFile::write(MapComposite *mapComposite, const QString &filePath
         }
     }
 
-    file.close();
-    if (!file.open(QIODevice::ReadWrite | QIODevice::Append)) {
-        mError = tr("Could not open file for writing.");
+    // Patch the chunk table now that the chunk positions are known.
+    if (!file.seek(chunkTablePosition)) {
+        mError = file.errorString();
         return false;
     }
-    file.seek(chunkTablePosition);
-
-    QDataStream out2(&file);
-    out2.setByteOrder(QDataStream::LittleEndian);
-
     for (int m = 0; m < NUM_CHUNKS_X * NUM_CHUNKS_Y; m++) {
-        out2 << qint64(PositionMap[m]);
+        out << qint64(PositionMap[m]);
     }
 
     file.close();
@@ -181,7 +164,8 @@ bool NewMapBinaryFile::generateHeader(MapComposite *mapComposite)
     mTileMap.clear();
     mTileMap[0] = new LotFile::Tile;
 
-    mTilesetToFirstGid.clear();
+    mGidMapper.clear();
+    mTilesetNameToFirstGid.clear();
     uint firstGid = 1;
     for (Tileset *tileset : tilesets) {
         if (!handleTileset(tileset, firstGid)) {
@@ -366,28 +350,46 @@ bool NewMapBinaryFile::generateChunk(QDataStream &out, MapComposite *mapComposit
 {
     Q_UNUSED(mapComposite)
 
+    // Remember the room at each position in the chunk.  Where rooms overlap
+    // the last one in roomList wins.
+    QRect chunkBounds(cx * CHUNK_WIDTH, cy * CHUNK_HEIGHT, CHUNK_WIDTH, CHUNK_HEIGHT);
+    mChunkRoomIDs.fill(-1, MaxLevel * CHUNK_WIDTH * CHUNK_HEIGHT);
+    for (LotFile::Room *room : roomList) {
+        for (LotFile::RoomRect *rr : room->rects) {
+            QRect r = rr->bounds() & chunkBounds;
+            for (int y = r.top(); y <= r.bottom(); y++) {
+                for (int x = r.left(); x <= r.right(); x++) {
+                    int index = (room->floor * CHUNK_HEIGHT + y - chunkBounds.top()) * CHUNK_WIDTH
+                            + x - chunkBounds.left();
+                    mChunkRoomIDs[index] = room->ID;
+                }
+            }
+        }
+    }
+
     int notdonecount = 0;
     for (int z = 0; z < MaxLevel; z++)  {
         for (int x = 0; x < CHUNK_WIDTH; x++) {
             for (int y = 0; y < CHUNK_HEIGHT; y++) {
                 int gx = cx * CHUNK_WIDTH + x;
                 int gy = cy * CHUNK_HEIGHT + y;
-                const QList<LotFile::Entry*> &entries = mGridData[gx][gy][z].Entries;
-                if (entries.count() == 0) {
+                mChunkGids.resize(0);
+                gidsAt(gx, gy, z, mChunkGids);
+                if (mChunkGids.isEmpty()) {
                     notdonecount++;
-                } else {
-                    if (notdonecount > 0) {
-                        out << qint32(-1);
-                        out << qint32(notdonecount);
-                    }
-                    notdonecount = 0;
-                    out << qint32(entries.count() + 1);
-                    out << qint32(getRoomID(gx, gy, z));
+                    continue;
+                }
+                if (notdonecount > 0) {
+                    out << qint32(-1);
+                    out << qint32(notdonecount);
                 }
-                for (LotFile::Entry *entry : entries) {
-                    Q_ASSERT(mTileMap[entry->gid]);
-                    Q_ASSERT(mTileMap[entry->gid]->id != -1);
-                    out << qint32(mTileMap[entry->gid]->id);
+                notdonecount = 0;
+                out << qint32(mChunkGids.size() + 1);
+                out << qint32(mChunkRoomIDs[(z * CHUNK_HEIGHT + y) * CHUNK_WIDTH + x]);
+                for (uint gid : mChunkGids) {
+                    Q_ASSERT(mTileMap[gid]);
+                    Q_ASSERT(mTileMap[gid]->id != -1);
+                    out << qint32(mTileMap[gid]->id);
                 }
             }
         }
@@ -414,14 +416,12 @@ void NewMapBinaryFile::generateBuildingObjects(int mapWidth, int mapHeight,
 {
     for (int x = rr->x; x < rr->x + rr->w; x++) {
         for (int y = rr->y; y < rr->y + rr->h; y++) {
-
-            // Remember the room at each position in the map.
-            mGridData[x][y][room->floor].roomID = room->ID;
-
             /* Examine every tile inside the room.  If the tile's metaEnum >= 0
                then create a new RoomObject for it. */
-            for (LotFile::Entry *entry : mGridData[x][y][room->floor].Entries) {
-                int metaEnum = mTileMap[entry->gid]->metaEnum;
+            mChunkGids.resize(0);
+            gidsAt(x, y, room->floor, mChunkGids);
+            for (uint gid : mChunkGids) {
+                int metaEnum = mTileMap[gid]->metaEnum;
                 if (metaEnum >= 0) {
                     LotFile::RoomObject object;
                     object.x = x;
@@ -438,8 +438,10 @@ void NewMapBinaryFile::generateBuildingObjects(int mapWidth, int mapHeight,
     int y = rr->y + rr->h;
     if (y < mapHeight) {
         for (int x = rr->x; x < rr->x + rr->w; x++) {
-            for (LotFile::Entry *entry : mGridData[x][y][room->floor].Entries) {
-                int metaEnum = mTileMap[entry->gid]->metaEnum;
+            mChunkGids.resize(0);
+            gidsAt(x, y, room->floor, mChunkGids);
+            for (uint gid : mChunkGids) {
+                int metaEnum = mTileMap[gid]->metaEnum;
                 if (metaEnum >= 0 && TileMetaInfoMgr::instance()->isEnumNorth(metaEnum)) {
                     LotFile::RoomObject object;
                     object.x = x;
@@ -456,8 +458,10 @@ void NewMapBinaryFile::generateBuildingObjects(int mapWidth, int mapHeight,
     int x = rr->x + rr->w;
     if (x < mapWidth) {
         for (int y = rr->y; y < rr->y + rr->h; y++) {
-            for (LotFile::Entry *entry : mGridData[x][y][room->floor].Entries) {
-                int metaEnum = mTileMap[entry->gid]->metaEnum;
+            mChunkGids.resize(0);
+            gidsAt(x, y, room->floor, mChunkGids);
+            for (uint gid : mChunkGids) {
+                int metaEnum = mTileMap[gid]->metaEnum;
                 if (metaEnum >= 0 && TileMetaInfoMgr::instance()->isEnumWest(metaEnum)) {
                     LotFile::RoomObject object;
                     object.x = x - 1;
@@ -481,7 +485,7 @@ QString NewMapBinaryFile::nameOfTileset(const Tileset *tileset)
     return name;
 }
 
-bool NewMapBinaryFile::handleTileset(const Tiled::Tileset *tileset, uint &firstGid)
+bool NewMapBinaryFile::handleTileset(Tiled::Tileset *tileset, uint &firstGid)
 {
     if (!tileset->fileName().isEmpty()) {
         mError = tr("Only tileset image files supported, not external tilesets");
@@ -492,15 +496,9 @@ bool NewMapBinaryFile::handleTileset(const Tiled::Tileset *tileset, uint &firstG
 
     // TODO: Verify that two tilesets sharing the same name are identical
     // between maps.
-    QMap<const Tileset*,uint>::const_iterator i = mTilesetToFirstGid.begin();
-    QMap<const Tileset*,uint>::const_iterator i_end = mTilesetToFirstGid.end();
-    while (i != i_end) {
-        QString name2 = nameOfTileset(i.key());
-        if (name == name2) {
-            mTilesetToFirstGid.insert(tileset, i.value());
-            return true;
-        }
-        ++i;
+    if (mTilesetNameToFirstGid.contains(name)) {
+        mGidMapper.insert(mTilesetNameToFirstGid[name], tileset);
+        return true;
     }
 
     for (int i = 0; i < tileset->tileCount(); ++i) {
@@ -511,30 +509,39 @@ bool NewMapBinaryFile::handleTileset(const Tiled::Tileset *tileset, uint &firstG
         mTileMap[ID] = tile;
     }
 
-    mTilesetToFirstGid.insert(tileset, firstGid);
+    mGidMapper.insert(firstGid, tileset);
+    mTilesetNameToFirstGid.insert(name, firstGid);
     firstGid += uint(tileset->tileCount());
 
     return true;
 }
 
-int NewMapBinaryFile::getRoomID(int x, int y, int z)
+// Appends the GIDs of the tiles drawn at x,y on the given level.
+void NewMapBinaryFile::gidsAt(int x, int y, int level, QVector<uint> &gids)
 {
-    return mGridData[x][y][z].roomID;
+    if (x < 0 || x >= mMapWidth || y < 0 || y >= mMapHeight)
+        return;
+    CompositeLayerGroup *lg = mLayerGroups.value(level);
+    if (lg == nullptr)
+        return;
+    if (mIsometric) {
+        x -= level * 3;
+        y -= level * 3;
+    }
+    mCells.resize(0);
+    lg->orderedCellsAt2(QPoint(x, y), mCells);
+    for (const Tiled::Cell *cell : mCells) {
+        if (cell->tile == mMissingTile) continue;
+        gids += cellToGid(cell);
+    }
 }
 
 uint NewMapBinaryFile::cellToGid(const Cell *cell)
 {
-    Tileset *tileset = cell->tile->tileset();
-
-    QMap<const Tileset*,uint>::const_iterator i = mTilesetToFirstGid.begin();
-    QMap<const Tileset*,uint>::const_iterator i_end = mTilesetToFirstGid.end();
-    while (i != i_end && i.key() != tileset) {
-        ++i;
-    }
-    if (i == i_end) {// tileset not found
+    uint firstGid = mGidMapper.firstGid(cell->tile->tileset());
+    if (firstGid == 0) // tileset not found
         return 0;
-    }
-    return i.value() + uint(cell->tile->id());
+    return firstGid + uint(cell->tile->id());
 }
 
 bool NewMapBinaryFile::processObjectGroups(MapComposite *mapComposite)
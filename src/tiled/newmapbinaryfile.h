@@ -1,12 +1,16 @@
 #ifndef TMXBINARY_H
 #define TMXBINARY_H
 
+#include "gidmapper.h"
+
+#include <QHash>
 #include <QMap>
 #include <QObject>
 #include <QRect>
 #include <QString>
 #include <QVector>
 
+class CompositeLayerGroup;
 class MapComposite;
 
 namespace Tiled {
@@ -55,41 +59,6 @@ public:
     int h;
 };
 
-class Entry
-{
-public:
-    Entry(uint gid) :
-        gid(gid)
-    {
-    }
-
-    uint gid;
-};
-
-class Square
-{
-public:
-    Square() :
-        roomID(-1)
-    {
-
-    }
-    ~Square()
-    {
-        qDeleteAll(Entries);
-    }
-    Square &operator=(const Square &other)
-    {
-        qDeleteAll(Entries);
-        Entries = other.Entries;
-        roomID = other.roomID;
-        return *this;
-    }
-
-    QList<Entry*> Entries;
-    int roomID;
-};
-
 class Zone
 {
 public:
@@ -259,9 +228,7 @@ public:
     void generateBuildingObjects(int mapWidth, int mapHeight,
                                  LotFile::Room *room, LotFile::RoomRect *rr);
     QString nameOfTileset(const Tiled::Tileset *tileset);
-    bool handleTileset(const Tiled::Tileset *tileset, uint &firstGid);
-
-    int getRoomID(int x, int y, int z);
+    bool handleTileset(Tiled::Tileset *tileset, uint &firstGid);
 
     QString errorString() const { return mError; }
 
@@ -269,6 +236,7 @@ signals:
 
 private:
     uint cellToGid(const Tiled::Cell *cell);
+    void gidsAt(int x, int y, int level, QVector<uint> &gids);
     bool processObjectGroups(MapComposite *mapComposite);
     bool processObjectGroup(Tiled::ObjectGroup *objectGroup,
                             int levelOffset, const QPoint &offset);
@@ -276,10 +244,18 @@ private:
 
 private:
     QList<LotFile::Zone*> ZoneList;
-    QMap<const Tiled::Tileset*,uint> mTilesetToFirstGid;
+    Tiled::GidMapper mGidMapper;
+    QHash<QString,uint> mTilesetNameToFirstGid;
     Tiled::Tileset *mJumboTreeTileset;
     QMap<uint,LotFile::Tile*> mTileMap;
-    QVector<QVector<QVector<LotFile::Square> > > mGridData;
+    QVector<CompositeLayerGroup*> mLayerGroups; // indexed by level
+    Tiled::Tile *mMissingTile;
+    int mMapWidth;
+    int mMapHeight;
+    bool mIsometric;
+    QVector<const Tiled::Cell*> mCells;
+    QVector<uint> mChunkGids;
+    QVector<int> mChunkRoomIDs; // MaxLevel * CHUNK_WIDTH * CHUNK_HEIGHT
     int MaxLevel;
     int Version;
     QList<LotFile::RoomRect*> mRoomRects;
@@ -135,6 +135,9 @@ HEADERS += BuildingEditor/buildingeditorwindow.h \
     BuildingEditor/furnituregroups.h \
     BuildingEditor/buildingpreferences.h \
     BuildingEditor/buildingtmx.h \
+    BuildingEditor/buildingbatchexport.h \
+    BuildingEditor/buildingbenchmark.h \
+    BuildingEditor/tilenametable.h \
     BuildingEditor/tilecategoryview.h \
     BuildingEditor/listofstringsdialog.h \
     BuildingEditor/horizontallinedelegate.h \
@@ -190,6 +193,9 @@ SOURCES += BuildingEditor/simplefile.cpp \
     BuildingEditor/furnituregroups.cpp \
     BuildingEditor/buildingpreferences.cpp \
     BuildingEditor/buildingtmx.cpp \
+    BuildingEditor/buildingbatchexport.cpp \
+    BuildingEditor/buildingbenchmark.cpp \
+    BuildingEditor/tilenametable.cpp \
     BuildingEditor/tilecategoryview.cpp \
     BuildingEditor/listofstringsdialog.cpp \
     BuildingEditor/horizontallinedelegate.cpp \
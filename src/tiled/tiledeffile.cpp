@@ -26,7 +26,9 @@
 #include <QDataStream>
 #include <QDir>
 #include <QFile>
+#include <QHash>
 #include <QImageReader>
+#include <QtEndian>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -40,22 +42,102 @@ TileDefFile::~TileDefFile()
     qDeleteAll(mTilesets);
 }
 
-static QString ReadString(QDataStream &in)
-{
-    QString str;
-    quint8 c = ' ';
-    while (c != '\n') {
-        in >> c;
-        if (c != '\n')
-            str += QLatin1Char(c);
-    }
-    return str;
-}
-
 #define VERSION0 0
 #define VERSION1 1
 #define VERSION_LATEST VERSION1
 
+namespace {
+
+// Parses a .tiles file straight out of a memory-mapped buffer.  Property
+// names and values are interned, and tiles whose properties are stored as
+// identical bytes share one QMap.
+class TileDefReader
+{
+public:
+    TileDefReader(const uchar *data, qint64 size) :
+        mData(data),
+        mEnd(data + size),
+        mError(false)
+    {
+    }
+
+    bool error() const { return mError; }
+    const uchar *pos() const { return mData; }
+
+    bool peek(const char *bytes, int length) const
+    {
+        return (mEnd - mData >= length) && !memcmp(mData, bytes, length);
+    }
+
+    void skip(int length)
+    {
+        mData += qMin(qint64(length), qint64(mEnd - mData));
+    }
+
+    qint32 readInt()
+    {
+        if (mEnd - mData < 4) {
+            mError = true;
+            mData = mEnd;
+            return 0;
+        }
+        qint32 value = qFromLittleEndian<qint32>(mData);
+        mData += 4;
+        return value;
+    }
+
+    QString readString()
+    {
+        const uchar *start = mData;
+        while (mData < mEnd && *mData != '\n')
+            ++mData;
+        if (mData == mEnd) {
+            mError = true;
+            return QString();
+        }
+        QByteArray key = QByteArray::fromRawData((const char*)start, mData - start);
+        ++mData;
+        QHash<QByteArray,QString>::iterator it = mStrings.find(key);
+        if (it == mStrings.end())
+            it = mStrings.insert(QByteArray(key.constData(), key.size()),
+                                 QString::fromLatin1(key.constData(), key.size()));
+        return it.value();
+    }
+
+    QMap<QString,QString> readProperties()
+    {
+        const uchar *start = mData;
+        qint32 numProperties = readInt();
+        QMap<QString,QString> properties;
+        for (int k = 0; k < numProperties && !mError; k++) {
+            QString propertyName = readString();
+            QString propertyValue = readString();
+            properties[propertyName] = propertyValue;
+        }
+        if (mError)
+            return QMap<QString,QString>();
+
+        // Modifying the same input gives the same output, so the raw bytes
+        // identify the result.
+        QByteArray key = QByteArray::fromRawData((const char*)start, mData - start);
+        QHash<QByteArray,QMap<QString,QString> >::const_iterator it = mPropertyMaps.find(key);
+        if (it != mPropertyMaps.end())
+            return it.value();
+        TilePropertyMgr::instance()->modify(properties);
+        mPropertyMaps.insert(QByteArray(key.constData(), key.size()), properties);
+        return properties;
+    }
+
+private:
+    const uchar *mData;
+    const uchar *mEnd;
+    bool mError;
+    QHash<QByteArray,QString> mStrings;
+    QHash<QByteArray,QMap<QString,QString> > mPropertyMaps;
+};
+
+} // namespace
+
 bool TileDefFile::read(const QString &fileName)
 {
     qDeleteAll(mTilesets);
@@ -68,71 +150,69 @@ bool TileDefFile::read(const QString &fileName)
         return false;
     }
 
-    QDir dir = QFileInfo(fileName).absoluteDir();
-
-    QDataStream in(&file);
-    in.setByteOrder(QDataStream::LittleEndian);
+    QByteArray contents;
+    const uchar *data = file.map(0, file.size());
+    if (!data) {
+        contents = file.readAll();
+        data = (const uchar *) contents.constData();
+    }
+    TileDefReader in(data, file.size());
 
-    quint8 tdef[4] = {0};
-    in >> tdef[0];
-    in >> tdef[1];
-    in >> tdef[2];
-    in >> tdef[3];
     int version = VERSION0;
-    if (memcmp(tdef, "tdef", 4) == 0) {
-        in >> version;
+    if (in.peek("tdef", 4)) {
+        in.skip(4);
+        version = in.readInt();
         if (version < 0 || version > VERSION_LATEST) {
             mError = tr("Unknown version number %1 in .tiles file.\n%2")
                     .arg(version).arg(fileName);
             return false;
         }
-    } else
-        file.seek(0);
+    }
 
-    int numTilesets;
-    in >> numTilesets;
-    for (int i = 0; i < numTilesets; i++) {
+    int numTilesets = in.readInt();
+    for (int i = 0; i < numTilesets && !in.error(); i++) {
         TileDefTileset *ts = new TileDefTileset;
-        ts->mName = ReadString(in);
-        ts->mImageSource = ReadString(in); // no path, just file + extension
-        qint32 columns, rows;
-        in >> columns;
-        in >> rows;
+        ts->mName = in.readString();
+        ts->mImageSource = in.readString(); // no path, just file + extension
+        qint32 columns = in.readInt();
+        qint32 rows = in.readInt();
 
         qint32 id = i + 1;
         if (version > VERSION0)
-            in >> id;
+            id = in.readInt();
 
-        qint32 tileCount;
-        in >> tileCount;
+        qint32 tileCount = in.readInt();
 
         ts->mColumns = columns;
         ts->mRows = rows;
         ts->mID = id;
 
-        QVector<TileDefTile*> tiles(columns * rows);
-        for (int j = 0; j < tileCount; j++) {
+        QVector<TileDefTile*> tiles(qMax(columns * rows, 0));
+        for (int j = 0; j < tileCount && !in.error(); j++) {
+            QMap<QString,QString> properties = in.readProperties();
+            if (j >= tiles.size())
+                continue;
             TileDefTile *tile = new TileDefTile(ts, j);
-            qint32 numProperties;
-            in >> numProperties;
-            QMap<QString,QString> properties;
-            for (int k = 0; k < numProperties; k++) {
-                QString propertyName = ReadString(in);
-                QString propertyValue = ReadString(in);
-                properties[propertyName] = propertyValue;
-            }
-            TilePropertyMgr::instance()->modify(properties);
-            tile->mPropertyUI.FromProperties(properties);
             tile->mProperties = properties;
             tiles[j] = tile;
         }
-        for (int j = tileCount; j < tiles.size(); j++) {
-            tiles[j] = new TileDefTile(ts, j);
+        for (int j = 0; j < tiles.size(); j++) {
+            if (!tiles[j])
+                tiles[j] = new TileDefTile(ts, j);
         }
         ts->mTiles = tiles;
+        if (in.error()) {
+            delete ts;
+            break;
+        }
         insertTileset(mTilesets.size(), ts);
     }
 
+    if (in.error()) {
+        mError = tr("Unexpected end of file.\n%1").arg(fileName);
+        return false;
+    }
+
     mFileName = fileName;
 
     return true;
@@ -169,7 +249,13 @@ bool TileDefFile::write(const QString &fileName)
         out << qint32(ts->mTiles.size());
         foreach (TileDefTile *tile, ts->mTiles) {
             QMap<QString,QString> &properties = tile->mProperties;
-            tile->mPropertyUI.ToProperties(properties);
+            if (tile->mPropertyUI)
+                tile->mPropertyUI->ToProperties(properties);
+            else {
+                UIProperties propertyUI;
+                propertyUI.FromProperties(properties);
+                propertyUI.ToProperties(properties);
+            }
             out << qint32(properties.size());
             foreach (QString key, properties.keys()) {
                 SaveString(out, key);
@@ -308,6 +394,17 @@ UIProperties::~UIProperties()
 
 /////
 
+UIProperties &TileDefTile::propertyUI()
+{
+    if (!mPropertyUI) {
+        mPropertyUI = new UIProperties;
+        mPropertyUI->FromProperties(mProperties);
+    }
+    return *mPropertyUI;
+}
+
+/////
+
 TileDefTileset::TileDefTileset(Tileset *ts) :
     mID(0)
 {
@@ -762,45 +762,58 @@ public:
     TileDefTile(TileDefTileset *tileset, int id) :
         mTileset(tileset),
         mID(id),
-        mPropertyUI()
+        mPropertyUI(0)
     {
     }
 
+    ~TileDefTile()
+    {
+        delete mPropertyUI;
+    }
+
     TileDefTileset *tileset() const { return mTileset; }
     int id() const { return mID; }
 
     UIProperties::UIProperty *property(const QString &name)
-    { return mPropertyUI.property(name); }
+    { return propertyUI().property(name); }
 
     bool getBoolean(const QString &name)
     {
-        return mPropertyUI.getBoolean(name);
+        return propertyUI().getBoolean(name);
     }
 
     int getInteger(const QString &name)
     {
-        return mPropertyUI.getInteger(name);
+        return propertyUI().getInteger(name);
     }
 
     QString getString(const QString &name)
     {
-        return mPropertyUI.getString(name);
+        return propertyUI().getString(name);
     }
 
     QString getEnum(const QString &name)
     {
-        return mPropertyUI.getEnum(name);
+        return propertyUI().getEnum(name);
     }
 
+    // Most tiles are never edited, so the UIProperties are only created
+    // from mProperties when first needed.
+    UIProperties &propertyUI();
+
     TileDefTileset *mTileset;
     int mID;
-    UIProperties mPropertyUI;
+    UIProperties *mPropertyUI;
 
     // This is to preserve all the properties that were in the .tiles file
     // for this tile.  If TileProperties.txt changes so that these properties
     // can't be edited they will still persist in the .tiles file.
     // TODO: add a way to report/clean out obsolete properties.
+    // Tiles with the same properties share one implicitly-shared map.
     QMap<QString,QString> mProperties;
+
+private:
+    Q_DISABLE_COPY(TileDefTile)
 };
 
 class TileDefTileset
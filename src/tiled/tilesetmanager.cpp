@@ -28,10 +28,13 @@
 #ifdef ZOMBOID
 #include "preferences.h"
 #include "tile.h"
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QImageReader>
 #include <QMetaType>
+#include <QSaveFile>
 #endif
 
 using namespace Tiled;
@@ -77,12 +80,17 @@ TilesetManager::TilesetManager():
 
     qRegisterMetaType<Tileset*>("Tileset*");
 
+    QString cacheDirectory = Preferences::instance()->configPath(QLatin1String("TilesetCache"));
+    if (!QDir().mkpath(cacheDirectory))
+        cacheDirectory.clear();
+
     mImageReaderThreads.resize(8);
     mImageReaderWorkers.resize(mImageReaderThreads.size());
     mNextThreadForJob = 0;
     for (int i = 0; i < mImageReaderWorkers.size(); i++) {
         mImageReaderThreads[i] = new InterruptibleThread;
-        mImageReaderWorkers[i] = new TilesetImageReaderWorker(i, mImageReaderThreads[i]);
+        mImageReaderWorkers[i] = new TilesetImageReaderWorker(i, mImageReaderThreads[i],
+                                                              cacheDirectory);
         mImageReaderWorkers[i]->moveToThread(mImageReaderThreads[i]);
         connect(mImageReaderWorkers[i], &TilesetImageReaderWorker::imageLoaded,
                 this, qOverload<Tiled::Tileset*,Tiled::Tileset*>(&TilesetManager::imageLoaded));
@@ -794,10 +802,124 @@ void TilesetManager::syncTileLayerNames(Tileset *ts)
 #ifdef ZOMBOID
 /////
 
-TilesetImageReaderWorker::TilesetImageReaderWorker(int id, InterruptibleThread *thread) :
+// Decoded tileset images are cached in the config directory as raw
+// premultiplied pixels that are read straight into a QImage on the next load,
+// skipping the PNG decode.  The cache files use the native byte order; they
+// are only read on the machine that wrote them.
+
+#define TILESET_CACHE_MAGIC 0x43535454 // "TTSC"
+#define TILESET_CACHE_VERSION 1
+
+namespace {
+
+struct TilesetCacheHeader
+{
+    quint32 magic;
+    quint32 version;
+    qint64 sourceModified; // msecs since epoch
+    qint64 sourceSize;
+    qint32 width;
+    qint32 height;
+    qint32 bytesPerLine;
+    qint32 pathLength; // QChars of the source path after the header
+    qint64 pixelOffset;
+};
+
+} // anonymous namespace
+
+static QString tilesetCacheFile(const QString &cacheDirectory, const QString &source)
+{
+    QByteArray hash = QCryptographicHash::hash(source.toUtf8(), QCryptographicHash::Sha1);
+    return cacheDirectory + QLatin1Char('/') + QString::fromLatin1(hash.toHex())
+            + QLatin1String(".bin");
+}
+
+static QImage readTilesetCache(const QString &cacheDirectory, const QString &source)
+{
+    QFileInfo sourceInfo(source);
+    QFile file(tilesetCacheFile(cacheDirectory, source));
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+
+    TilesetCacheHeader header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header))
+        return QImage();
+    if (header.magic != TILESET_CACHE_MAGIC || header.version != TILESET_CACHE_VERSION)
+        return QImage();
+    if (header.sourceModified != sourceInfo.lastModified().toMSecsSinceEpoch()
+            || header.sourceSize != sourceInfo.size())
+        return QImage();
+    if (header.pathLength != source.length())
+        return QImage();
+    QByteArray path = file.read(header.pathLength * sizeof(QChar));
+    if (path.size() != int(header.pathLength * sizeof(QChar))
+            || QString(reinterpret_cast<const QChar*>(path.constData()), header.pathLength) != source)
+        return QImage();
+
+    qint64 pixelBytes = qint64(header.bytesPerLine) * header.height;
+    if (header.width <= 0 || header.height <= 0 || header.bytesPerLine < header.width * 4
+            || file.size() < header.pixelOffset + pixelBytes)
+        return QImage();
+    if (!file.seek(header.pixelOffset))
+        return QImage();
+
+    // Read into an image that owns its pixels so the file can be closed.
+    // Mapping the file instead kept one descriptor open per tileset.
+    QImage image(header.width, header.height, QImage::Format_ARGB32_Premultiplied);
+    if (image.isNull())
+        return QImage();
+    if (image.bytesPerLine() == header.bytesPerLine) {
+        if (file.read(reinterpret_cast<char*>(image.bits()), pixelBytes) != pixelBytes)
+            return QImage();
+    } else {
+        const int lineBytes = header.width * 4;
+        for (int y = 0; y < header.height; y++) {
+            if (!file.seek(header.pixelOffset + qint64(y) * header.bytesPerLine)
+                    || file.read(reinterpret_cast<char*>(image.scanLine(y)), lineBytes) != lineBytes)
+                return QImage();
+        }
+    }
+
+    return image;
+}
+
+static void writeTilesetCache(const QString &cacheDirectory, const QString &source,
+                              const QImage &image)
+{
+    Q_ASSERT(image.format() == QImage::Format_ARGB32_Premultiplied);
+    QFileInfo sourceInfo(source);
+
+    TilesetCacheHeader header;
+    header.magic = TILESET_CACHE_MAGIC;
+    header.version = TILESET_CACHE_VERSION;
+    header.sourceModified = sourceInfo.lastModified().toMSecsSinceEpoch();
+    header.sourceSize = sourceInfo.size();
+    header.width = image.width();
+    header.height = image.height();
+    header.bytesPerLine = image.bytesPerLine();
+    header.pathLength = source.length();
+    // Keep the pixels aligned for QImage.
+    header.pixelOffset = (sizeof(header) + source.length() * sizeof(QChar) + 15) & ~15;
+
+    QSaveFile file(tilesetCacheFile(cacheDirectory, source));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(source.constData()), source.length() * sizeof(QChar));
+    file.write(QByteArray(int(header.pixelOffset - file.pos()), 0));
+    file.write(reinterpret_cast<const char*>(image.constBits()),
+               qint64(image.bytesPerLine()) * image.height());
+    file.commit();
+}
+
+/////
+
+TilesetImageReaderWorker::TilesetImageReaderWorker(int id, InterruptibleThread *thread,
+                                                   const QString &cacheDirectory) :
     BaseWorker(thread),
     mID(id),
-    mHasJobs(false)
+    mHasJobs(false),
+    mCacheDirectory(cacheDirectory)
 {
 }
 
@@ -823,15 +945,22 @@ void TilesetImageReaderWorker::work()
 
         Job job = mJobs.takeAt(0);
 
-        QImage *image = new QImage(job.tileset->imageSource2x().isEmpty() ? job.tileset->imageSource() : job.tileset->imageSource2x());
+        QString source = job.tileset->imageSource2x().isEmpty() ? job.tileset->imageSource() : job.tileset->imageSource2x();
+        QImage image;
+        if (!mCacheDirectory.isEmpty())
+            image = readTilesetCache(mCacheDirectory, source);
+        if (image.isNull()) {
+            image = QImage(source).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+            if (!image.isNull() && !mCacheDirectory.isEmpty())
+                writeTilesetCache(mCacheDirectory, source, image);
+        }
 #if 0
         Sleep::msleep(500);
         qDebug() << "TilesetImageReaderThread #" << mID << "loaded" << job.tileset->imageSource();
 #endif
         Tileset *fromThread = new Tileset(job.tileset->name(), 64, 128);
         fromThread->setImageSource2x(job.tileset->imageSource2x());
-        fromThread->loadFromImage(*image, job.tileset->imageSource());
-        delete image;
+        fromThread->loadFromImage(image, job.tileset->imageSource());
         emit imageLoaded(fromThread, job.tileset);
     }
 
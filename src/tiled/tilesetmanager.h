@@ -43,7 +43,8 @@ class TilesetImageReaderWorker : public BaseWorker
 {
     Q_OBJECT
 public:
-    TilesetImageReaderWorker(int id, InterruptibleThread *thread);
+    TilesetImageReaderWorker(int id, InterruptibleThread *thread,
+                             const QString &cacheDirectory);
 
     ~TilesetImageReaderWorker();
 
@@ -72,6 +73,7 @@ private:
     int mID;
     QMutex mJobsMutex;
     bool mHasJobs;
+    QString mCacheDirectory;
 };
 #endif // ZOMBOID
 